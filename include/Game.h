@@ -120,6 +120,7 @@ class Game {
     Map* current_map;          /**< the map currently displayed */
     Map* next_map;             /**< the map where the hero is going to; if not NULL, it means that the hero
                                 * is changing from current_map to next_map */
+    MapPrefetcher* prefetcher; /**< reads in advance the maps where the hero may go next */
     Surface* previous_map_surface;  /**< a copy of the previous map surface for transition effects that display two maps */
 
     Transition::Style transition_style; /**< the transition style between the current map and the next one */
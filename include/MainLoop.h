@@ -19,6 +19,7 @@
 
 #include "Common.h"
 #include <string>
+#include <vector>
 
 /**
  * \brief Main class of the game engine.
@@ -45,12 +46,25 @@ class MainLoop {
   private:
 
     void check_input();
+    void run_benchmark();
+    void run_benchmark_suite();
+    bool start_benchmark_map();
+    void run_entities_benchmark();
+    void run_path_finding_benchmark(Map& map,
+        const std::vector<MapEntity*>& sources);
 
     Surface* root_surface;      /**< the surface where everything is drawn (always SOLARUS_GAME_WIDTH * SOLARUS_GAME_HEIGHT) */
     LuaContext* lua_context;    /**< the Lua world where scripts are run */
     bool exiting;               /**< indicates that the program is about to stop */
     Game* game;                 /**< The current game if any, NULL otherwise. */
     Game* next_game;            /**< The game to start at next cycle (NULL means resetting the game). */
+    InputRecording*
+      input_recording;          /**< Input events being recorded or replayed, or NULL. */
+    bool benchmark;             /**< Whether recorded inputs are replayed as fast as possible. */
+    std::string
+      benchmark_map_id;         /**< Test map of the benchmark suite, or an empty string. */
+    static const unsigned int
+      benchmark_seed = 42;      /**< Random seed of the benchmark suite. */
 
     void notify_input(const InputEvent& event);
     void draw();
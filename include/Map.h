@@ -24,6 +24,7 @@
 #include "entities/Ground.h"
 #include "lowlevel/Rectangle.h"
 #include "lua/ExportableToLua.h"
+#include <vector>
 
 /**
  * \brief Represents a map where the game can take place.
@@ -72,6 +73,9 @@ class Map: public ExportableToLua {
 
     // loading
     bool is_loaded() const;
+    void preload();
+    void preload(MapPreloader* preloader);
+    bool is_preloaded();
     void load(Game& game);
     void unload();
     Game& get_game();
@@ -117,6 +121,9 @@ class Map: public ExportableToLua {
         int x,
         int y,
         const MapEntity& entity_to_check) const;
+    int get_nb_reachable_positions(
+        const MapEntity& entity_to_check,
+        const std::vector<Rectangle>& path) const;
     bool has_empty_ground(
         Layer layer,
         const Rectangle& collision_box) const;
@@ -127,6 +134,10 @@ class Map: public ExportableToLua {
     // collisions with detectors (checked after a move)
     void check_collision_with_detectors(MapEntity& entity);
     void check_collision_with_detectors(MapEntity& entity, Sprite& sprite);
+    int check_collision_with_detectors(
+        MapEntity& entity,
+        const std::vector<Rectangle>& path,
+        int nb_positions);
 
     // main loop
     bool notify_input(const InputEvent& event);
@@ -151,6 +162,9 @@ class Map: public ExportableToLua {
     void draw_foreground();
 
     static MapLoader map_loader;  /**< the map file parser */
+    static const int
+        detector_margin = 16;     /**< distance around an entity where detectors are
+                                   * searched when it moves */
 
     // map properties
 
@@ -188,6 +202,8 @@ class Map: public ExportableToLua {
     Surface* background_surface;  /**< a surface filled with the background color of the tileset */
 
     // map state
+    MapPreloader* preloader;      /**< reads the map data in a background thread before
+                                   * the map is loaded, or NULL */
     bool loaded;                  /**< true if the loading phase is finished */
     bool started;                 /**< true if this map is the current map */
     std::string destination_name; /**< current destination point on the map,
@@ -18,13 +18,13 @@
 #define SOLARUS_MAP_LOADER_H
 
 #include "Common.h"
-
-struct lua_State;
+#include <lua.hpp>
 
 /**
  * \brief Parses a map file.
  *
- * This class loads a map and its content from a map file.
+ * This class loads a map and its content from the data read by a
+ * MapPreloader.
  */
 class MapLoader {
 
@@ -37,7 +37,12 @@ class MapLoader {
 
   private:
 
+    friend class MapPreloader; // the preloader records calls to the creation functions
+
     static int l_properties(lua_State* l);
+
+    static const luaL_Reg
+      entity_creation_functions[]; /**< functions that create entities from the map data file */
 };
 
 #endif
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_MAP_PREFETCHER_H
+#define SOLARUS_MAP_PREFETCHER_H
+
+#include "Common.h"
+#include <SDL.h>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Reads in advance the maps where the hero may go next.
+ *
+ * When a map starts, the destination maps of its teletransporters are
+ * preloaded by a low priority background thread: their data file and
+ * tileset (see MapPreloader), the images of the sprites their entities
+ * declare and their music file.
+ * When the hero then goes to one of these maps, Game takes the preloader
+ * from here and the map only has to create its entities.
+ *
+ * The memory kept for maps that the hero may never visit is limited by a
+ * budget. Sprite images are only decoded into the ImageCache, which has its
+ * own budget.
+ */
+class MapPrefetcher {
+
+  public:
+
+    MapPrefetcher();
+    ~MapPrefetcher();
+
+    void prefetch_neighbours(Map& map);
+    MapPreloader* take_preloader(const std::string& map_id);
+
+    size_t get_prefetched_bytes();
+    size_t get_max_bytes() const;
+    void set_max_bytes(size_t max_bytes);
+
+  private:
+
+    /**
+     * \brief A map read in advance.
+     */
+    struct PrefetchedMap {
+      MapPreloader* preloader;        /**< the data file and tileset of the map */
+      std::string music_file_name;    /**< music file read in advance, or an empty string */
+      size_t size;                    /**< estimated memory kept for this map in bytes */
+    };
+
+    static int thread_main(void* prefetcher);
+    void work();
+    PrefetchedMap prefetch(const std::string& map_id);
+    void discard(PrefetchedMap& prefetched_map);
+
+    SDL_Thread* thread;               /**< the low priority background thread */
+    SDL_mutex* mutex;                 /**< protects the fields below */
+    SDL_cond* queue_changed;          /**< signaled when maps are queued or when the thread stops */
+    SDL_cond* map_prefetched;         /**< signaled when the thread has finished a map */
+    std::deque<std::string>
+        pending_map_ids;              /**< maps to prefetch, in order */
+    std::set<std::string>
+        wanted_map_ids;               /**< neighbours of the current map */
+    std::string map_id_in_progress;   /**< map being read by the thread, or an empty string */
+    std::map<std::string, PrefetchedMap>
+        prefetched_maps;              /**< maps read in advance, indexed by id */
+    std::vector<std::string>
+        taken_music_file_names;       /**< music files of maps taken by Game,
+                                       * kept until the next call to prefetch_neighbours() */
+    size_t prefetched_bytes;          /**< estimated memory kept for all prefetched maps */
+    size_t max_bytes;                 /**< no more maps are prefetched above this size */
+    bool stopping;                    /**< true when the thread has to stop */
+};
+
+#endif
+
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_MAP_PRELOADER_H
+#define SOLARUS_MAP_PRELOADER_H
+
+#include "Common.h"
+#include <SDL.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+struct lua_State;
+
+/**
+ * \brief Reads the data of a map, possibly in a background thread.
+ *
+ * This is the part of map loading that does not need the game:
+ * the map data file is read and executed in an independent Lua world where
+ * entity declarations are only recorded, and the tileset of the map is
+ * parsed with its images decoded.
+ * The MapLoader then creates the entities from these declarations
+ * on the main thread.
+ *
+ * Several maps can be preloaded at the same time by different threads
+ * (see MapPrefetcher), but a preloader must only be used by one thread at
+ * a time.
+ */
+class MapPreloader {
+
+  public:
+
+    MapPreloader(const std::string& map_id);
+    ~MapPreloader();
+
+    void start();
+    void load();
+    bool try_load();
+    bool is_finished();
+    const std::string& get_error_message() const;
+    void wait();
+
+    lua_State* get_lua_state();
+    const std::string& get_tileset_id() const;
+    const std::string& get_music_id() const;
+    Tileset* release_tileset();
+    size_t get_memory_size();
+    void get_sprite_ids(std::set<std::string>& sprite_ids);
+    int get_nb_entities() const;
+    int get_entity_type(int index) const;
+    const std::string& get_entity_location(int index) const;
+
+  private:
+
+    /**
+     * \brief The compiled Lua chunk of a map data file.
+     */
+    struct CompiledMap {
+      int64_t modification_time;   /**< modification date of the data file when it was compiled */
+      std::string bytecode;        /**< the Lua bytecode of the data file */
+    };
+
+    /**
+     * \brief An entity declared in the map data file.
+     */
+    struct EntityDeclaration {
+      int type;                    /**< index of the creation function in MapLoader */
+      std::string location;        /**< position of the declaration in the data file */
+    };
+
+    static int thread_main(void* preloader);
+    bool load_data_file();
+
+    static int l_properties(lua_State* l);
+    static int l_entity(lua_State* l);
+    static int l_dump_chunk(lua_State* l, const void* data, size_t size, void* bytecode);
+    static MapPreloader& get_preloader(lua_State* l);
+
+    const std::string map_id;      /**< id of the map to read */
+    lua_State* l;                  /**< Lua world where the data file was executed,
+                                    * with the declarations stored in its registry */
+    std::string tileset_id;        /**< id of the tileset of the map */
+    std::string music_id;          /**< id of the music of the map */
+    Tileset* tileset;              /**< reference to the tileset in the TilesetCache
+                                    * (NULL once released) */
+    std::vector<EntityDeclaration>
+        entities;                  /**< entities declared, in the order of the data file */
+    SDL_Thread* thread;            /**< the background thread, or NULL */
+    SDL_atomic_t finished;         /**< 1 when all data is loaded */
+    std::string error_message;     /**< why the data could not be loaded */
+
+    static SDL_SpinLock
+      compiled_maps_lock;          /**< protects compiled_maps */
+    static std::map<std::string, CompiledMap>
+      compiled_maps;               /**< compiled map data files, indexed by map id */
+};
+
+#endif
+
@@ -44,20 +44,25 @@ class System;
 class FileTools;
 class VideoManager;
 class Surface;
+class ImageCache;
 class TextSurface;
 class Color;
 class PixelFilter;
+class WorkerPool;
+class Profiler;
 class Scale2xFilter;
 class Hq4xFilter;
 class Sound;
 class Music;
 class SpcDecoder;
 class ItDecoder;
+class RingBuffer;
 class Random;
 class Geometry;
 class Rectangle;
 class PixelBits;
 class InputEvent;
+class InputRecording;
 class Debug;
 class StringConcat;
 
@@ -71,6 +76,8 @@ class EquipmentItemUsage;
 class Treasure;
 class Map;
 class MapLoader;
+class MapPreloader;
+class MapPrefetcher;
 class Camera;
 class Dialog;
 class DialogResource;
@@ -98,6 +105,8 @@ class MapEntity;
 class Hero;
 class HeroSprites;
 class Tile;
+class AnimatedTileRegion;
+class NonAnimatedTileChunks;
 class DynamicTile;
 class Detector;
 class Teletransporter;
@@ -131,6 +140,7 @@ class Hookshot;
 
 // tile patterns
 class Tileset;
+class TilesetCache;
 class TilePattern;
 class SimpleTilePattern;
 class AnimatedTilePattern;
@@ -149,6 +159,7 @@ class PathMovement;
 class RandomPathMovement;
 class PathFindingMovement;
 class PathFinding;
+class WalkabilityGrid;
 class RandomMovement;
 class FollowMovement;
 class TargetMovement;
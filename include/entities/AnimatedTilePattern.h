@@ -61,9 +61,13 @@ class AnimatedTilePattern: public TilePattern {
     ~AnimatedTilePattern();
 
     static void update();
+    static int get_frame_counter();
+    static void set_frame_counter(int frame_counter);
+    static int get_frame(AnimationSequence sequence, int frame_counter);
     void draw(Surface& dst_surface, const Rectangle& dst_position,
         Tileset& tileset, const Rectangle& viewport);
     virtual bool is_drawn_at_its_position();
+    virtual int get_frame_sequence();
 };
 
 #endif
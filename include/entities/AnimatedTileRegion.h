@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_ANIMATED_TILE_REGION_H
+#define SOLARUS_ANIMATED_TILE_REGION_H
+
+#include "Common.h"
+#include "lowlevel/Rectangle.h"
+#include <vector>
+
+/**
+ * \brief A connected group of 8*8 squares of a map layer that contain
+ * animated tiles.
+ *
+ * Animated tile patterns all change their frame at the same time, so the
+ * whole region can be pre-rendered once for each possible frame when the
+ * map is loaded. Drawing the region then only takes one blit of the part
+ * that is visible in the camera.
+ *
+ * Regions never cross the boundaries of the map chunks, so that their
+ * bounding box stays small even when animated squares spread over the
+ * whole map.
+ *
+ * Regions containing tile patterns that do not only depend on the frame
+ * (like scrolling ones), or that do not fit in the remaining pixel budget
+ * of the map, are not pre-rendered: their tiles have to be drawn one by
+ * one at each cycle like before.
+ */
+class AnimatedTileRegion {
+
+  public:
+
+    AnimatedTileRegion(const Rectangle& area);
+    ~AnimatedTileRegion();
+
+    const Rectangle& get_area() const;
+    void add_square(int x8, int y8);
+    void add_tile(Tile& tile);
+    const std::vector<Tile*>& get_tiles() const;
+
+    bool build(int& pixel_budget);
+    bool is_built() const;
+    void draw(Map& map);
+
+  private:
+
+    void clear_frame_surfaces();
+
+    Rectangle area;                      /**< bounding box of the region in the map */
+    std::vector<bool> squares;           /**< whether each 8*8 square of the bounding box
+                                          * belongs to the region */
+    std::vector<Tile*> tiles;            /**< animated tiles and tiles overlapping them
+                                          * in this region, in drawing order */
+    std::vector<Surface*>
+        frame_surfaces;                  /**< the region pre-rendered with each different
+                                          * combination of frames (empty if not built) */
+    int frame_surface_indexes[12];       /**< index in frame_surfaces for each value of the
+                                          * frame counter of animated tile patterns */
+};
+
+#endif
+
@@ -70,6 +70,7 @@ class CarriedItem: public MapEntity {
     void set_suspended(bool suspended);
     void update();
     void draw_on_map();
+    Rectangle get_max_drawn_bounding_box() const;
 
     bool is_teletransporter_obstacle(const Teletransporter& teletransporter) const;
     bool is_conveyor_belt_obstacle(const ConveyorBelt& conveyor_belt) const;
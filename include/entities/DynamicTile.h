@@ -39,6 +39,7 @@ class DynamicTile: public MapEntity {
 
     EntityType get_type() const;
     void set_map(Map& map);
+    void notify_tileset_changed();
     bool is_ground_modifier() const;
     Ground get_modified_ground() const;
     bool is_obstacle_for(const MapEntity& other) const;
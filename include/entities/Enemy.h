@@ -160,6 +160,7 @@ class Enemy: public Detector {
     void update();
     void set_suspended(bool suspended);
     void draw_on_map();
+    Rectangle get_max_drawn_bounding_box() const;
 
     void notify_enabled(bool enabled);
     void notify_ground_below_changed();
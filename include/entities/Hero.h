@@ -57,6 +57,7 @@ class Hero: public MapEntity {
      */
     void update();
     void draw_on_map();
+    Rectangle get_max_drawn_bounding_box() const;
     void set_suspended(bool suspended);
     void notify_command_pressed(GameCommands::Command command);
     void notify_command_released(GameCommands::Command command);
@@ -60,6 +60,7 @@ class Hookshot: public MapEntity {
     // state
     void update();
     virtual void draw_on_map();
+    virtual Rectangle get_max_drawn_bounding_box() const;
     const Rectangle get_facing_point() const;
     bool is_flying() const;
     bool is_going_back() const;
@@ -23,6 +23,8 @@
 #include "entities/Layer.h"
 #include "entities/EntityType.h"
 #include "entities/Enemy.h"
+#include "lowlevel/Grid.h"
+#include "movements/WalkabilityGrid.h"
 #include <vector>
 #include <list>
 
@@ -45,12 +47,17 @@ class MapEntities {
     // entities
     Hero& get_hero();
     Ground get_tile_ground(Layer layer, int x, int y) const;
-    const std::list<MapEntity*>& get_obstacle_entities(Layer layer);
-    const std::list<MapEntity*>& get_ground_observers(Layer layer);
-    const std::list<MapEntity*>& get_ground_modifiers(Layer layer);
-    const std::list<Detector*>& get_detectors();
-    const std::list<Stairs*>& get_stairs(Layer layer);
-    const std::list<CrystalBlock*>& get_crystal_blocks(Layer layer);
+    const std::vector<MapEntity*>& get_obstacle_entities(Layer layer);
+    const std::vector<MapEntity*>& get_ground_observers(Layer layer);
+    const std::vector<MapEntity*>& get_ground_modifiers(Layer layer);
+    const std::vector<MapEntity*>& get_ground_modifiers(Layer layer, int x, int y);
+    const WalkabilityGrid& get_walkability_grid() const;
+    const std::vector<Detector*>& get_detectors();
+    void get_obstacle_entities(Layer layer, const Rectangle& where,
+        std::vector<MapEntity*>& obstacle_entities);
+    void get_detectors(const Rectangle& where, std::vector<Detector*>& detectors);
+    const std::vector<Stairs*>& get_stairs(Layer layer);
+    const std::vector<CrystalBlock*>& get_crystal_blocks(Layer layer);
     const std::list<const Separator*>& get_separators() const;
     Destination* get_default_destination();
 
@@ -59,6 +66,11 @@ class MapEntities {
     std::list<MapEntity*> get_entities_with_prefix(const std::string& prefix);
     std::list<MapEntity*> get_entities_with_prefix(EntityType type, const std::string& prefix);
     bool has_entity_with_prefix(const std::string& prefix) const;
+    int get_entities_count_with_prefix(const std::string& prefix) const;
+    MapEntity* get_next_entity_with_prefix(const std::string& prefix,
+        const std::string& previous_name,
+        uint32_t max_creation_index = 0xFFFFFFFF) const;
+    uint32_t get_last_creation_index() const;
 
     // handle entities
     void add_entity(MapEntity* entity);
@@ -70,6 +82,15 @@ class MapEntities {
     void destroy_entity(MapEntity* entity);
     static bool compare_y(MapEntity* first, MapEntity* second);
     void set_entity_layer(MapEntity& entity, Layer layer);
+    void notify_entity_bounding_box_changed(MapEntity& entity);
+    void notify_ground_modifier_changed(MapEntity& ground_modifier);
+    void get_default_update_lod(EntityType type, int& margin, int& interval) const;
+    void set_default_update_lod(EntityType type, int margin, int interval);
+
+    // debugging
+    int get_num_grid_queries() const;
+    int get_num_grid_candidates() const;
+    void reset_grid_statistics();
 
     // specific to some entity types
     bool overlaps_raised_blocks(Layer layer, const Rectangle& rectangle);
@@ -95,8 +116,15 @@ class MapEntities {
     void set_tile_ground(Layer layer, int x8, int y8, Ground ground);
     void build_non_animated_tiles();
     void redraw_non_animated_tiles();
+    void add_non_animated_tiles_to_chunks(int layer);
     bool overlaps_animated_tile(Tile& tile);
+    void build_animated_tile_regions(int layer);
+    void build_animated_tile_frames(int layer);
+    void destroy_animated_tile_regions(int layer);
+    bool is_in_entities_grid(const MapEntity& entity) const;
+    bool is_in_prefix_query(const MapEntity& entity) const;
     void remove_marked_entities();
+    void sort_entities_drawn_y_order();
     void update_crystal_blocks();
 
     // map
@@ -116,45 +144,82 @@ class MapEntities {
                                                      * of each 8x8 square. */
     bool* animated_tiles[LAYER_NB];                 /**< array of size tiles_grid_size that remembers which squares
                                                      * have animated tiles */
-    Surface* non_animated_tiles_surfaces[LAYER_NB]; /**< all non-animated tiles are rendered once for all on these surfaces
-                                                     * for performance */
+    NonAnimatedTileChunks*
+        non_animated_tiles[LAYER_NB];               /**< all non-animated tiles are rendered once for all on these chunks
+                                                     * for performance, as the camera gets close to them */
     std::vector<Tile*>
         tiles_in_animated_regions[LAYER_NB];        /**< animated tiles and tiles overlapping them */
+    std::vector<AnimatedTileRegion*>
+        animated_tile_regions[LAYER_NB];            /**< connected groups of animated squares, pre-rendered
+                                                     * for each frame when possible */
+    std::vector<Tile*>
+        tiles_drawn_individually[LAYER_NB];         /**< tiles of the animated regions that cannot be
+                                                     * pre-rendered, drawn one by one at each cycle */
+    int animated_tiles_pixel_budget;                /**< number of pixels that can still be used to
+                                                     * pre-render animated regions on all layers */
+    static const int
+        animated_tiles_chunk_size = 256;            /**< animated regions never cross the boundaries of
+                                                     * chunks of this size in pixels */
+    static const int
+        max_animated_tiles_pixels = 1 << 22;        /**< maximum total size in pixels of the pre-rendered
+                                                     * frames of all animated regions of the map */
 
     // dynamic entities
     Hero& hero;                                     /**< the hero (also stored in Game because it is kept when changing maps) */
 
     std::map<std::string, MapEntity*>
-      named_entities;                               /**< entities identified by a name */
-    std::list<MapEntity*> all_entities;             /**< all map entities except the tiles and the hero;
+      named_entities;                               /**< entities identified by a name, sorted by name
+                                                     * so that a prefix is a contiguous range */
+    std::vector<MapEntity*> all_entities;           /**< all map entities except the tiles and the hero;
                                                      * this vector is used to delete the entities
-                                                     * when the map is unloaded */
+                                                     * when the map is unloaded (removing an entity
+                                                     * keeps the order of the other ones) */
     std::list<MapEntity*> entities_to_remove;       /**< list of entities that need to be removed right now */
+    uint32_t last_creation_index;                   /**< creation index of the last entity added
+                                                     * (the hero has index 0) */
 
     std::list<MapEntity*>
       entities_drawn_first[LAYER_NB];               /**< all map entities that are drawn in the normal order */
 
-    std::list<MapEntity*>
+    std::vector<MapEntity*>
       entities_drawn_y_order[LAYER_NB];             /**< all map entities that are drawn in the order
                                                      * defined by their y position, including the hero */
+    std::vector<int> y_order_keys;                  /**< temporary buffer of sort_entities_drawn_y_order() */
 
-    std::list<Detector*> detectors;                 /**< all entities able to detect other entities
+    std::vector<Detector*> detectors;               /**< all entities able to detect other entities
                                                      * on this map.
                                                      * TODO store them by layer like obstacle_entities */
-    std::list<MapEntity*>
+    std::vector<MapEntity*>
       ground_observers[LAYER_NB];                   /**< all dynamic entities sensible to the ground
                                                      * below them */
-    std::list<MapEntity*>
+    std::vector<MapEntity*>
       ground_modifiers[LAYER_NB];                   /**< all dynamic entities that may change the ground of
                                                      * the map where they are placed */
+    Grid<MapEntity*>*
+      ground_modifiers_grid[LAYER_NB];              /**< ground modifiers of each layer stored by location */
+    std::vector<MapEntity*> ground_modifiers_found; /**< temporary buffer of ground_modifiers_grid queries */
+    static const int
+        ground_modifiers_grid_cell_size = 8;        /**< size of a cell of ground_modifiers_grid in pixels */
+    WalkabilityGrid walkability_grid;               /**< cache of the terrain obstacles for the path finding */
     Destination* default_destination;               /**< the default destination of this map */
+    int
+      default_update_lod_margins[ENTITY_NUMBER];    /**< update level of detail margin of each entity type
+                                                     * (0 means disabled, see MapEntity::set_update_lod()) */
+    int
+      default_update_lod_intervals[ENTITY_NUMBER];  /**< update level of detail interval of each entity type */
 
-    std::list<MapEntity*>
+    std::vector<MapEntity*>
       obstacle_entities[LAYER_NB];                  /**< all entities that might be obstacle for other
                                                      * entities on this map, including the hero */
 
-    std::list<Stairs*> stairs[LAYER_NB];            /**< all stairs of the map */
-    std::list<CrystalBlock*>
+    Grid<MapEntity*>* entities_grid;                /**< obstacle entities and detectors (including the hero)
+                                                     * stored by location for fast collision tests */
+    std::vector<MapEntity*> entities_found;         /**< temporary buffer of entities_grid queries */
+    static const int
+        entities_grid_cell_size = 64;               /**< size of a cell of entities_grid in pixels */
+
+    std::vector<Stairs*> stairs[LAYER_NB];          /**< all stairs of the map */
+    std::vector<CrystalBlock*>
       crystal_blocks[LAYER_NB];                     /**< all crystal blocks of the map */
     std::list<const Separator*> separators;         /**< all separators of the map */
 
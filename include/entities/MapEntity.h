@@ -73,6 +73,8 @@ class MapEntity: public ExportableToLua {
     bool is_on_map() const;
     virtual void set_map(Map& map);
     Map& get_map() const;
+    uint32_t get_creation_index() const;
+    void set_creation_index(uint32_t creation_index);
     virtual void notify_map_started();
     virtual void notify_map_opening_transition_finished();
     virtual void notify_tileset_changed();
@@ -124,6 +126,10 @@ class MapEntity: public ExportableToLua {
     int get_optimization_distance() const;
     int get_optimization_distance2() const;
     void set_optimization_distance(int distance);
+    int get_update_lod_margin() const;
+    int get_update_lod_interval() const;
+    void set_update_lod(int margin, int interval);
+    bool check_update_lod();
 
     bool is_enabled() const;
     void set_enabled(bool enable);
@@ -177,6 +183,7 @@ class MapEntity: public ExportableToLua {
     bool overlaps(int x, int y) const;
     bool overlaps(const MapEntity& other) const;
     bool overlaps_camera() const;
+    virtual Rectangle get_max_drawn_bounding_box() const;
     bool is_origin_point_in(const Rectangle& rectangle) const;
     bool is_facing_point_in(const Rectangle& rectangle) const;
     bool is_facing_point_in(const Rectangle& rectangle, int direction) const;
@@ -294,6 +301,8 @@ class MapEntity: public ExportableToLua {
     MapEntity(const MapEntity& other);
     MapEntity& operator=(const MapEntity& other);
 
+    void notify_bounding_box_changed();
+
     MainLoop* main_loop;                        /**< The Solarus main loop. */
     Map* map;                                   /**< The map where this entity is, or NULL
                                                  * (automatically set by class MapEntities after adding the entity to the map) */
@@ -350,6 +359,21 @@ class MapEntity: public ExportableToLua {
     int optimization_distance2;                 /**< Square of optimization_distance. */
     static const int
         default_optimization_distance = 400;    /**< default value */
+    static const int
+        drawn_margin = 16;                      /**< margin added around the sprites for what is drawn
+                                                 * next to them (like shadows) */
+
+    int update_lod_margin;                      /**< beyond this distance from the visible area, the entity
+                                                 * is updated less often (0 means never, -1 means the
+                                                 * default value of its type) */
+    int update_lod_interval;                    /**< delay between two updates when the entity is beyond
+                                                 * update_lod_margin (0 means no update) */
+    uint32_t next_lod_update_date;              /**< date of the next update when the entity is beyond
+                                                 * update_lod_margin */
+    bool lod_suspended;                         /**< true if the entity is suspended only because it is
+                                                 * beyond update_lod_margin */
+    uint32_t creation_index;                    /**< order in which the entity was added to its map
+                                                 * (0 for the hero, see MapEntities::add_entity()) */
 
 };
 
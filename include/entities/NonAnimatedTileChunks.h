@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_NON_ANIMATED_TILE_CHUNKS_H
+#define SOLARUS_NON_ANIMATED_TILE_CHUNKS_H
+
+#include "Common.h"
+#include <vector>
+
+/**
+ * \brief The non-animated tiles of a map layer, pre-rendered by chunks.
+ *
+ * Non-animated tiles are drawn once on intermediate surfaces for
+ * performance. Instead of one surface of the size of the map, the layer is
+ * divided into square chunks. A chunk is rendered the first time it is
+ * needed, i.e. when it becomes visible or is close to the camera,
+ * and the least recently drawn chunks are destroyed when there are
+ * too many of them. This way, the memory used and the loading time only
+ * depend on the part of the map that was visited.
+ *
+ * Squares that contain animated tiles are left transparent since they are
+ * drawn separately.
+ */
+class NonAnimatedTileChunks {
+
+  public:
+
+    NonAnimatedTileChunks(int map_width, int map_height,
+        const bool* animated_squares);
+    ~NonAnimatedTileChunks();
+
+    void add_tile(Tile& tile);
+    void clear();
+    void draw(Surface& dst_surface, const Rectangle& camera_position);
+
+  private:
+
+    /**
+     * \brief A square part of the layer.
+     */
+    struct Chunk {
+      std::vector<Tile*> tiles;  /**< non-animated tiles overlapping this chunk, in drawing order */
+      Surface* surface;          /**< the tiles rendered, or NULL if not built */
+      uint32_t last_draw_index;  /**< value of draw_index when this chunk was last drawn */
+    };
+
+    void get_chunks_in_rectangle(const Rectangle& where,
+        int& first_column, int& first_row, int& last_column, int& last_row) const;
+    void build_chunk(int column, int row);
+    void destroy_old_chunks();
+
+    static const int
+        chunk_size = 256;                /**< width and height of a chunk in pixels */
+    static const int
+        max_chunks = 24;                 /**< maximum number of chunks built at the same time */
+    static const int
+        prefetch_margin = 64;            /**< chunks closer than this distance to the camera
+                                          * are built before they become visible */
+
+    const int map_width;                 /**< width of the map in pixels */
+    const int map_height;                /**< height of the map in pixels */
+    const bool* animated_squares;        /**< which 8*8 squares of the map have animated
+                                          * tiles (not owned) */
+    const int nb_columns;                /**< number of chunks on a row */
+    const int nb_rows;                   /**< number of chunks on a column */
+    std::vector<Chunk> chunks;           /**< all chunks of the layer, row by row */
+    int nb_chunks_built;                 /**< number of chunks that have a surface */
+    uint32_t draw_index;                 /**< number of calls to draw() so far */
+};
+
+#endif
+
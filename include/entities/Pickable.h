@@ -56,6 +56,7 @@ class Pickable: public Detector {
     void notify_collision(MapEntity& other_entity, Sprite& other_sprite, Sprite& this_sprite);
     void update();
     void draw_on_map();
+    Rectangle get_max_drawn_bounding_box() const;
 
     virtual const std::string& get_lua_type_name() const;
 
@@ -67,6 +67,9 @@ class Teletransporter: public Detector {
 
     EntityType get_type() const;
     void set_map(Map& map);
+    void update();
+
+    const std::string& get_destination_map_id() const;
 
     bool is_obstacle_for(const MapEntity& other) const;
     bool test_collision_custom(MapEntity& entity);
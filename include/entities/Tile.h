@@ -44,6 +44,7 @@ class Tile: public MapEntity {
 
     EntityType get_type() const;
     void set_map(Map& map);
+    void notify_tileset_changed();
     void draw_on_map();
     void draw(Surface& dst_surface, const Rectangle& viewport);
     TilePattern& get_tile_pattern();
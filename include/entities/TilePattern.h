@@ -53,6 +53,7 @@ class TilePattern {
         Tileset& tileset, const Rectangle& viewport) = 0;
     virtual bool is_animated();
     virtual bool is_drawn_at_its_position();
+    virtual int get_frame_sequence();
 
   protected:
 
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_TILESET_CACHE_H
+#define SOLARUS_TILESET_CACHE_H
+
+#include "Common.h"
+#include <SDL.h>
+#include <list>
+#include <map>
+#include <string>
+
+/**
+ * \brief Keeps loaded tilesets in memory to share them between maps.
+ *
+ * Maps that use the same tileset share one Tileset object, so going back
+ * and forth between them does not parse the tileset data file again.
+ * Tilesets are reference-counted: each map using a tileset holds a
+ * reference.
+ * When the tilesets kept exceed a memory budget, the least recently used
+ * ones that no map uses anymore are destroyed.
+ *
+ * Shared tilesets must not be modified.
+ * A map that changes its tileset images (see Map::set_tileset()) gets
+ * another shared tileset that combines the tile patterns of its original
+ * tileset with the images of the new one.
+ *
+ * Tilesets may be requested from a background thread (see MapPreloader).
+ */
+class TilesetCache {
+
+  public:
+
+    static void initialize(int argc, char** argv);
+    static void quit();
+
+    static Tileset* get_tileset(const std::string& tileset_id);
+    static Tileset* get_tileset(const std::string& tileset_id,
+        const std::string& images_tileset_id);
+    static void release_tileset(Tileset* tileset);
+
+    static int get_nb_hits();
+    static int get_nb_misses();
+    static double get_load_time();
+    static size_t get_resident_bytes();
+    static size_t get_max_bytes();
+    static void set_max_bytes(size_t max_bytes);
+
+    static size_t get_size(Tileset& tileset);
+
+  private:
+
+    /**
+     * \brief A tileset kept in the cache.
+     */
+    struct Entry {
+      Tileset* tileset;                              /**< the loaded tileset */
+      int refcount;                                  /**< number of maps using it */
+      size_t size;                                   /**< estimated memory used by the tileset in bytes */
+      std::list<std::string>::iterator lru_position; /**< position of the key in the LRU list */
+    };
+
+    TilesetCache();
+
+    static Tileset* load_tileset(const std::string& tileset_id,
+        const std::string& images_tileset_id);
+    static void evict_unused_tilesets();
+
+    static SDL_mutex* mutex;                         /**< protects the fields below */
+    static std::map<std::string, Entry> tilesets;    /**< the tilesets kept, indexed by key */
+    static std::map<const Tileset*, std::string>
+        keys;                                        /**< key of each tileset kept */
+    static std::list<std::string> lru_keys;          /**< keys of the tilesets, most recently used first */
+    static size_t resident_bytes;                    /**< memory used by all tilesets kept */
+    static size_t max_bytes;                         /**< budget above which unused tilesets are destroyed */
+    static int nb_hits;                              /**< number of requests that found their tileset */
+    static int nb_misses;                            /**< number of requests that loaded their tileset */
+    static double load_time;                         /**< total time spent loading tilesets in milliseconds */
+};
+
+#endif
+
@@ -18,6 +18,8 @@
 #define SOLARUS_FILE_TOOLS_H
 
 #include "Common.h"
+#include <SDL.h>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -58,6 +60,7 @@ class FileTools {
         const std::string& file_name);
     static bool data_file_exists(const std::string& file_name,
         bool language_specific = false);
+    static int64_t data_file_get_modification_time(const std::string& file_name);
     static std::istream& data_file_open(const std::string& file_name,
         bool language_specific = false);
     static void data_file_close(const std::istream& data_file);
@@ -66,6 +69,8 @@ class FileTools {
     static void data_file_save_buffer(const std::string& file_name,
         const char* buffer, size_t size);
     static void data_file_close_buffer(char* buffer);
+    static size_t data_file_prefetch(const std::string& file_name);
+    static void data_file_discard_prefetched(const std::string& file_name);
     static bool data_file_delete(const std::string& file_name);
     static bool data_file_mkdir(const std::string& dir_name);
 
@@ -104,6 +109,19 @@ class FileTools {
     static std::string language_code;                    /**< Code of the current language (e.g. "en", "fr", etc.). */
 
     static std::vector<std::string> temporary_files;     /**< Name of all temporary files created. */
+
+    /**
+     * \brief Content of a data file read in advance.
+     */
+    struct PrefetchedFile {
+      char* buffer;                                      /**< the content of the file */
+      size_t size;                                       /**< size of the buffer in bytes */
+    };
+
+    static SDL_mutex* prefetched_files_mutex;            /**< protects prefetched_files */
+    static std::map<std::string, PrefetchedFile>
+        prefetched_files;                                /**< data files read in advance by
+                                                          * data_file_prefetch(), indexed by name */
 };
 
 #endif
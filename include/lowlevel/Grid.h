@@ -0,0 +1,469 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_GRID_H
+#define SOLARUS_GRID_H
+
+#include "Common.h"
+#include "lowlevel/Rectangle.h"
+#include "lowlevel/Debug.h"
+#include <algorithm>
+#include <map>
+#include <vector>
+
+/**
+ * \brief A uniform grid of cells that stores elements by location.
+ *
+ * Each element is stored in every cell overlapped by its rectangle.
+ * This makes it fast to find the elements that may overlap a given area:
+ * only the cells of that area are visited instead of all elements.
+ *
+ * Elements outside the grid are stored in the closest border cells, so
+ * queries never miss them.
+ *
+ * Queries return elements in the order they were added, without duplicates.
+ * Moving an element does not change its order.
+ *
+ * \param T Type of elements (typically a pointer type).
+ */
+template<typename T>
+class Grid {
+
+  public:
+
+    Grid(const Rectangle& grid_size, const Rectangle& cell_size);
+
+    const Rectangle& get_grid_size() const;
+    const Rectangle& get_cell_size() const;
+    int get_num_rows() const;
+    int get_num_columns() const;
+    int get_num_elements() const;
+
+    void clear();
+    bool has(const T& element) const;
+    Rectangle get_cells_area(const T& element) const;
+    void add(const T& element, const Rectangle& where);
+    void move(const T& element, const Rectangle& where);
+    void remove(const T& element);
+    void get_elements(const Rectangle& where, std::vector<T>& elements) const;
+
+    // Debugging statistics.
+    int get_num_queries() const;
+    int get_num_candidates() const;
+    void reset_statistics();
+
+  private:
+
+    /**
+     * \brief An element stored in a cell.
+     */
+    struct Entry {
+      int order;                  /**< Insertion order of the element. */
+      T element;                  /**< The element. */
+
+      bool operator<(const Entry& other) const {
+        return order < other.order;
+      }
+      bool operator==(const Entry& other) const {
+        return order == other.order;
+      }
+    };
+
+    /**
+     * \brief The cells where an element is currently stored.
+     */
+    struct Location {
+      int order;                  /**< Insertion order of the element. */
+      int row1, column1;          /**< Top-left cell of the element. */
+      int row2, column2;          /**< Bottom-right cell of the element. */
+    };
+
+    void get_cells(const Rectangle& where,
+        int& row1, int& column1, int& row2, int& column2) const;
+    void add_to_cells(const Entry& entry, const Location& location);
+    void remove_from_cells(const T& element, const Location& location);
+
+    Rectangle grid_size;          /**< Size of the area covered by the grid. */
+    Rectangle cell_size;          /**< Size of each cell. */
+    int num_rows;                 /**< Number of rows of cells. */
+    int num_columns;              /**< Number of columns of cells. */
+    std::vector<std::vector<Entry> >
+        cells;                    /**< Elements of each cell, row by row. */
+    std::map<T, Location>
+        locations;                /**< Cells occupied by each element. */
+    int next_order;               /**< Insertion order of the next element added. */
+
+    mutable std::vector<Entry>
+        candidates;               /**< Temporary buffer used by queries. */
+    mutable int num_queries;      /**< Number of queries since the last reset. */
+    mutable int num_candidates;   /**< Number of elements returned by queries
+                                   * since the last reset. */
+};
+
+/**
+ * \brief Creates an empty grid.
+ * \param grid_size Size of the area covered by the grid.
+ * Only the width and the height are used.
+ * \param cell_size Size of each cell. Only the width and the height are used.
+ */
+template<typename T>
+Grid<T>::Grid(const Rectangle& grid_size, const Rectangle& cell_size):
+  grid_size(0, 0, grid_size.get_width(), grid_size.get_height()),
+  cell_size(0, 0, cell_size.get_width(), cell_size.get_height()),
+  num_rows(0),
+  num_columns(0),
+  next_order(0),
+  num_queries(0),
+  num_candidates(0) {
+
+  Debug::check_assertion(cell_size.get_width() > 0 && cell_size.get_height() > 0,
+      "Invalid grid cell size");
+
+  num_columns = std::max(1, (grid_size.get_width() + cell_size.get_width() - 1) / cell_size.get_width());
+  num_rows = std::max(1, (grid_size.get_height() + cell_size.get_height() - 1) / cell_size.get_height());
+  cells.resize(num_rows * num_columns);
+}
+
+/**
+ * \brief Returns the size of the area covered by this grid.
+ * \return The size of the grid.
+ */
+template<typename T>
+const Rectangle& Grid<T>::get_grid_size() const {
+  return grid_size;
+}
+
+/**
+ * \brief Returns the size of each cell.
+ * \return The size of a cell.
+ */
+template<typename T>
+const Rectangle& Grid<T>::get_cell_size() const {
+  return cell_size;
+}
+
+/**
+ * \brief Returns the number of rows of cells.
+ * \return The number of rows.
+ */
+template<typename T>
+int Grid<T>::get_num_rows() const {
+  return num_rows;
+}
+
+/**
+ * \brief Returns the number of columns of cells.
+ * \return The number of columns.
+ */
+template<typename T>
+int Grid<T>::get_num_columns() const {
+  return num_columns;
+}
+
+/**
+ * \brief Returns the number of elements stored in this grid.
+ * \return The number of elements.
+ */
+template<typename T>
+int Grid<T>::get_num_elements() const {
+  return locations.size();
+}
+
+/**
+ * \brief Removes all elements from this grid.
+ */
+template<typename T>
+void Grid<T>::clear() {
+
+  for (unsigned int i = 0; i < cells.size(); ++i) {
+    cells[i].clear();
+  }
+  locations.clear();
+  next_order = 0;
+}
+
+/**
+ * \brief Returns whether an element is stored in this grid.
+ * \param element The element to check.
+ * \return \c true if this element is in the grid.
+ */
+template<typename T>
+bool Grid<T>::has(const T& element) const {
+  return locations.find(element) != locations.end();
+}
+
+/**
+ * \brief Returns the area covered by the cells where an element is stored.
+ *
+ * This contains the rectangle occupied by the element the last time it
+ * was added or moved, as long as this rectangle is inside the grid.
+ *
+ * \param element An element of the grid.
+ * \return The rectangle covered by its cells, or an empty rectangle if the
+ * element is not in the grid.
+ */
+template<typename T>
+Rectangle Grid<T>::get_cells_area(const T& element) const {
+
+  typename std::map<T, Location>::const_iterator it = locations.find(element);
+  if (it == locations.end()) {
+    return Rectangle();
+  }
+
+  const Location& location = it->second;
+  const int cell_width = cell_size.get_width();
+  const int cell_height = cell_size.get_height();
+  return Rectangle(
+      location.column1 * cell_width,
+      location.row1 * cell_height,
+      (location.column2 - location.column1 + 1) * cell_width,
+      (location.row2 - location.row1 + 1) * cell_height);
+}
+
+/**
+ * \brief Adds an element to this grid.
+ *
+ * The element must not be already in the grid.
+ *
+ * \param element The element to add.
+ * \param where Rectangle occupied by the element.
+ */
+template<typename T>
+void Grid<T>::add(const T& element, const Rectangle& where) {
+
+  Debug::check_assertion(!has(element), "This element is already in the grid");
+
+  Location location;
+  location.order = next_order++;
+  get_cells(where, location.row1, location.column1, location.row2, location.column2);
+  locations[element] = location;
+
+  Entry entry;
+  entry.order = location.order;
+  entry.element = element;
+  add_to_cells(entry, location);
+}
+
+/**
+ * \brief Updates the location of an element of this grid.
+ *
+ * Call this function when the rectangle occupied by the element changes.
+ * If the element is not in the grid, nothing happens.
+ *
+ * \param element The element that has moved.
+ * \param where The new rectangle occupied by the element.
+ */
+template<typename T>
+void Grid<T>::move(const T& element, const Rectangle& where) {
+
+  typename std::map<T, Location>::iterator it = locations.find(element);
+  if (it == locations.end()) {
+    return;
+  }
+
+  Location& location = it->second;
+  int row1, column1, row2, column2;
+  get_cells(where, row1, column1, row2, column2);
+  if (row1 == location.row1
+      && column1 == location.column1
+      && row2 == location.row2
+      && column2 == location.column2) {
+    // Still in the same cells: this is the most common case.
+    return;
+  }
+
+  remove_from_cells(element, location);
+  location.row1 = row1;
+  location.column1 = column1;
+  location.row2 = row2;
+  location.column2 = column2;
+
+  Entry entry;
+  entry.order = location.order;
+  entry.element = element;
+  add_to_cells(entry, location);
+}
+
+/**
+ * \brief Removes an element from this grid.
+ *
+ * If the element is not in the grid, nothing happens.
+ *
+ * \param element The element to remove.
+ */
+template<typename T>
+void Grid<T>::remove(const T& element) {
+
+  typename std::map<T, Location>::iterator it = locations.find(element);
+  if (it == locations.end()) {
+    return;
+  }
+
+  remove_from_cells(element, it->second);
+  locations.erase(it);
+}
+
+/**
+ * \brief Returns the elements that may overlap a rectangle.
+ *
+ * All elements stored in the cells overlapped by the rectangle are returned,
+ * so the caller still has to test the exact collision.
+ * Elements are returned in the order they were added to the grid,
+ * and each element is returned only once.
+ *
+ * \param where The rectangle to check.
+ * \param[out] elements The elements found are appended to this vector.
+ */
+template<typename T>
+void Grid<T>::get_elements(const Rectangle& where, std::vector<T>& elements) const {
+
+  int row1, column1, row2, column2;
+  get_cells(where, row1, column1, row2, column2);
+
+  candidates.clear();
+  for (int i = row1; i <= row2; ++i) {
+    for (int j = column1; j <= column2; ++j) {
+      const std::vector<Entry>& cell = cells[i * num_columns + j];
+      candidates.insert(candidates.end(), cell.begin(), cell.end());
+    }
+  }
+
+  if (row1 != row2 || column1 != column2) {
+    // Several cells: remove duplicates and restore the insertion order.
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+  }
+
+  const typename std::vector<Entry>::const_iterator end = candidates.end();
+  typename std::vector<Entry>::const_iterator it;
+  for (it = candidates.begin(); it != end; ++it) {
+    elements.push_back(it->element);
+  }
+
+  ++num_queries;
+  num_candidates += candidates.size();
+}
+
+/**
+ * \brief Returns the number of queries made since the last reset.
+ * \return The number of calls to get_elements().
+ */
+template<typename T>
+int Grid<T>::get_num_queries() const {
+  return num_queries;
+}
+
+/**
+ * \brief Returns the number of candidates returned since the last reset.
+ *
+ * Divide by get_num_queries() to know the average number of candidates
+ * tested per query.
+ *
+ * \return The total number of elements returned by get_elements().
+ */
+template<typename T>
+int Grid<T>::get_num_candidates() const {
+  return num_candidates;
+}
+
+/**
+ * \brief Resets the debugging statistics of queries.
+ */
+template<typename T>
+void Grid<T>::reset_statistics() {
+
+  num_queries = 0;
+  num_candidates = 0;
+}
+
+/**
+ * \brief Determines the range of cells overlapped by a rectangle.
+ *
+ * Cells are clamped to the grid, so that a rectangle outside the grid
+ * is considered to be in the closest border cells.
+ * A rectangle with an empty size is considered to be a single point.
+ *
+ * \param where The rectangle.
+ * \param[out] row1 First row overlapped.
+ * \param[out] column1 First column overlapped.
+ * \param[out] row2 Last row overlapped.
+ * \param[out] column2 Last column overlapped.
+ */
+template<typename T>
+void Grid<T>::get_cells(const Rectangle& where,
+    int& row1, int& column1, int& row2, int& column2) const {
+
+  const int x1 = where.get_x();
+  const int y1 = where.get_y();
+  const int x2 = x1 + std::max(1, where.get_width()) - 1;
+  const int y2 = y1 + std::max(1, where.get_height()) - 1;
+  const int cell_width = cell_size.get_width();
+  const int cell_height = cell_size.get_height();
+
+  // Careful: integer division rounds towards zero.
+  column1 = (x1 < 0) ? 0 : std::min(x1 / cell_width, num_columns - 1);
+  column2 = (x2 < 0) ? 0 : std::min(x2 / cell_width, num_columns - 1);
+  row1 = (y1 < 0) ? 0 : std::min(y1 / cell_height, num_rows - 1);
+  row2 = (y2 < 0) ? 0 : std::min(y2 / cell_height, num_rows - 1);
+}
+
+/**
+ * \brief Stores an element in all cells of a location.
+ * \param entry The element to store.
+ * \param location Cells where to store it.
+ */
+template<typename T>
+void Grid<T>::add_to_cells(const Entry& entry, const Location& location) {
+
+  for (int i = location.row1; i <= location.row2; ++i) {
+    for (int j = location.column1; j <= location.column2; ++j) {
+      std::vector<Entry>& cell = cells[i * num_columns + j];
+
+      // Keep each cell sorted by insertion order.
+      // Elements are usually added after the existing ones.
+      typename std::vector<Entry>::iterator position = cell.end();
+      if (!cell.empty() && entry < cell.back()) {
+        position = std::upper_bound(cell.begin(), cell.end(), entry);
+      }
+      cell.insert(position, entry);
+    }
+  }
+}
+
+/**
+ * \brief Removes an element from all cells of a location.
+ * \param element The element to remove.
+ * \param location Cells where it is stored.
+ */
+template<typename T>
+void Grid<T>::remove_from_cells(const T& element, const Location& location) {
+
+  for (int i = location.row1; i <= location.row2; ++i) {
+    for (int j = location.column1; j <= location.column2; ++j) {
+      std::vector<Entry>& cell = cells[i * num_columns + j];
+      typename std::vector<Entry>::iterator it;
+      for (it = cell.begin(); it != cell.end(); ++it) {
+        if (it->element == element) {
+          cell.erase(it);
+          break;
+        }
+      }
+    }
+  }
+}
+
+#endif
+
@@ -31,7 +31,14 @@ class Hq4xFilter: public PixelFilter {
     ~Hq4xFilter();
 
     int get_scaling_factor() const;
-    void filter(
+    void filter_rows(
+        const uint32_t* src,
+        int src_width,
+        int src_height,
+        uint32_t* dst,
+        int first_row,
+        int last_row) const;
+    void filter_reference(
         const uint32_t* src,
         int src_width,
         int src_height,
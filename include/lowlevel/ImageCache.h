@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_IMAGE_CACHE_H
+#define SOLARUS_IMAGE_CACHE_H
+
+#include "Common.h"
+#include <SDL.h>
+#include <list>
+#include <map>
+#include <string>
+
+/**
+ * \brief Keeps decoded images in memory to share them between surfaces.
+ *
+ * Images are indexed by their file name and, for language-specific images,
+ * by the current language.
+ * The pixels are reference-counted with the refcount field of SDL surfaces:
+ * the cache holds one reference and each surface using the image holds
+ * another one.
+ * When the images kept exceed a memory budget, the least recently used ones
+ * that no surface uses anymore are evicted.
+ *
+ * Surfaces that share an image must not modify it:
+ * see Surface::create_from_cache().
+ *
+ * Images may be requested and released from background threads
+ * (see MapPreloader and MapPrefetcher): the cache and the reference counts
+ * of its images are protected by a mutex.
+ */
+class ImageCache {
+
+  public:
+
+    static void initialize();
+    static void quit();
+
+    static SDL_Surface* get_image(const std::string& file_name,
+        bool language_specific);
+    static void release_image(SDL_Surface* image);
+
+    static int get_nb_hits();
+    static int get_nb_misses();
+    static size_t get_resident_bytes();
+    static size_t get_max_bytes();
+    static void set_max_bytes(size_t max_bytes);
+
+  private:
+
+    /**
+     * \brief An image kept in the cache.
+     */
+    struct Image {
+      SDL_Surface* surface;                          /**< the decoded image (the cache holds a reference) */
+      size_t size;                                   /**< memory used by the pixels in bytes */
+      std::list<std::string>::iterator lru_position; /**< position of the key in the LRU list */
+    };
+
+    ImageCache();
+
+    static SDL_Surface* load_image(const std::string& file_name,
+        bool language_specific);
+    static void evict_unused_images();
+
+    static SDL_mutex* mutex;                         /**< protects the fields below */
+
+    static std::map<std::string, Image> images;      /**< the images kept, indexed by key */
+    static std::list<std::string> lru_keys;          /**< keys of the images, most recently used first */
+    static size_t resident_bytes;                    /**< memory used by all images kept */
+    static size_t max_bytes;                         /**< budget above which unused images are evicted */
+    static int nb_hits;                              /**< number of requests that found their image */
+    static int nb_misses;                            /**< number of requests that decoded their image */
+};
+
+#endif
+
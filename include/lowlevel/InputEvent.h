@@ -249,6 +249,8 @@ class InputEvent {
 
   private:
 
+    friend class InputRecording;   // to save and restore internal events
+
     InputEvent(const SDL_Event& event);
 
     static const KeyboardKey directional_keys[];  /**< array of the keyboard directional keys */
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_INPUT_RECORDING_H
+#define SOLARUS_INPUT_RECORDING_H
+
+#include "Common.h"
+#include <SDL.h>
+#include <string>
+#include <vector>
+#include <fstream>
+
+/**
+ * \brief Records the input events of a session to replay them later.
+ *
+ * Each event is stored with the simulated date (System::now()) when it
+ * was received, together with the seed of the random number generator.
+ * Since the simulated time advances by a fixed timestep, replaying the
+ * events at the same dates reproduces the same session,
+ * which is how the benchmark mode works.
+ *
+ * The file format is binary and depends on the SDL version and platform:
+ * replay a file on the kind of system where it was recorded.
+ */
+class InputRecording {
+
+  public:
+
+    InputRecording();
+    ~InputRecording();
+
+    // recording
+    bool start_recording(const std::string& file_name);
+    void record_event(const InputEvent& event, uint32_t date);
+    void stop_recording(uint32_t date);
+
+    // replay
+    bool start_replay(const std::string& file_name);
+    InputEvent* get_event(uint32_t date);
+    bool is_replay_finished(uint32_t date) const;
+
+  private:
+
+    /**
+     * \brief An event stored in the file.
+     */
+    struct Record {
+      uint32_t date;                  /**< simulated date of the event (SDL_FIRSTEVENT marks the end) */
+      SDL_Event event;                /**< the event */
+    };
+
+    static const char magic[];        /**< first bytes of a recording file */
+    static const uint32_t version;    /**< version of the file format */
+
+    void write_record(uint32_t date, const SDL_Event& event);
+
+    std::ofstream output;             /**< file being recorded, if any */
+    std::vector<Record> records;      /**< events being replayed */
+    size_t next_record;               /**< index of the next event to replay */
+    uint32_t end_date;                /**< date when the replay ends */
+};
+
+#endif
+
@@ -19,6 +19,8 @@
 
 #include "Common.h"
 #include "lowlevel/Sound.h"
+#include <SDL.h>
+#include <vector>
 
 /**
  * \brief Represents a music that can be played.
@@ -29,6 +31,12 @@
  * Before using this class, the audio system should have been
  * initialized, by calling Sound::initialize().
  * Sound and Music are the only classes that depends on audio libraries.
+ *
+ * The current music is decoded by a dedicated thread into a ring buffer,
+ * ahead of what is being played.
+ * The main loop then only has to copy decoded data to the OpenAL buffers
+ * that were played, so it can be blocked for a while without the music
+ * being interrupted.
  */
 class Music { // TODO make a subclass for each format, or at least make a better separation between them
 
@@ -51,7 +59,7 @@ class Music { // TODO make a subclass for each format, or at least make a better
     Music(const std::string& music_id = none);
     ~Music();
 
-    static void initialize();
+    static void initialize(int argc, char** argv);
     static void quit();
     static bool is_initialized();
     static void update();
@@ -64,6 +72,7 @@ class Music { // TODO make a subclass for each format, or at least make a better
     static void set_channel_volume(int channel, int volume);
     static int get_tempo();
     static void set_tempo(int tempo);
+    static int get_nb_underruns();
 
     static void find_music_file(const std::string& music_id,
         std::string& file_name, Format& format);
@@ -79,9 +88,14 @@ class Music { // TODO make a subclass for each format, or at least make a better
     bool is_paused();
     void set_paused(bool pause);
 
-    void decode_spc(ALuint destination_buffer, ALsizei nb_samples);
-    void decode_it(ALuint destination_buffer, ALsizei nb_samples);
-    void decode_ogg(ALuint destination_buffer, ALsizei nb_samples);
+    size_t decode(char* decoded_data, size_t size);
+    size_t decode_spc(char* decoded_data, size_t size);
+    size_t decode_it(char* decoded_data, size_t size);
+    size_t decode_ogg(char* decoded_data, size_t size);
+    bool fill_buffer(ALuint buffer);
+
+    static int decoding_thread_main(void* music);
+    void decode_ahead();
 
     void update_playing();
 
@@ -96,10 +110,22 @@ class Music { // TODO make a subclass for each format, or at least make a better
     static const int nb_buffers = 8;
     ALuint buffers[nb_buffers];                  /**< multiple buffers used to stream the music */
     ALuint source;                               /**< the OpenAL source streaming the buffers */
+    std::vector<ALuint> empty_buffers;           /**< buffers played that could not be refilled yet */
+    ALenum al_format;                            /**< OpenAL format of the decoded data */
+    ALsizei sample_rate;                         /**< sample rate of the decoded data */
+    size_t chunk_size;                           /**< size of the data of one buffer in bytes */
+
+    RingBuffer* decoded_data;                    /**< data decoded ahead by the decoding thread */
+    SDL_Thread* decoding_thread;                 /**< the thread that decodes the music while it is played */
+    SDL_atomic_t stopping;                       /**< 1 when the decoding thread has to stop */
 
     static SpcDecoder* spc_decoder;              /**< the SPC decoder */
     static ItDecoder* it_decoder;                /**< the IT decoder */
+    static SDL_mutex* decoder_mutex;             /**< protects the decoders, used by both threads */
     static float volume;                         /**< volume of musics (0.0 to 1.0) */
+    static int buffer_duration;                  /**< music decoded in advance in milliseconds,
+                                                  * both in the ring buffer and in the OpenAL buffers */
+    static int nb_underruns;                     /**< number of times the OpenAL source ran out of data */
 
     static Music* current_music;                 /**< the music currently played (if any) */
     static std::map<std::string, Music> all_musics;   /**< all musics created before */
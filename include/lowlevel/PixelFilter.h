@@ -18,9 +18,14 @@
 #define SOLARUS_PIXEL_FILTER_H
 
 #include "Common.h"
+#include "lowlevel/WorkerPool.h"
+#include <vector>
 
 /**
  * \brief Abstract class for pixel filtering algorithms.
+ *
+ * Subclasses implement filter_rows(). Rows are independent from each
+ * other, so a frame can be split into bands processed by several threads.
  */
 class PixelFilter {
 
@@ -35,21 +40,88 @@ class PixelFilter {
      */
     virtual int get_scaling_factor() const = 0;
 
+    void filter(
+        const uint32_t* src,
+        int src_width,
+        int src_height,
+        uint32_t* dst) const;
+    void filter(
+        const uint32_t* src,
+        int src_width,
+        int src_height,
+        uint32_t* dst,
+        int first_row,
+        int last_row,
+        WorkerPool& workers) const;
+
+    /**
+     * \brief Applies the algorithm on some rows of a rectangle of pixels.
+     *
+     * Rows outside the range are read as neighbours but not written.
+     *
+     * \param src The rectangle of pixels in RGBA format.
+     * Must be a buffer of size src_width * src_height.
+     * \param src_width Width of the rectangle.
+     * \param src_height Height of the rectangle.
+     * \param dst The destination rectangle to write.
+     * Must be a buffer of size
+     * src_width * src_height * get_scaling_factor()^2.
+     * \param first_row First source row to filter.
+     * \param last_row Source row after the last one to filter.
+     */
+    virtual void filter_rows(
+        const uint32_t* src,
+        int src_width,
+        int src_height,
+        uint32_t* dst,
+        int first_row,
+        int last_row) const = 0;
+
     /**
-     * \brief Applies the algorithm on a rectangle of pixels.
+     * \brief Applies the original version of the algorithm on a rectangle
+     * of pixels.
+     *
+     * This version processes one pixel at a time on the calling thread.
+     * It is only used by the benchmark mode to check that filter_rows()
+     * gives the same result.
+     *
      * \param src The rectangle of pixels in RGBA format.
-     * Must be a buffer of size src_width * dst_width.
+     * Must be a buffer of size src_width * src_height.
      * \param src_width Width of the rectangle.
-     * \param dst_width Height of the rectangle.
+     * \param src_height Height of the rectangle.
      * \param dst The destination rectangle to write.
      * Must be a buffer of size
-     * src_width * dst_width * get_scaling_factor().
+     * src_width * src_height * get_scaling_factor()^2.
      */
-    virtual void filter(
+    virtual void filter_reference(
         const uint32_t* src,
         int src_width,
         int src_height,
         uint32_t* dst) const = 0;
+
+  private:
+
+    /**
+     * \brief Filters a band of rows of a frame.
+     */
+    class Band: public WorkerPool::Job {
+
+      public:
+
+        void run();
+
+        const PixelFilter* filter;  /**< the filter to apply */
+        const uint32_t* src;        /**< the source frame */
+        int src_width;              /**< width of the source frame */
+        int src_height;             /**< height of the source frame */
+        uint32_t* dst;              /**< the destination frame */
+        int first_row;              /**< first row of the band */
+        int last_row;               /**< row after the last one of the band */
+    };
+
+    mutable std::vector<Band> bands;       /**< bands of the frame being filtered */
+    mutable std::vector<WorkerPool::Job*>
+        band_jobs;                         /**< the same bands, as jobs for the pool */
 };
 
 #endif
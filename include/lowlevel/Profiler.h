@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_PROFILER_H
+#define SOLARUS_PROFILER_H
+
+#include "Common.h"
+#include <map>
+#include <string>
+#include <vector>
+#include <SDL.h>
+
+/**
+ * \brief Measures how long the main subsystems take in each frame.
+ *
+ * Profiling is enabled with the -profile command-line option.
+ * Timings are recorded by Profiler::Scope objects into a fixed-size ring
+ * buffer that several threads can fill without locking.
+ * Recent timings can be drawn as an overlay, queried from Lua and the whole
+ * buffer is dumped in the Chrome trace format (chrome://tracing) when the
+ * program exits.
+ *
+ * When profiling is disabled, a scope only costs a test of a boolean.
+ */
+class Profiler {
+
+  public:
+
+    /**
+     * \brief Records the time spent between its creation and destruction.
+     *
+     * Create an instance at the beginning of the code to measure,
+     * for example with the SOLARUS_PROFILE macro.
+     */
+    class Scope {
+
+      public:
+
+        /**
+         * \brief Starts measuring a section of code.
+         * \param name Name of the section. Must be a string literal
+         * (it is stored as is).
+         */
+        Scope(const char* name):
+          name(enabled ? name : NULL),
+          start(enabled ? get_counter() : 0) {
+        }
+
+        /**
+         * \brief Stops measuring the section of code.
+         */
+        ~Scope() {
+          if (name != NULL) {
+            record(name, start, get_counter());
+          }
+        }
+
+      private:
+
+        const char* name;                    /**< name of the section or NULL if not profiling */
+        uint64_t start;                      /**< performance counter at the start of the section */
+    };
+
+    /**
+     * \brief Timing statistics of a section over the last second.
+     */
+    struct Statistics {
+      int nb_calls;                          /**< number of times the section was executed */
+      double average;                        /**< average duration of a call in milliseconds */
+      double max;                            /**< longest call in milliseconds */
+    };
+
+    static void initialize(int argc, char** argv);
+    static void quit();
+
+    static bool is_enabled();
+    static void get_statistics(std::map<std::string, Statistics>& statistics);
+    static void draw(Surface& dst_surface);
+
+  private:
+
+    /**
+     * \brief A timing recorded in the ring buffer.
+     */
+    struct Sample {
+      const char* name;                      /**< name of the section (NULL if the slot is unused) */
+      uint64_t start;                        /**< performance counter at the start */
+      uint64_t end;                          /**< performance counter at the end */
+      unsigned long thread_id;               /**< thread that executed the section */
+    };
+
+    Profiler();
+
+    static uint64_t get_counter();
+    static void record(const char* name, uint64_t start, uint64_t end);
+    static void save_trace();
+
+    static const int max_samples = 1 << 17;  /**< capacity of the ring buffer (a power of two) */
+
+    static bool enabled;                     /**< whether profiling is active */
+    static std::string trace_file_name;      /**< file where the Chrome trace is written on exit */
+    static std::vector<Sample> samples;      /**< ring buffer of the recorded timings */
+    static SDL_atomic_t nb_samples;          /**< total number of timings recorded so far */
+    static uint64_t initial_counter;         /**< performance counter when profiling started */
+    static double counter_frequency;         /**< performance counter ticks per millisecond */
+};
+
+/**
+ * \brief Measures the time spent until the end of the current block.
+ * \param name Name of the section (a string literal).
+ */
+#define SOLARUS_PROFILE(name) Profiler::Scope profiler_scope_(name)
+
+#endif
+
@@ -29,12 +29,17 @@ class Random {
     static void initialize();
     static void quit();
 
+    static unsigned int get_seed();
+    static void set_seed(unsigned int seed);
+
     static int get_number(unsigned int x);
     static int get_number(unsigned int x, unsigned int y);
 
   private:
 
     Random();
+
+    static unsigned int seed;   /**< seed used to initialize the generator */
 };
 
 #endif
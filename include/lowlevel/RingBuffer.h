@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_RING_BUFFER_H
+#define SOLARUS_RING_BUFFER_H
+
+#include "Common.h"
+#include <SDL.h>
+#include <cstddef>
+
+/**
+ * \brief A fixed-size queue of bytes shared by two threads without locks.
+ *
+ * One thread writes data at the end of the buffer while another one reads
+ * data from its beginning. Each thread only moves its own position,
+ * so no mutex is needed as long as there is only one reader and one writer.
+ */
+class RingBuffer {
+
+  public:
+
+    RingBuffer(size_t capacity);
+    ~RingBuffer();
+
+    size_t get_capacity() const;
+    size_t get_available_size();
+    size_t get_free_size();
+
+    size_t write(const char* data, size_t size);
+    size_t read(char* data, size_t size);
+
+  private:
+
+    RingBuffer(const RingBuffer& other);             // Not copyable.
+    RingBuffer& operator=(const RingBuffer& other);
+
+    char* data;                    /**< the storage (one byte is never used
+                                    * to distinguish a full buffer from an empty one) */
+    const size_t storage_size;     /**< size of the storage in bytes */
+    SDL_atomic_t read_position;    /**< index of the next byte to read, only moved by the reader */
+    SDL_atomic_t write_position;   /**< index of the next byte to write, only moved by the writer */
+};
+
+#endif
+
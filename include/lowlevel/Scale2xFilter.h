@@ -19,11 +19,17 @@
 
 #include "Common.h"
 #include "lowlevel/PixelFilter.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /**
  * \brief Implementation of the Scale2x algorithm.
  *
  * See http://scale2x.sourceforge.net/algorithm.html
+ *
+ * When SSE2 is available, four pixels are processed at a time.
+ * The result is identical to the one of the scalar version.
  */
 class Scale2xFilter: public PixelFilter {
 
@@ -33,11 +39,32 @@ class Scale2xFilter: public PixelFilter {
     ~Scale2xFilter();
 
     int get_scaling_factor() const;
-    void filter(
+    void filter_rows(
+        const uint32_t* src,
+        int src_width,
+        int src_height,
+        uint32_t* dst,
+        int first_row,
+        int last_row) const;
+    void filter_reference(
         const uint32_t* src,
         int src_width,
         int src_height,
         uint32_t* dst) const;
+
+  private:
+
+    static void filter_pixel(
+        const uint32_t* above,
+        const uint32_t* line,
+        const uint32_t* below,
+        int src_width,
+        int col,
+        uint32_t* dst_top,
+        uint32_t* dst_bottom);
+#ifdef __SSE2__
+    static __m128i select(__m128i condition, __m128i if_true, __m128i if_false);
+#endif
 };
 
 #endif
@@ -18,9 +18,11 @@
 #define SOLARUS_SOUND_H
 
 #include "Common.h"
+#include "lowlevel/WorkerPool.h"
 #include <string>
 #include <list>
 #include <map>
+#include <vector>
 #include <al.h>
 #include <alc.h>
 #include <vorbis/vorbisfile.h>
@@ -33,6 +35,12 @@
  * rather than calling directly the constructor of Sound.
  * This class is the only one that depends on the sound decoding library (libsndfile).
  * This class and the Music class are the only ones that depend on the audio mixer library (OpenAL).
+ *
+ * Sounds are decoded the first time they are played, or in advance by
+ * load_all() and load_sounds(), which decode several files in parallel.
+ * With the option -lazy-sounds, load_all() does nothing.
+ * With the option -sound-cache, the decoded data is also saved in the quest
+ * write directory and read from there the next times.
  */
 class Sound {
 
@@ -60,6 +68,7 @@ class Sound {
     bool start();
 
     static void load_all();
+    static void load_sounds(const std::vector<std::string>& sound_ids);
     static bool exists(const std::string& sound_id);
     static void play(const std::string& sound_id);
 
@@ -73,6 +82,31 @@ class Sound {
 
   private:
 
+    /**
+     * \brief Decodes a sound file, possibly in a worker thread.
+     */
+    class DecodingJob: public WorkerPool::Job {
+
+      public:
+
+        void run();
+
+        std::string file_name;        /**< the sound file to decode */
+        std::vector<char> samples;    /**< the decoded 16-bit stereo samples */
+        ALsizei sample_rate;          /**< sample rate of the decoded samples */
+        bool success;                 /**< false if the file could not be decoded */
+    };
+
+    /**
+     * \brief Header of a file of the PCM cache.
+     */
+    struct PcmCacheHeader {
+      char magic[4];                  /**< "SPCM" */
+      int64_t modification_time;      /**< modification date of the sound file that was decoded */
+      uint32_t sample_rate;           /**< sample rate of the samples that follow */
+      uint32_t size;                  /**< size of the samples that follow in bytes */
+    };
+
     static ALCdevice* device;
     static ALCcontext* context;
 
@@ -84,9 +118,23 @@ class Sound {
 
     static bool initialized;                     /**< indicates that the audio system is initialized */
     static bool sounds_preloaded;                /**< true if load_all() was called */
+    static bool lazy_loading;                    /**< true if load_all() does nothing */
+    static bool pcm_cache_enabled;               /**< true to keep decoded sounds in the write directory */
     static float volume;                         /**< the volume of sound effects (0.0 to 1.0) */
-
-    ALuint decode_file(const std::string &file_name);
+    static ov_callbacks seekable_ogg_callbacks;  /**< vorbisfile callbacks that also allow to know
+                                                  * the decoded size in advance */
+
+    static std::string get_file_name(const std::string& sound_id);
+    static bool decode_file(const std::string& file_name,
+        std::vector<char>& samples, ALsizei& sample_rate);
+    static bool read_pcm_cache(const std::string& file_name,
+        std::vector<char>& samples, ALsizei& sample_rate);
+    static void write_pcm_cache(const std::string& file_name,
+        const std::vector<char>& samples, ALsizei sample_rate);
+    static int cb_seek(void* datasource, ogg_int64_t offset, int whence);
+    static long cb_tell(void* datasource);
+    ALuint create_buffer(const std::string& file_name,
+        const std::vector<char>& samples, ALsizei sample_rate);
     bool update_playing();
 
 };
@@ -35,6 +35,7 @@ class Surface: public Drawable {
   friend class TextSurface;
   friend class VideoManager;
   friend class PixelBits;
+  friend class ImageCache;
 
   public:
 
@@ -56,6 +57,9 @@ class Surface: public Drawable {
 
     static Surface* create_from_file(const std::string& file_name,
         ImageDirectory base_directory = DIR_SPRITES);
+    static Surface* create_from_cache(const std::string& file_name,
+        ImageDirectory base_directory = DIR_SPRITES);
+    static void run_blits_benchmark();
 
     int get_width() const;
     int get_height() const;
@@ -84,6 +88,14 @@ class Surface: public Drawable {
 
   private:
 
+    static std::string get_prefixed_file_name(const std::string& file_name,
+        ImageDirectory base_directory, bool& language_specific);
+    static SDL_Surface* load_image(const std::string& prefixed_file_name,
+        bool language_specific);
+    static SDL_Surface* convert_to_display_format(SDL_Surface* image);
+    static SDL_Surface* create_benchmark_image(uint32_t pixel_format);
+    static double measure_blits(SDL_Surface* image, SDL_Surface* dst_surface);
+
     uint32_t get_pixel(int index) const;
     bool is_pixel_transparent(int index) const;
   
@@ -91,6 +103,7 @@ class Surface: public Drawable {
 
     SDL_Surface* internal_surface;     /**< the SDL_Surface encapsulated */
     bool owns_internal_surface;        /**< indicates that internal_surface belongs to this object */
+    bool cached_internal_surface;      /**< indicates that internal_surface is shared through the ImageCache */
     bool with_colorkey;
     uint32_t colorkey;
 };
@@ -34,6 +34,7 @@ class System {
 
     static uint32_t now();
     static uint32_t get_real_time();
+    static double get_precise_real_time();
     static void sleep(uint32_t duration);
 
     static const uint32_t timestep = 10;  // Timestep added to the simulated time at each update.
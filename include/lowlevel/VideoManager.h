@@ -21,6 +21,7 @@
 #include "lowlevel/Rectangle.h"
 #include <list>
 #include <map>
+#include <vector>
 
 /**
  * \brief Draws the window and handles the video mode.
@@ -80,16 +81,31 @@ class VideoManager {
         const Rectangle& max_quest_size);
 
     void draw(Surface& quest_surface);
+    void run_pixel_filters_benchmark(Surface& frame);
 
     static const std::string video_mode_names[];
 
   private:
 
-    VideoManager(bool disable_window, const Rectangle& wanted_quest_size);
+    VideoManager(bool disable_window, bool pipelined, const Rectangle& wanted_quest_size);
     ~VideoManager();
 
     void initialize_video_modes();
-    void apply_pixel_filter(Surface& src_surface, Surface& dst_surface);
+    bool find_changed_rows(
+        const uint8_t* pixels,
+        int pitch,
+        int row_size,
+        int height,
+        int& first_row,
+        int& last_row);
+    void apply_pixel_filter(int& first_row, int& last_row);
+    void upload_changed_rows(int first_row, int last_row);
+    void render_screen();
+
+    void start_render_thread();
+    void stop_render_thread();
+    static int render_thread_main(void* video_manager);
+    void run_render_thread();
 
     static VideoManager* instance;          /**< The only instance. */
 
@@ -104,6 +120,23 @@ class VideoManager {
     const PixelFilter* pixel_filter;        /**< The pixel filtering algorithm (if any) applied with
                                              * the current video mode. */
     Surface* scaled_surface;                /**< The screen surface used with scaled modes. */
+    WorkerPool* pixel_filter_workers;       /**< Threads that apply the pixel filter. */
+    std::vector<uint8_t>
+        previous_quest_pixels;              /**< Copy of the quest surface drawn at the previous frame,
+                                             * without padding between rows. */
+    bool full_redraw_needed;                /**< Whether the whole screen has to be redrawn at the next frame
+                                             * instead of only the rows that have changed. */
+
+    SDL_Thread* render_thread;              /**< Thread that prepares frames in pipelined mode (NULL otherwise). */
+    SDL_sem* render_frame_ready;            /**< Posted when render_frame contains a new frame to prepare. */
+    SDL_sem* render_frame_done;             /**< Posted when the render thread has prepared its frame. */
+    bool render_thread_stopping;            /**< Tells the render thread to stop. */
+    std::vector<uint8_t> render_frame;      /**< Copy of the quest surface given to the render thread,
+                                             * without padding between rows. */
+    int render_frame_row_size;              /**< Size of a row of render_frame in bytes. */
+    int render_first_row;                   /**< First row changed in the frame prepared by the render thread. */
+    int render_last_row;                    /**< Row after the last one changed in the frame prepared
+                                             * by the render thread. */
   
     std::string outset_title;               /**< Title used when creating the window. */
     VideoMode video_mode;                   /**< Current display mode. */
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_WORKER_POOL_H
+#define SOLARUS_WORKER_POOL_H
+
+#include "Common.h"
+#include <SDL.h>
+#include <deque>
+#include <vector>
+
+/**
+ * \brief A set of threads that run jobs in parallel.
+ *
+ * Jobs are submitted by batches with run(), which returns when the whole
+ * batch is done. The calling thread also executes jobs while waiting,
+ * so a pool with no thread simply runs the jobs sequentially.
+ */
+class WorkerPool {
+
+  public:
+
+    /**
+     * \brief Abstract class for a task to execute by the pool.
+     */
+    class Job {
+
+      public:
+
+        virtual ~Job();
+
+        /**
+         * \brief Executes this job.
+         *
+         * This function may be called from any thread.
+         */
+        virtual void run() = 0;
+    };
+
+    WorkerPool(int nb_threads);
+    ~WorkerPool();
+
+    static int get_default_nb_threads();
+    int get_nb_threads() const;
+
+    void run(const std::vector<Job*>& jobs);
+
+  private:
+
+    static int worker_main(void* pool);
+    void work();
+    void finish_job();
+
+    std::vector<SDL_Thread*> threads;  /**< the worker threads */
+    SDL_mutex* mutex;                  /**< protects the fields below */
+    SDL_cond* jobs_available;          /**< signaled when jobs are submitted or when the pool stops */
+    SDL_cond* jobs_finished;           /**< signaled when the last job of a batch is done */
+    std::deque<Job*> pending_jobs;     /**< jobs not started yet */
+    int nb_unfinished_jobs;            /**< jobs of the current batch that are not done yet */
+    bool stopping;                     /**< true when threads have to stop */
+};
+
+#endif
+
@@ -49,6 +49,8 @@ class ExportableToLua {
     void set_known_to_lua(bool known_to_lua);
     bool is_with_lua_table() const;
     void set_with_lua_table(bool with_lua_table);
+    bool has_lua_field(const char* key) const;
+    void notify_lua_field_set(const char* key);
 
     // Reference counting.
     int get_refcount() const;
@@ -63,6 +65,8 @@ class ExportableToLua {
 
   private:
 
+    static uint64_t get_lua_field_bit(const char* key);
+
     int refcount;                /**< Number of pointers to the object
                                   * including the Lua ones
                                   * (0 means that it can be deleted). */
@@ -70,6 +74,8 @@ class ExportableToLua {
                                   * at least once. */
     bool with_lua_table;         /**< Whether a Lua table was created to make
                                   * this userdata indexable like a table. */
+    uint64_t lua_field_bits;     /**< One bit for each key ever set in the
+                                  * Lua table (indexed by a hash of the key). */
 };
 
 #endif
@@ -368,6 +368,7 @@ class LuaContext {
       main_api_save_settings,
       main_api_get_distance,  // TODO remove?
       main_api_get_angle,     // TODO remove?
+      main_api_get_profiler_statistics,
 
       // Audio API.
       audio_api_get_sound_volume,
@@ -509,6 +510,8 @@ class LuaContext {
       straight_movement_api_set_max_distance,
       straight_movement_api_is_smooth,
       straight_movement_api_set_smooth,
+      straight_movement_api_is_swept,
+      straight_movement_api_set_swept,
       random_movement_api_get_speed,
       random_movement_api_set_speed,
       random_movement_api_get_angle,
@@ -684,6 +687,8 @@ class LuaContext {
       map_api_get_entities_count,
       map_api_has_entities,
       map_api_set_entities_enabled,
+      map_api_get_update_lod,
+      map_api_set_update_lod,
       map_api_remove_entities,
       map_api_create_tile,
       map_api_create_destination,
@@ -743,6 +748,8 @@ class LuaContext {
       entity_api_test_obstacles,
       entity_api_get_optimization_distance,
       entity_api_set_optimization_distance,
+      entity_api_get_update_lod,
+      entity_api_set_update_lod,
       entity_api_is_in_same_region,
       hero_api_teleport,
       hero_api_get_direction,
@@ -1066,6 +1073,7 @@ class LuaContext {
       l_panic,
       l_loader,
       l_get_map_entity_or_global,
+      l_get_next_entity_with_prefix,
       l_camera_do_callback,
       l_camera_restore,
       l_treasure_dialog_finished,
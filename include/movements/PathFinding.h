@@ -19,8 +19,8 @@
 
 #include "Common.h"
 #include "lowlevel/Rectangle.h"
-#include <list>
-#include <map>
+#include "entities/Layer.h"
+#include <vector>
 
 /**
  * \brief Implementation of the A* algorithm to compute a path.
@@ -28,6 +28,20 @@
  * In the current implementation, the computed path always corresponds to a
  * shape of 16*16. If the entity to move is bigger, some obstacles may prevent
  * it from following the computed path.
+ *
+ * Nodes are stored in a flat array with one element per 8*8 square of the
+ * map and the open list is a binary heap. These structures are static and
+ * reused from one computation to another, so that computing a path
+ * allocates no memory in general.
+ * Terrain obstacles are read from the walkability cache of the map.
+ *
+ * When the target is close, all nodes around are explored.
+ * When the target is far, the search is hierarchical: the map is divided
+ * into regions of 64*64 pixels and a first search finds a sequence of
+ * regions leading to the target. Two neighbour regions are connected if
+ * their common border has a portal, that is, a pair of adjacent squares
+ * that are not entirely blocked. Then only the nodes in these regions
+ * and around them are explored.
  */
 class PathFinding {
 
@@ -64,14 +78,52 @@ class PathFinding {
       int parent_index;   /**< index of the square containing the best node leading to this node */
       char direction;     /**< direction from the parent node to this node (0 to 7) */
 
-      bool operator<(const Node& other) const;
+      uint32_t search_id; /**< computation where this node was last reached
+                           * (the other fields are only valid during this computation) */
+      bool closed;        /**< whether this node is in the closed list */
     };
 
+    /**
+     * \brief An element of the open list.
+     *
+     * When a better path is found to a node of the open list, a new element
+     * is added and the old one is ignored when it gets popped.
+     */
+    class OpenNode {
+
+     public:
+
+      int total_cost;     /**< total cost of the node when this element was added */
+      int heuristic;      /**< heuristic of the node, used to break ties */
+      int index;          /**< index of the node */
+
+      bool operator<(const OpenNode& other) const;
+    };
+
+    /**
+     * \brief Represents a region of the map in the hierarchical search.
+     */
+    class Region {
+
+     public:
+
+      uint32_t search_id;   /**< computation where this region was last reached */
+      int parent_index;     /**< region leading to this one */
+      uint32_t corridor_id; /**< computation where this region was part of the
+                             * regions to explore */
+    };
+
+    void start_search();
+    std::string search_path(const Rectangle& source, const Rectangle& target, bool in_corridor);
+    bool find_corridor(const Rectangle& source, const Rectangle& target);
+    bool are_regions_connected(int region_index1, int region_index2) const;
+    int get_region_index(const Rectangle& location) const;
+    bool is_on_map(const Rectangle& location) const;
     int get_square_index(const Rectangle& location) const;
     int get_manhattan_distance(const Rectangle& point1, const Rectangle& point2) const;
     bool is_node_transition_valid(const Node& node, int direction) const;
-    void add_index_sorted(Node* node);
-    std::string rebuild_path(const Node* final_node);
+    void push_open_node(const Node& node);
+    std::string rebuild_path(const Node& final_node) const;
 
     static const Rectangle neighbours_locations[];
     static const Rectangle transition_collision_boxes[];
@@ -79,10 +131,24 @@ class PathFinding {
     const Map& map;                    /**< the map */
     const MapEntity& source_entity;    /**< the entity to move */
     const MapEntity& target_entity;    /**< the target point */
-
-    std::map<int, Node> closed_list;   /**< the closed list, indexed by the node locations on the map */
-    std::map<int, Node> open_list;     /**< the open list, indexed by the node locations on the map */
-    std::list<int> open_list_indices;  /**< indices of the open list elements, sorted by priority */
+    const WalkabilityGrid& walkability;/**< terrain obstacles of the map */
+    Layer layer;                       /**< layer of the path */
+    int ground_profile;                /**< ground obstacle properties of the entity to move */
+    int nb_regions_x;                  /**< number of columns of regions */
+    int nb_regions_y;                  /**< number of rows of regions */
+
+    static const int
+        max_local_distance = 200;      /**< beyond this Manhattan distance to the target,
+                                        * the search is hierarchical */
+    static const int region_size = 8; /**< size of a region in 8*8 squares */
+
+    static std::vector<Node> nodes;    /**< all nodes of the map, indexed by their square */
+    static std::vector<OpenNode>
+        open_list;                     /**< the open list, as a binary heap (lowest cost first) */
+    static std::vector<Region> regions;/**< all regions of the map */
+    static std::vector<int>
+        regions_queue;                 /**< regions to explore in the hierarchical search */
+    static uint32_t search_id;         /**< id of the current computation */
 
 };
 
@@ -19,6 +19,8 @@
 
 #include "Common.h"
 #include "movements/Movement.h"
+#include "lowlevel/Rectangle.h"
+#include <vector>
 
 /**
  * \brief A straight movement represented as a speed vector
@@ -49,6 +51,8 @@ class StraightMovement: public Movement {
     void set_max_distance(int max_distance);
     bool is_smooth() const;
     void set_smooth(bool smooth);
+    bool is_swept() const;
+    void set_swept(bool swept);
     int get_displayed_direction4() const;
 
     // movement
@@ -73,6 +77,8 @@ class StraightMovement: public Movement {
 
   private:
 
+    void update_swept();
+
     // speed vector
     double angle;                /**< angle between the speed vector and the horizontal axis in radians */
     double x_speed;              /**< X speed of the object to move in pixels per second.
@@ -104,6 +110,12 @@ class StraightMovement: public Movement {
                                   * that max_distance or an obstacle is reached */
     bool smooth;                 /**< Makes the movement adjust its trajectory
                                   * when an obstacle is close */
+    bool swept;                  /**< Makes the movement go through all pixel
+                                  * moves that are due at once when nothing
+                                  * blocks them */
+    std::vector<Rectangle>
+        swept_path;              /**< Positions of the current swept move
+                                  * (kept to avoid reallocations) */
 
 };
 
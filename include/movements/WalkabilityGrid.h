@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_WALKABILITY_GRID_H
+#define SOLARUS_WALKABILITY_GRID_H
+
+#include "Common.h"
+#include "entities/Layer.h"
+#include "entities/Ground.h"
+#include <vector>
+#include <map>
+
+/**
+ * \brief Cache of the terrain obstacles of a map, used by the path finding.
+ *
+ * For each 8*8 square of the map, this cache tells whether the terrain
+ * (i.e. the ground of tiles and of dynamic entities that modify it)
+ * is entirely traversable, entirely an obstacle or only partially an
+ * obstacle for an entity.
+ * Whether a ground is an obstacle depends on the entity, so the squares are
+ * stored separately for each combination of ground obstacle properties
+ * (see get_ground_profile()).
+ *
+ * The squares are computed lazily. When ground modifiers appear, disappear
+ * or move, only the squares under them are invalidated.
+ * Collisions with obstacle entities are never cached because they depend on
+ * the entity to check.
+ */
+class WalkabilityGrid {
+
+  public:
+
+    /**
+     * \brief State of a square of the map.
+     */
+    enum SquareState {
+      SQUARE_UNKNOWN,     /**< not computed yet */
+      SQUARE_FREE,        /**< the terrain is traversable in the whole square */
+      SQUARE_BLOCKED,     /**< the terrain is an obstacle in the whole square */
+      SQUARE_PARTIAL      /**< the terrain is an obstacle in some points only */
+    };
+
+    WalkabilityGrid(const Map& map);
+    ~WalkabilityGrid();
+
+    void invalidate();
+    void invalidate(Layer layer, const Rectangle& where);
+
+    static int get_ground_profile(const MapEntity& entity);
+    SquareState get_square_state(Layer layer, int ground_profile, int x8, int y8) const;
+    bool test_collision_with_obstacles(
+        Layer layer,
+        int ground_profile,
+        const Rectangle& collision_box,
+        const MapEntity& entity_to_check) const;
+
+  private:
+
+    /**
+     * \brief Ground obstacle properties of an entity.
+     *
+     * A profile is a combination of these values.
+     */
+    enum GroundObstacle {
+      LOW_WALL_OBSTACLE = 1 << 0,
+      SHALLOW_WATER_OBSTACLE = 1 << 1,
+      DEEP_WATER_OBSTACLE = 1 << 2,
+      HOLE_OBSTACLE = 1 << 3,
+      LAVA_OBSTACLE = 1 << 4,
+      PRICKLE_OBSTACLE = 1 << 5,
+      LADDER_OBSTACLE = 1 << 6
+    };
+
+    std::vector<uint8_t>& get_squares(Layer layer, int ground_profile) const;
+    SquareState compute_square_state(Layer layer, int ground_profile, int x8, int y8) const;
+    static SquareState get_ground_state(Ground ground, int ground_profile);
+
+    const Map& map;                          /**< the map */
+    mutable std::map<int, std::vector<uint8_t> >
+        squares[LAYER_NB];                   /**< state of each square of each layer,
+                                              * indexed by ground profile */
+    mutable bool valid;                      /**< false if the squares have to be recomputed */
+};
+
+#endif
+
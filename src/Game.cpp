@@ -17,6 +17,7 @@
 #include "Game.h"
 #include "MainLoop.h"
 #include "Map.h"
+#include "MapPrefetcher.h"
 #include "Savegame.h"
 #include "KeysEffect.h"
 #include "Equipment.h"
@@ -30,6 +31,7 @@
 #include "lowlevel/StringConcat.h"
 #include "lowlevel/Music.h"
 #include "lowlevel/VideoManager.h"
+#include "lowlevel/Profiler.h"
 #include <sstream>
 #include <vector>
 
@@ -52,6 +54,7 @@ Game::Game(MainLoop& main_loop, Savegame* savegame):
   keys_effect(NULL),
   current_map(NULL),
   next_map(NULL),
+  prefetcher(NULL),
   previous_map_surface(NULL),
   transition_style(Transition::IMMEDIATE),
   transition(NULL),
@@ -67,6 +70,7 @@ Game::Game(MainLoop& main_loop, Savegame* savegame):
   hero->increment_refcount();
   keys_effect = new KeysEffect();
   update_keys_effect();
+  prefetcher = new MapPrefetcher();
 
   // Maybe we are restarting after a game-over sequence.
   if (get_equipment().get_life() <= 0) {
@@ -105,12 +109,24 @@ Game::~Game() {
     }
   }
 
+  // Stop reading the neighbour maps first.
+  delete prefetcher;
+
   current_map->unload();
   current_map->decrement_refcount();
   if (current_map->get_refcount() == 0) {
     delete current_map;
   }
 
+  if (next_map != NULL && next_map != current_map) {
+    // The next map may still be read by a background thread.
+    next_map->unload();
+    next_map->decrement_refcount();
+    if (next_map->get_refcount() == 0) {
+      delete next_map;
+    }
+  }
+
   Music::play(Music::none);
 
   delete transition;
@@ -348,6 +364,8 @@ void Game::notify_command_released(GameCommands::Command command) {
  */
 void Game::update() {
 
+  SOLARUS_PROFILE("Game::update");
+
   // update the transitions between maps
   update_transitions();
 
@@ -380,6 +398,16 @@ void Game::update_transitions() {
     transition->update();
   }
 
+  // if the next map was read in the background, create its entities
+  // as soon as possible so that the end of the transition does not wait
+  if (next_map != NULL
+      && !restarting
+      && !next_map->is_loaded()
+      && next_map->is_preloaded()) {
+    next_map->load(*this);
+    next_map->check_suspended();
+  }
+
   // if the map has just changed, close the current map if any and play an out transition
   if (next_map != NULL && transition == NULL) { // the map has changed (i.e. set_current_map has been called)
 
@@ -429,6 +457,12 @@ void Game::update_transitions() {
       }
       else {
 
+        // finish loading the next map if the background thread is late
+        if (!next_map->is_loaded()) {
+          next_map->load(*this);
+          next_map->check_suspended();
+        }
+
         // change the map
         current_map->leave();
 
@@ -490,6 +524,9 @@ void Game::update_transitions() {
     transition->start();
     current_map->start();
     notify_map_changed();
+
+    // read in advance the maps that the hero may go to next
+    prefetcher->prefetch_neighbours(*current_map);
   }
 }
 
@@ -589,8 +626,22 @@ void Game::set_current_map(
     // another map
     next_map = new Map(map_id);
     next_map->increment_refcount();
-    next_map->load(*this);
-    next_map->check_suspended();
+    if (current_map == NULL) {
+      // no transition to play: load the map now
+      next_map->load(*this);
+      next_map->check_suspended();
+    }
+    else {
+      MapPreloader* preloader = prefetcher->take_preloader(map_id);
+      if (preloader != NULL) {
+        // the map was already read in advance
+        next_map->preload(preloader);
+      }
+      else {
+        // read the map in the background during the out transition
+        next_map->preload();
+      }
+    }
   }
   else {
     // same map
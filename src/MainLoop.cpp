@@ -22,12 +22,25 @@
 #include "lowlevel/Music.h"
 #include "lowlevel/FileTools.h"
 #include "lowlevel/Debug.h"
+#include "lowlevel/Profiler.h"
+#include "lowlevel/InputRecording.h"
+#include "lowlevel/Random.h"
 #include "lua/LuaContext.h"
 #include "QuestProperties.h"
 #include "Game.h"
+#include "Map.h"
 #include "Savegame.h"
 #include "StringResource.h"
 #include "QuestResourceList.h"
+#include "entities/MapEntities.h"
+#include "entities/CustomEntity.h"
+#include "entities/Hero.h"
+#include "movements/RandomMovement.h"
+#include "movements/PathFinding.h"
+#include "entities/TilesetCache.h"
+#include <algorithm>
+#include <iostream>
+#include <vector>
 
 /**
  * \brief Initializes the game engine.
@@ -39,11 +52,38 @@ MainLoop::MainLoop(int argc, char** argv):
   lua_context(NULL),
   exiting(false),
   game(NULL),
-  next_game(NULL) {
+  next_game(NULL),
+  input_recording(NULL),
+  benchmark(false) {
 
   // Initialize low-level features (audio, video, files...).
   System::initialize(argc, argv);
 
+  // Record or replay the input events if requested.
+  const std::string record_option = "-record-input=";
+  const std::string benchmark_option = "-benchmark=";
+  const std::string benchmark_suite_option = "-benchmark-suite=";
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg.find(record_option) == 0) {
+      input_recording = new InputRecording();
+      if (!input_recording->start_recording(arg.substr(record_option.size()))) {
+        delete input_recording;
+        input_recording = NULL;
+      }
+    }
+    else if (arg.find(benchmark_option) == 0) {
+      input_recording = new InputRecording();
+      if (!input_recording->start_replay(arg.substr(benchmark_option.size()))) {
+        Debug::die("Cannot start the benchmark");
+      }
+      benchmark = true;
+    }
+    else if (arg.find(benchmark_suite_option) == 0) {
+      benchmark_map_id = arg.substr(benchmark_suite_option.size());
+    }
+  }
+
   // Read the quest general properties.
   QuestProperties quest_properties(*this);
   quest_properties.load();
@@ -71,6 +111,11 @@ MainLoop::~MainLoop() {
     game = NULL;
   }
 
+  if (input_recording != NULL) {
+    input_recording->stop_recording(System::now());
+    delete input_recording;
+  }
+
   delete lua_context;
   root_surface->decrement_refcount();
   delete root_surface;
@@ -153,6 +198,16 @@ void MainLoop::set_game(Game* game) {
  */
 void MainLoop::run() {
 
+  if (benchmark) {
+    run_benchmark();
+    return;
+  }
+
+  if (!benchmark_map_id.empty()) {
+    run_benchmark_suite();
+    return;
+  }
+
   // Main loop.
   uint32_t last_frame_date = System::get_real_time();
   uint32_t lag = 0;  // Lose time of the simulation.
@@ -207,12 +262,272 @@ void MainLoop::run() {
 void MainLoop::check_input() {
 
   InputEvent* event = InputEvent::get_event();
+
+  if (benchmark) {
+    // Only accept closing the window from the real input.
+    if (event != NULL) {
+      if (event->is_window_closing()) {
+        notify_input(*event);
+      }
+      delete event;
+    }
+
+    // Replay all events recorded at the current date.
+    while ((event = input_recording->get_event(System::now())) != NULL) {
+      notify_input(*event);
+      delete event;
+    }
+    return;
+  }
+
   if (event != NULL) {
+    if (input_recording != NULL) {
+      input_recording->record_event(*event, System::now());
+    }
     notify_input(*event);
     delete event;
   }
 }
 
+/**
+ * \brief Replays the recorded input events as fast as possible.
+ *
+ * Unlike run(), each iteration makes exactly one update and one draw and
+ * never sleeps, so that the result only depends on the recording.
+ * When the recording is finished, the number of updates and draws per
+ * second and the median and 99th percentile frame times are printed,
+ * as well as statistics of some subsystems.
+ */
+void MainLoop::run_benchmark() {
+
+  std::vector<double> frame_durations;
+  int num_updates = 0;
+  int num_draws = 0;
+  uint64_t num_grid_queries = 0;
+  uint64_t num_grid_candidates = 0;
+  const double start_date = System::get_precise_real_time();
+
+  while (!is_exiting()
+      && !input_recording->is_replay_finished(System::now())) {
+
+    const double frame_start_date = System::get_precise_real_time();
+
+    check_input();
+    if (is_exiting()) {
+      break;
+    }
+
+    update();
+    ++num_updates;
+
+    if (game != NULL && game->has_current_map()) {
+      MapEntities& entities = game->get_current_map().get_entities();
+      num_grid_queries += entities.get_num_grid_queries();
+      num_grid_candidates += entities.get_num_grid_candidates();
+      entities.reset_grid_statistics();
+    }
+
+    draw();
+    ++num_draws;
+
+    frame_durations.push_back(System::get_precise_real_time() - frame_start_date);
+  }
+
+  const double total_duration = (System::get_precise_real_time() - start_date) / 1000.0;
+  double p50 = 0.0;
+  double p99 = 0.0;
+  if (!frame_durations.empty()) {
+    std::sort(frame_durations.begin(), frame_durations.end());
+    p50 = frame_durations[frame_durations.size() * 50 / 100];
+    p99 = frame_durations[frame_durations.size() * 99 / 100];
+  }
+
+  std::cout << "Benchmark: " << num_updates << " updates and "
+      << num_draws << " draws in " << total_duration << " s" << std::endl
+      << "  updates/s: " << (total_duration > 0.0 ? num_updates / total_duration : 0.0) << std::endl
+      << "  draws/s: " << (total_duration > 0.0 ? num_draws / total_duration : 0.0) << std::endl
+      << "  frame time p50: " << p50 << " ms" << std::endl
+      << "  frame time p99: " << p99 << " ms" << std::endl
+      << "  tileset cache: " << TilesetCache::get_nb_hits() << " hits, "
+      << TilesetCache::get_nb_misses() << " misses, "
+      << TilesetCache::get_load_time() << " ms loading" << std::endl
+      << "  collision grid: " << num_grid_queries << " queries, "
+      << (num_grid_queries > 0 ? double(num_grid_candidates) / num_grid_queries : 0.0)
+      << " candidates/query" << std::endl
+      << "  music underruns: " << Music::get_nb_underruns() << std::endl;
+}
+
+/**
+ * \brief Measures some subsystems in fixed conditions.
+ *
+ * Unlike run_benchmark(), this does not depend on a recording: a new game
+ * is started on the test map and the random generator uses a fixed seed,
+ * so that results can be compared between runs and between machines.
+ * The pixel filters are measured on the first frame of the map, then the
+ * blits and the entities.
+ */
+void MainLoop::run_benchmark_suite() {
+
+  std::cout << "Benchmark suite on map '" << benchmark_map_id << "'" << std::endl;
+  if (!start_benchmark_map()) {
+    std::cout << "  cannot start the test map" << std::endl;
+    return;
+  }
+
+  draw();
+  VideoManager::get_instance()->run_pixel_filters_benchmark(*root_surface);
+  Surface::run_blits_benchmark();
+
+  Random::set_seed(benchmark_seed);
+  run_entities_benchmark();
+}
+
+/**
+ * \brief Starts a new game on the test map of the benchmark suite.
+ *
+ * The savegame is never saved.
+ *
+ * \return true if the test map is now running.
+ */
+bool MainLoop::start_benchmark_map() {
+
+  Savegame* savegame = new Savegame(*this, "benchmark_suite.dat");
+  savegame->increment_refcount();
+  savegame->get_equipment().load_items();
+  savegame->set_string(Savegame::KEY_STARTING_MAP, benchmark_map_id);
+  savegame->set_string(Savegame::KEY_STARTING_POINT, "");
+  savegame->decrement_refcount();
+  set_game(new Game(*this, savegame));
+
+  // Wait for the map to be loaded and started.
+  const int max_updates = 1000;
+  for (int i = 0; i < max_updates && !is_exiting(); i++) {
+    update();
+    if (game != NULL
+        && game->has_current_map()
+        && game->get_current_map().is_started()
+        && game->get_current_map().get_id() == benchmark_map_id) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * \brief Measures the update and collision throughput of the current map
+ * with a lot of moving entities.
+ *
+ * This is done by the benchmark suite, on its test map.
+ * Custom entities with a random movement are added to the map and the
+ * game is updated during a fixed number of cycles.
+ * Every move of these entities makes obstacle and detector queries.
+ * The entities are removed afterwards.
+ */
+void MainLoop::run_entities_benchmark() {
+
+  if (game == NULL || !game->has_current_map()) {
+    std::cout << "  entities: no map to test" << std::endl;
+    return;
+  }
+
+  const int nb_entities = 1000;
+  const int nb_updates = 300;
+
+  Map* map = &game->get_current_map();
+  MapEntities& entities = map->get_entities();
+  std::vector<MapEntity*> added_entities;
+  for (int i = 0; i < nb_entities; i++) {
+    const int x = Random::get_number(std::max(1, map->get_width() - 16));
+    const int y = Random::get_number(std::max(1, map->get_height() - 16));
+    CustomEntity* entity = new CustomEntity(
+        *game, "", LAYER_LOW, x, y, 16, 16, "");
+    entity->set_optimization_distance(0);  // Always update it.
+    entities.add_entity(entity);
+    entity->set_movement(new RandomMovement(48));
+    added_entities.push_back(entity);
+  }
+  entities.reset_grid_statistics();
+
+  int num_updates = 0;
+  const double start_date = System::get_precise_real_time();
+  while (num_updates < nb_updates
+      && game != NULL
+      && game->has_current_map()
+      && &game->get_current_map() == map) {
+    update();
+    ++num_updates;
+  }
+  const double duration = (System::get_precise_real_time() - start_date) / 1000.0;
+
+  if (game == NULL
+      || !game->has_current_map()
+      || &game->get_current_map() != map) {
+    // The map has changed meanwhile: its entities no longer exist.
+    std::cout << "  entities: the map has changed during the test" << std::endl;
+    return;
+  }
+
+  const int num_grid_queries = entities.get_num_grid_queries();
+  const int num_grid_candidates = entities.get_num_grid_candidates();
+  std::cout << "  entities: " << nb_entities << " added to map '"
+      << map->get_id() << "', " << num_updates << " updates in "
+      << duration << " s" << std::endl
+      << "    updates/s: " << (duration > 0.0 ? num_updates / duration : 0.0) << std::endl
+      << "    entity updates/s: "
+      << (duration > 0.0 ? num_updates * nb_entities / duration : 0.0) << std::endl
+      << "    collision grid queries/s: "
+      << (duration > 0.0 ? num_grid_queries / duration : 0.0) << ", "
+      << (num_grid_queries > 0 ? double(num_grid_candidates) / num_grid_queries : 0.0)
+      << " candidates/query" << std::endl;
+
+  run_path_finding_benchmark(*map, added_entities);
+
+  std::vector<MapEntity*>::const_iterator it;
+  for (it = added_entities.begin(); it != added_entities.end(); ++it) {
+    entities.remove_entity(*it);
+  }
+  update();
+}
+
+/**
+ * \brief Measures how many paths per second the path finding computes on
+ * a map.
+ *
+ * A path is computed from each source entity to the hero, like enemies
+ * with a path finding movement do.
+ * Paths start from the 8*8 grid, so sources that are not aligned on it
+ * are snapped to it first.
+ *
+ * \param map The map.
+ * \param sources Entities of the map where paths start.
+ */
+void MainLoop::run_path_finding_benchmark(Map& map,
+    const std::vector<MapEntity*>& sources) {
+
+  Hero& hero = map.get_entities().get_hero();
+  std::vector<MapEntity*>::const_iterator it;
+  for (it = sources.begin(); it != sources.end(); ++it) {
+    MapEntity& source = *(*it);
+    if (!source.is_aligned_to_grid()) {
+      source.set_aligned_to_grid();
+    }
+  }
+
+  int nb_paths_found = 0;
+  const double start_date = System::get_precise_real_time();
+  for (it = sources.begin(); it != sources.end(); ++it) {
+    PathFinding path_finding(map, **it, hero);
+    if (!path_finding.compute_path().empty()) {
+      ++nb_paths_found;
+    }
+  }
+  const double duration = (System::get_precise_real_time() - start_date) / 1000.0;
+
+  std::cout << "    path finding: " << sources.size() << " paths in "
+      << duration * 1000.0 << " ms (" << nb_paths_found << " found)" << std::endl
+      << "    paths/s: " << (duration > 0.0 ? sources.size() / duration : 0.0) << std::endl;
+}
+
 /**
  * \brief This function is called when there is an input event.
  *
@@ -285,6 +600,7 @@ void MainLoop::draw() {
     game->draw(*root_surface);
   }
   lua_context->main_on_draw(*root_surface);
+  Profiler::draw(*root_surface);
   VideoManager::get_instance()->draw(*root_surface);
 }
 
@@ -16,6 +16,7 @@
  */
 #include "Map.h"
 #include "MapLoader.h"
+#include "MapPreloader.h"
 #include "Game.h"
 #include "Savegame.h"
 #include "Sprite.h"
@@ -25,13 +26,16 @@
 #include "lowlevel/VideoManager.h"
 #include "lowlevel/Music.h"
 #include "lowlevel/Debug.h"
+#include "lowlevel/Profiler.h"
 #include "entities/Ground.h"
 #include "entities/Tileset.h"
+#include "entities/TilesetCache.h"
 #include "entities/TilePattern.h"
 #include "entities/MapEntities.h"
 #include "entities/Destination.h"
 #include "entities/Detector.h"
 #include "entities/Hero.h"
+#include <algorithm>
 
 MapLoader Map::map_loader;
 
@@ -48,6 +52,7 @@ Map::Map(const std::string& id):
   camera(NULL),
   visible_surface(NULL),
   background_surface(NULL),
+  preloader(NULL),
   loaded(false),
   started(false),
   destination_name(""),
@@ -67,6 +72,7 @@ Map::~Map() {
   if (is_loaded()) {
     unload();
   }
+  delete preloader;
 }
 
 /**
@@ -107,10 +113,12 @@ const std::string& Map::get_tileset_id() const {
  */
 void Map::set_tileset(const std::string& tileset_id) {
 
-  Tileset new_tileset(tileset_id);
-  new_tileset.load();
-  tileset->set_images(new_tileset);
+  // The tileset may be shared with other maps: get another one that keeps
+  // the tile patterns but has the new images.
+  Tileset* old_tileset = tileset;
+  tileset = TilesetCache::get_tileset(old_tileset->get_id(), tileset_id);
   get_entities().notify_tileset_changed();
+  TilesetCache::release_tileset(old_tileset);
   this->tileset_id = tileset_id;
   rebuild_background_surface();
 }
@@ -236,7 +244,7 @@ bool Map::is_loaded() const {
 void Map::unload() {
 
   if (is_loaded()) {
-    delete tileset;
+    TilesetCache::release_tileset(tileset);
     tileset = NULL;
     visible_surface->decrement_refcount();
     if (visible_surface->get_refcount() == 0) {
@@ -253,10 +261,53 @@ void Map::unload() {
   }
 }
 
+/**
+ * \brief Starts reading the map data and its tileset in a background thread.
+ *
+ * Call load() later to finish loading the map: it only has to create the
+ * entities then.
+ * This allows to play a transition while the map is being read.
+ */
+void Map::preload() {
+
+  Debug::check_assertion(!is_loaded() && preloader == NULL,
+      "This map is already loaded");
+
+  preloader = new MapPreloader(id);
+  preloader->start();
+}
+
+/**
+ * \brief Uses map data already read by someone else.
+ *
+ * Call load() later to finish loading the map: it only has to create the
+ * entities then.
+ *
+ * \param preloader A preloader of this map, for example one taken from the
+ * MapPrefetcher. The map becomes its owner.
+ */
+void Map::preload(MapPreloader* preloader) {
+
+  Debug::check_assertion(!is_loaded() && this->preloader == NULL,
+      "This map is already loaded");
+
+  this->preloader = preloader;
+}
+
+/**
+ * \brief Returns whether load() can be called without waiting for the
+ * background thread started by preload().
+ * \return true if the map data is available.
+ */
+bool Map::is_preloaded() {
+  return preloader == NULL || preloader->is_finished();
+}
+
 /**
  * \brief Loads the map into a game.
  *
- * Reads the description file of the map.
+ * Reads the description file of the map, unless preload() was called.
+ * In this case, waits for the preloading to finish if necessary.
  *
  * \param game the game
  */
@@ -522,6 +573,8 @@ void Map::check_suspended() {
  */
 void Map::draw() {
 
+  SOLARUS_PROFILE("Map::draw");
+
   if (is_loaded()) {
     // background
     draw_background();
@@ -839,12 +892,14 @@ bool Map::test_collision_with_entities(
     const Rectangle& collision_box,
     const MapEntity& entity_to_check) const {
 
-  const std::list<MapEntity*>& obstacle_entities =
-      entities->get_obstacle_entities(layer);
-  const std::list<MapEntity*>::const_iterator end =
+  // Only check entities located in the cells of the collision box.
+  // The vector is local because obstacle tests may query the map again.
+  std::vector<MapEntity*> obstacle_entities;
+  entities->get_obstacle_entities(layer, collision_box, obstacle_entities);
+  const std::vector<MapEntity*>::const_iterator end =
       obstacle_entities.end();
 
-  std::list<MapEntity*>::const_iterator it;
+  std::vector<MapEntity*>::const_iterator it;
   for (it = obstacle_entities.begin(); it != end; ++it) {
 
     MapEntity* entity = *it;
@@ -962,6 +1017,83 @@ bool Map::test_collision_with_obstacles(
   return collision;
 }
 
+/**
+ * \brief Returns how far an entity can go along a path without reaching an
+ * obstacle.
+ *
+ * This is equivalent to calling test_collision_with_obstacles() for each
+ * position of the path until one is blocked, but when the whole swept area
+ * is free (the usual case), the terrain and the dynamic entities are only
+ * tested once for the union of all bounding boxes.
+ *
+ * \param entity_to_check The entity that wants to move. Its current
+ * bounding box gives the size and the offset of the tested boxes.
+ * \param path Successive positions of the entity (only x and y are used).
+ * \return The number of positions at the beginning of the path that the
+ * entity can reach one after the other.
+ */
+int Map::get_nb_reachable_positions(
+    const MapEntity& entity_to_check,
+    const std::vector<Rectangle>& path) const {
+
+  if (path.empty()) {
+    return 0;
+  }
+
+  const Layer layer = entity_to_check.get_layer();
+  const Rectangle& bounding_box = entity_to_check.get_bounding_box();
+  const int dx = bounding_box.get_x() - entity_to_check.get_x();
+  const int dy = bounding_box.get_y() - entity_to_check.get_y();
+
+  // Compute the area swept by the bounding box.
+  int x1 = path[0].get_x();
+  int x2 = x1;
+  int y1 = path[0].get_y();
+  int y2 = y1;
+  std::vector<Rectangle>::const_iterator it;
+  for (it = path.begin(); it != path.end(); ++it) {
+    x1 = std::min(x1, it->get_x());
+    x2 = std::max(x2, it->get_x());
+    y1 = std::min(y1, it->get_y());
+    y2 = std::max(y2, it->get_y());
+  }
+  const Rectangle swept_box(x1 + dx, y1 + dy,
+      x2 - x1 + bounding_box.get_width(), y2 - y1 + bounding_box.get_height());
+
+  // Fast path: test one point of each 8x8 square of the swept area,
+  // including its interior, and the obstacle entities once.
+  // A diagonal wall needs the exact check of every box.
+  const int sx1 = swept_box.get_x();
+  const int sx2 = sx1 + swept_box.get_width() - 1;
+  const int sy1 = swept_box.get_y();
+  const int sy2 = sy1 + swept_box.get_height() - 1;
+  bool found_diagonal_wall = false;
+  bool collision = false;
+  for (int y = sy1; y < sy2 + 8 && !collision; y += 8) {
+    for (int x = sx1; x < sx2 + 8 && !collision; x += 8) {
+      collision = test_collision_with_ground(layer, std::min(x, sx2), std::min(y, sy2),
+          entity_to_check, found_diagonal_wall);
+    }
+  }
+
+  if (!collision && !found_diagonal_wall
+      && !test_collision_with_entities(layer, swept_box, entity_to_check)) {
+    return path.size();
+  }
+
+  // Slow path: find the first blocked position.
+  Rectangle collision_box = bounding_box;
+  int nb_positions = 0;
+  for (it = path.begin(); it != path.end(); ++it) {
+    collision_box.set_xy(it->get_x() + dx, it->get_y() + dy);
+    if (test_collision_with_obstacles(layer, collision_box, entity_to_check)) {
+      break;
+    }
+    ++nb_positions;
+  }
+  return nb_positions;
+}
+
 /**
  * \brief Returns whether there is empty ground in the specified rectangle.
  *
@@ -1008,12 +1140,13 @@ bool Map::has_empty_ground(Layer layer, const Rectangle& collision_box) const {
 Ground Map::get_ground(Layer layer, int x, int y) const {
 
   // See if a dynamic entity changes the ground.
-  // TODO store ground modifiers in a quad tree for performance.
+  // Only the ground modifiers of the 8x8 cell of the point are checked.
+  // The last one added wins.
 
-  const std::list<MapEntity*>& ground_modifiers =
-      entities->get_ground_modifiers(layer);
-  std::list<MapEntity*>::const_reverse_iterator it;
-  const std::list<MapEntity*>::const_reverse_iterator rend =
+  const std::vector<MapEntity*>& ground_modifiers =
+      entities->get_ground_modifiers(layer, x, y);
+  std::vector<MapEntity*>::const_reverse_iterator it;
+  const std::vector<MapEntity*>::const_reverse_iterator rend =
       ground_modifiers.rend();
   for (it = ground_modifiers.rbegin(); it != rend; ++it) {
     const MapEntity& ground_modifier = *(*it);
@@ -1060,11 +1193,20 @@ void Map::check_collision_with_detectors(MapEntity& entity) {
     return;
   }
 
-  const std::list<Detector*>& detectors = entities->get_detectors();
+  // Only check detectors near the entity. The margin includes the facing
+  // points and the other points tested by some collision modes.
+  // We work on a copy because detectors may move or be created when they are
+  // notified of a collision.
+  Rectangle region = entity.get_bounding_box();
+  region.add_xy(-detector_margin, -detector_margin);
+  region.add_width(2 * detector_margin);
+  region.add_height(2 * detector_margin);
+  std::vector<Detector*> detectors;
+  entities->get_detectors(region, detectors);
 
   // Check each detector.
-  std::list<Detector*>::const_iterator it;
-  const std::list<Detector*>::const_iterator end = detectors.end();
+  std::vector<Detector*>::const_iterator it;
+  const std::vector<Detector*>::const_iterator end = detectors.end();
   for (it = detectors.begin(); it != end; ++it) {
 
     Detector* detector = *it;
@@ -1075,6 +1217,123 @@ void Map::check_collision_with_detectors(MapEntity& entity) {
   }
 }
 
+/**
+ * \brief Checks the collisions between an entity and the detectors of the map
+ * at each intermediate position of a path.
+ *
+ * This function is called by movements that move an entity of several
+ * pixels at once: detectors that the entity crosses on its way are notified
+ * in the order of the path, as if the entity had stopped at each position.
+ * The entity is placed at each position without any other notification.
+ * The last position is not checked here: the caller is supposed to move
+ * the entity there normally.
+ *
+ * Candidate detectors for bounding box collisions are only searched once,
+ * around the whole path. Pixel-precise collisions are checked with all
+ * detectors because sprites can be larger than bounding boxes.
+ *
+ * \param entity The entity that moves.
+ * \param path Successive positions of the entity (only x and y are used).
+ * \param nb_positions Number of positions of the path to go through,
+ * including the last one.
+ * \return The number of positions the entity went through. This is less
+ * than nb_positions if a detector moved the entity, changed its movement,
+ * removed it or suspended the map: the entity is then left where the detector put it and the rest
+ * of the path should be abandoned.
+ */
+int Map::check_collision_with_detectors(
+    MapEntity& entity,
+    const std::vector<Rectangle>& path,
+    int nb_positions) {
+
+  if (suspended || nb_positions <= 1) {
+    return nb_positions;
+  }
+
+  // Get the detectors near the swept area.
+  Rectangle region = entity.get_bounding_box();
+  const int dx = region.get_x() - entity.get_x();
+  const int dy = region.get_y() - entity.get_y();
+  int x1 = entity.get_x();
+  int x2 = x1;
+  int y1 = entity.get_y();
+  int y2 = y1;
+  for (int i = 0; i < nb_positions; ++i) {
+    x1 = std::min(x1, path[i].get_x());
+    x2 = std::max(x2, path[i].get_x());
+    y1 = std::min(y1, path[i].get_y());
+    y2 = std::max(y2, path[i].get_y());
+  }
+  region.set_xy(x1 + dx - detector_margin, y1 + dy - detector_margin);
+  region.add_width(x2 - x1 + 2 * detector_margin);
+  region.add_height(y2 - y1 + 2 * detector_margin);
+  std::vector<Detector*> detectors;
+  entities->get_detectors(region, detectors);
+
+  if (detectors.empty()) {
+    return nb_positions;
+  }
+
+  const Movement* movement = entity.get_movement();
+  const std::vector<Detector*>::const_iterator end = detectors.end();
+  std::vector<Detector*>::const_iterator it;
+  for (int i = 0; i < nb_positions - 1; ++i) {
+
+    const Rectangle& xy = path[i];
+    entity.set_xy(xy);
+
+    for (it = detectors.begin(); it != end; ++it) {
+
+      Detector* detector = *it;
+      if (detector->is_enabled()
+          && !detector->is_being_removed()) {
+        detector->check_collision(entity);
+      }
+
+      if (suspended
+          || entity.is_being_removed()
+          || entity.get_movement() != movement
+          || entity.get_x() != xy.get_x()
+          || entity.get_y() != xy.get_y()) {
+        // The detector reacted by moving the entity or by changing the game.
+        return i + 1;
+      }
+    }
+
+    // Pixel-precise collisions: sprites can be larger than bounding boxes,
+    // so all detectors are checked like in the non-swept case.
+    const std::vector<Sprite*>& sprites = entity.get_sprites();
+    std::vector<Sprite*>::const_iterator sprite_it;
+    for (sprite_it = sprites.begin(); sprite_it != sprites.end(); ++sprite_it) {
+
+      Sprite& sprite = *(*sprite_it);
+      if (!sprite.are_pixel_collisions_enabled()) {
+        continue;
+      }
+
+      const std::vector<Detector*>& all_detectors = entities->get_detectors();
+      for (unsigned int j = 0; j < all_detectors.size(); ++j) {
+
+        Detector* detector = all_detectors[j];
+        if (detector->is_enabled()
+            && !detector->is_being_removed()) {
+          detector->check_collision(entity, sprite);
+        }
+
+        if (suspended
+            || entity.is_being_removed()
+            || entity.get_movement() != movement
+            || entity.get_x() != xy.get_x()
+            || entity.get_y() != xy.get_y()) {
+          return i + 1;
+        }
+      }
+    }
+  }
+
+  return nb_positions;
+}
+
 /**
  * \brief Checks the pixel-perfect collisions between an entity and the detectors of the map.
  *
@@ -1092,16 +1351,14 @@ void Map::check_collision_with_detectors(MapEntity &entity, Sprite &sprite) {
     return;
   }
 
-  const std::list<Detector*>& detectors = entities->get_detectors();
+  const std::vector<Detector*>& detectors = entities->get_detectors();
   // check each detector
-  std::list<Detector*>::const_iterator i;
-  for (i = detectors.begin();
-       i != detectors.end();
-       i++) {
-
-    if (!(*i)->is_being_removed()
-        && (*i)->is_enabled()) {
-      (*i)->check_collision(entity, sprite);
+  for (unsigned int i = 0; i < detectors.size(); i++) {
+
+    Detector* detector = detectors[i];
+    if (!detector->is_being_removed()
+        && detector->is_enabled()) {
+      detector->check_collision(entity, sprite);
     }
   }
 }
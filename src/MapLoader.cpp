@@ -15,6 +15,7 @@
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "MapLoader.h"
+#include "MapPreloader.h"
 #include "Map.h"
 #include "Game.h"
 #include "Camera.h"
@@ -28,8 +29,35 @@
 #include "entities/MapEntities.h"
 #include "entities/EntityType.h"
 #include "entities/MapEntity.h"
+#include "entities/Hero.h"
 #include "lua/LuaContext.h"
 
+const luaL_Reg MapLoader::entity_creation_functions[] = {
+  { "tile",             LuaContext::map_api_create_tile },
+  { "destination",      LuaContext::map_api_create_destination },
+  { "teletransporter",  LuaContext::map_api_create_teletransporter },
+  { "pickable",         LuaContext::map_api_create_pickable },
+  { "destructible",     LuaContext::map_api_create_destructible },
+  { "chest",            LuaContext::map_api_create_chest },
+  { "jumper",           LuaContext::map_api_create_jumper },
+  { "enemy",            LuaContext::map_api_create_enemy },
+  { "npc",              LuaContext::map_api_create_npc },
+  { "block",            LuaContext::map_api_create_block },
+  { "dynamic_tile",     LuaContext::map_api_create_dynamic_tile },
+  { "switch",           LuaContext::map_api_create_switch },
+  { "wall",             LuaContext::map_api_create_wall },
+  { "sensor",           LuaContext::map_api_create_sensor },
+  { "crystal",          LuaContext::map_api_create_crystal },
+  { "crystal_block",    LuaContext::map_api_create_crystal_block },
+  { "shop_treasure",    LuaContext::map_api_create_shop_treasure },
+  { "conveyor_belt",    LuaContext::map_api_create_conveyor_belt },
+  { "door",             LuaContext::map_api_create_door },
+  { "stairs",           LuaContext::map_api_create_stairs },
+  { "separator",        LuaContext::map_api_create_separator },
+  { "custom",           LuaContext::map_api_create_custom_entity },
+  { NULL, NULL }
+};
+
 /**
  * \brief Creates a map loader.
  */
@@ -46,6 +74,13 @@ MapLoader::~MapLoader() {
 
 /**
  * \brief Loads a map into the game.
+ *
+ * If the map data was not preloaded in a background thread
+ * (see Map::preload()), it is read now.
+ * Otherwise, this function only blocks if the preloader has not finished
+ * yet.
+ * The entities are then created in the current thread.
+ *
  * \param game The game.
  * \param map The map to load.
  */
@@ -53,23 +88,19 @@ void MapLoader::load_map(Game& game, Map& map) {
 
   map.game = &game;
 
-  // Open the map data file in an independent Lua world.
-  const std::string& file_name = std::string("maps/") + map.get_id() + ".dat";
-  lua_State* l = luaL_newstate();
-  size_t size;
-  char* buffer;
-  FileTools::data_file_open_buffer(file_name, &buffer, &size);
-  int load_result = luaL_loadbuffer(l, buffer, size, file_name.c_str());
-  FileTools::data_file_close_buffer(buffer);
-
-  if (load_result != 0) {
-    Debug::die(StringConcat() << "Failed to load map data file '"
-        << file_name << "': " << lua_tostring(l, -1));
-    lua_pop(l, 1);
+  MapPreloader* preloader = map.preloader;
+  map.preloader = NULL;
+  if (preloader == NULL) {
+    preloader = new MapPreloader(map.get_id());
+    preloader->load();
+  }
+  else {
+    preloader->wait();
   }
 
-  // Register the properties() function to Lua.
-  lua_register(l, "properties", l_properties);
+  const std::string& file_name = std::string("maps/") + map.get_id() + ".dat";
+  lua_State* l = preloader->get_lua_state();
+  map.tileset = preloader->release_tileset();
 
   // Make the Lua world aware of our map.
   luaL_newmetatable(l, LuaContext::map_module_name.c_str());
@@ -78,23 +109,39 @@ void MapLoader::load_map(Game& game, Map& map) {
   lua_pop(l, 1);
   LuaContext::set_entity_implicit_creation_map(l, &map);
 
-  // Execute the Lua code.
-  if (lua_pcall(l, 0, 0, 0) != 0) {
+  // Apply the properties.
+  lua_pushcfunction(l, l_properties);
+  lua_getfield(l, LUA_REGISTRYINDEX, "properties");
+  if (lua_pcall(l, 1, 0, 0) != 0) {
     Debug::die(StringConcat() << "Failed to load map data file '"
         << file_name << "': " << lua_tostring(l, -1));
     lua_pop(l, 1);
   }
 
-  lua_close(l);
+  // Create the entities in the order of the data file.
+  lua_getfield(l, LUA_REGISTRYINDEX, "entities");
+  const int nb_entities = preloader->get_nb_entities();
+  for (int i = 0; i < nb_entities; ++i) {
+    lua_pushcfunction(l, entity_creation_functions[preloader->get_entity_type(i)].func);
+    lua_rawgeti(l, -2, i + 1);
+    if (lua_pcall(l, 1, 0, 0) != 0) {
+      Debug::die(StringConcat() << "Failed to load map data file '"
+          << file_name << "': " << preloader->get_entity_location(i)
+          << " " << lua_tostring(l, -1));
+      lua_pop(l, 1);
+    }
+  }
+  lua_pop(l, 1);
 
-  // TODO if necessary, store the Lua compiled chunck to speed up next loadings of this map.
+  delete preloader;
 }
 
 /**
  * \brief Implementation of the properties() function of the Lua map data file.
  *
  * Sets the properties of the map: position, dimensions, tileset, music, etc.
- * This function must be called before any entity creation function.
+ * It is called with the properties table recorded by the MapPreloader,
+ * before any entity creation function.
  *
  * \param l The Lua state that is calling this function.
  * \return Number of values to return to Lua.
@@ -128,8 +175,8 @@ int MapLoader::l_properties(lua_State* l) {
   map->set_floor(floor);
 
   map->tileset_id = tileset_id;
-  map->tileset = new Tileset(tileset_id);
-  map->tileset->load();
+  Debug::check_assertion(map->tileset != NULL && map->tileset->get_id() == tileset_id,
+      "The tileset of the map was not preloaded");
 
   MapEntities& entities = map->get_entities();
   entities.map_width8 = map->width8;
@@ -144,42 +191,17 @@ int MapLoader::l_properties(lua_State* l) {
       entities.animated_tiles[layer][i] = false;
       entities.tiles_ground[layer][i] = initial_ground;
     }
+    entities.ground_modifiers_grid[layer] = new Grid<MapEntity*>(
+        map->location,
+        Rectangle(0, 0, MapEntities::ground_modifiers_grid_cell_size, MapEntities::ground_modifiers_grid_cell_size));
   }
+  entities.entities_grid = new Grid<MapEntity*>(
+      map->location,
+      Rectangle(0, 0, MapEntities::entities_grid_cell_size, MapEntities::entities_grid_cell_size));
+  entities.entities_grid->add(&entities.hero, entities.hero.get_bounding_box());
   entities.boomerang = NULL;
   map->camera = new Camera(*map);
 
-  // Properties are set: we now allow the data file to declare entities.
-  static const luaL_Reg functions[] = {
-    { "tile",             LuaContext::map_api_create_tile },
-    { "destination",      LuaContext::map_api_create_destination },
-    { "teletransporter",  LuaContext::map_api_create_teletransporter },
-    { "pickable",         LuaContext::map_api_create_pickable },
-    { "destructible",     LuaContext::map_api_create_destructible },
-    { "chest",            LuaContext::map_api_create_chest },
-    { "jumper",           LuaContext::map_api_create_jumper },
-    { "enemy",            LuaContext::map_api_create_enemy },
-    { "npc",              LuaContext::map_api_create_npc },
-    { "block",            LuaContext::map_api_create_block },
-    { "dynamic_tile",     LuaContext::map_api_create_dynamic_tile },
-    { "switch",           LuaContext::map_api_create_switch },
-    { "wall",             LuaContext::map_api_create_wall },
-    { "sensor",           LuaContext::map_api_create_sensor },
-    { "crystal",          LuaContext::map_api_create_crystal },
-    { "crystal_block",    LuaContext::map_api_create_crystal_block },
-    { "shop_treasure",    LuaContext::map_api_create_shop_treasure },
-    { "conveyor_belt",    LuaContext::map_api_create_conveyor_belt },
-    { "door",             LuaContext::map_api_create_door },
-    { "stairs",           LuaContext::map_api_create_stairs },
-    { "separator",        LuaContext::map_api_create_separator },
-    { "custom",           LuaContext::map_api_create_custom_entity },
-    { NULL, NULL }
-  };
-  const luaL_Reg* function = functions;
-  while (function->name != NULL) {
-    lua_register(l, function->name, function->func);
-    function++;
-  }
-
   return 0;
 }
 
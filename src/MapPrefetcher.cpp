@@ -0,0 +1,351 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "MapPrefetcher.h"
+#include "MapPreloader.h"
+#include "Map.h"
+#include "SpriteAnimationSet.h"
+#include "entities/MapEntities.h"
+#include "entities/Teletransporter.h"
+#include "lowlevel/FileTools.h"
+#include "lowlevel/Music.h"
+#include "lowlevel/Debug.h"
+#include "lowlevel/Profiler.h"
+#include <algorithm>
+#include <list>
+#include <vector>
+
+/**
+ * \brief Creates a prefetcher and starts its background thread.
+ */
+MapPrefetcher::MapPrefetcher():
+  thread(NULL),
+  mutex(SDL_CreateMutex()),
+  queue_changed(SDL_CreateCond()),
+  map_prefetched(SDL_CreateCond()),
+  prefetched_bytes(0),
+  max_bytes(16 * 1024 * 1024),
+  stopping(false) {
+
+  thread = SDL_CreateThread(thread_main, "solarus_map_prefetcher", this);
+  if (thread == NULL) {
+    Debug::warning(std::string("Failed to create the map prefetcher thread: ")
+        + SDL_GetError());
+  }
+}
+
+/**
+ * \brief Destructor.
+ *
+ * Stops the background thread and frees the maps read in advance.
+ */
+MapPrefetcher::~MapPrefetcher() {
+
+  SDL_LockMutex(mutex);
+  stopping = true;
+  SDL_CondBroadcast(queue_changed);
+  SDL_UnlockMutex(mutex);
+
+  if (thread != NULL) {
+    SDL_WaitThread(thread, NULL);
+  }
+
+  std::map<std::string, PrefetchedMap>::iterator it;
+  for (it = prefetched_maps.begin(); it != prefetched_maps.end(); ++it) {
+    discard(it->second);
+  }
+
+  std::vector<std::string>::const_iterator it2;
+  for (it2 = taken_music_file_names.begin(); it2 != taken_music_file_names.end(); ++it2) {
+    FileTools::data_file_discard_prefetched(*it2);
+  }
+
+  SDL_DestroyCond(map_prefetched);
+  SDL_DestroyCond(queue_changed);
+  SDL_DestroyMutex(mutex);
+}
+
+/**
+ * \brief Starts reading in advance the destination maps of the
+ * teletransporters of a map.
+ *
+ * Maps read in advance that are not destinations of this map are freed.
+ * This function should be called when the map has started.
+ *
+ * \param map The map where the hero is.
+ */
+void MapPrefetcher::prefetch_neighbours(Map& map) {
+
+  std::set<std::string> neighbour_ids;
+  const std::list<MapEntity*>& teletransporters =
+      map.get_entities().get_entities_with_prefix(ENTITY_TELETRANSPORTER, "");
+  std::list<MapEntity*>::const_iterator it;
+  for (it = teletransporters.begin(); it != teletransporters.end(); ++it) {
+    const std::string& destination_map_id =
+        static_cast<Teletransporter*>(*it)->get_destination_map_id();
+    if (destination_map_id != map.get_id()) {
+      neighbour_ids.insert(destination_map_id);
+    }
+  }
+
+  std::vector<PrefetchedMap> maps_to_discard;
+  std::vector<std::string> music_file_names_to_discard;
+
+  SDL_LockMutex(mutex);
+
+  // The music of the map that was taken has been played by now.
+  music_file_names_to_discard.swap(taken_music_file_names);
+
+  // Forget the maps that are no longer neighbours.
+  std::map<std::string, PrefetchedMap>::iterator it2 = prefetched_maps.begin();
+  while (it2 != prefetched_maps.end()) {
+    if (neighbour_ids.find(it2->first) == neighbour_ids.end()) {
+      prefetched_bytes -= it2->second.size;
+      maps_to_discard.push_back(it2->second);
+      prefetched_maps.erase(it2++);
+    }
+    else {
+      ++it2;
+    }
+  }
+
+  // Queue the new ones.
+  wanted_map_ids = neighbour_ids;
+  pending_map_ids.clear();
+  std::set<std::string>::const_iterator it3;
+  for (it3 = neighbour_ids.begin(); it3 != neighbour_ids.end(); ++it3) {
+    if (prefetched_maps.find(*it3) == prefetched_maps.end()
+        && *it3 != map_id_in_progress) {
+      pending_map_ids.push_back(*it3);
+    }
+  }
+  SDL_CondBroadcast(queue_changed);
+  SDL_UnlockMutex(mutex);
+
+  // Free memory outside the lock.
+  std::vector<PrefetchedMap>::iterator it4;
+  for (it4 = maps_to_discard.begin(); it4 != maps_to_discard.end(); ++it4) {
+    discard(*it4);
+  }
+  std::vector<std::string>::const_iterator it5;
+  for (it5 = music_file_names_to_discard.begin(); it5 != music_file_names_to_discard.end(); ++it5) {
+    FileTools::data_file_discard_prefetched(*it5);
+  }
+}
+
+/**
+ * \brief Takes the preloader of a map read in advance.
+ *
+ * If the background thread is reading this map right now, waits for it.
+ *
+ * \param map_id Id of the map.
+ * \return The preloader of this map with all data loaded, or NULL if the map
+ * was not read in advance. The caller becomes its owner.
+ */
+MapPreloader* MapPrefetcher::take_preloader(const std::string& map_id) {
+
+  MapPreloader* preloader = NULL;
+
+  SDL_LockMutex(mutex);
+  while (map_id_in_progress == map_id) {
+    SDL_CondWait(map_prefetched, mutex);
+  }
+
+  pending_map_ids.erase(
+      std::remove(pending_map_ids.begin(), pending_map_ids.end(), map_id),
+      pending_map_ids.end());
+
+  std::map<std::string, PrefetchedMap>::iterator it = prefetched_maps.find(map_id);
+  if (it != prefetched_maps.end()) {
+    PrefetchedMap& prefetched_map = it->second;
+    preloader = prefetched_map.preloader;
+    if (!prefetched_map.music_file_name.empty()) {
+      // The music file is kept until the map has started.
+      taken_music_file_names.push_back(prefetched_map.music_file_name);
+    }
+    prefetched_bytes -= prefetched_map.size;
+    prefetched_maps.erase(it);
+  }
+  SDL_UnlockMutex(mutex);
+
+  return preloader;
+}
+
+/**
+ * \brief Returns the memory kept for maps read in advance.
+ * \return The estimated size in bytes.
+ */
+size_t MapPrefetcher::get_prefetched_bytes() {
+
+  SDL_LockMutex(mutex);
+  size_t result = prefetched_bytes;
+  SDL_UnlockMutex(mutex);
+  return result;
+}
+
+/**
+ * \brief Returns the memory budget of the prefetcher.
+ * \return The size above which no more maps are read in advance, in bytes.
+ */
+size_t MapPrefetcher::get_max_bytes() const {
+  return max_bytes;
+}
+
+/**
+ * \brief Sets the memory budget of the prefetcher.
+ *
+ * Maps already read in advance are kept.
+ *
+ * \param max_bytes The size above which no more maps are read in advance,
+ * in bytes (0 disables prefetching).
+ */
+void MapPrefetcher::set_max_bytes(size_t max_bytes) {
+
+  SDL_LockMutex(mutex);
+  this->max_bytes = max_bytes;
+  SDL_UnlockMutex(mutex);
+}
+
+/**
+ * \brief Function executed by the background thread.
+ * \param prefetcher The map prefetcher.
+ * \return 0.
+ */
+int MapPrefetcher::thread_main(void* prefetcher) {
+
+  // Don't slow down the game.
+  SDL_SetThreadPriority(SDL_THREAD_PRIORITY_LOW);
+
+  static_cast<MapPrefetcher*>(prefetcher)->work();
+  return 0;
+}
+
+/**
+ * \brief Reads the queued maps until the prefetcher is destroyed.
+ */
+void MapPrefetcher::work() {
+
+  SDL_LockMutex(mutex);
+  while (true) {
+
+    while (!stopping && pending_map_ids.empty()) {
+      SDL_CondWait(queue_changed, mutex);
+    }
+
+    if (stopping) {
+      break;
+    }
+
+    const std::string map_id = pending_map_ids.front();
+    pending_map_ids.pop_front();
+    if (prefetched_bytes >= max_bytes) {
+      // Over budget: the map will be loaded normally if needed.
+      continue;
+    }
+
+    map_id_in_progress = map_id;
+    SDL_UnlockMutex(mutex);
+    PrefetchedMap prefetched_map = prefetch(map_id);
+    SDL_LockMutex(mutex);
+    map_id_in_progress.clear();
+
+    bool keep = prefetched_map.preloader != NULL
+        && wanted_map_ids.find(map_id) != wanted_map_ids.end();
+    if (keep) {
+      prefetched_maps[map_id] = prefetched_map;
+      prefetched_bytes += prefetched_map.size;
+    }
+    SDL_CondBroadcast(map_prefetched);
+
+    if (!keep) {
+      // The hero has moved meanwhile.
+      SDL_UnlockMutex(mutex);
+      discard(prefetched_map);
+      SDL_LockMutex(mutex);
+    }
+  }
+  SDL_UnlockMutex(mutex);
+}
+
+/**
+ * \brief Reads a map in advance.
+ *
+ * This function is called by the background thread.
+ *
+ * \param map_id Id of the map to read.
+ * \return The map read. Its preloader is NULL if the map does not exist
+ * or cannot be loaded.
+ */
+MapPrefetcher::PrefetchedMap MapPrefetcher::prefetch(const std::string& map_id) {
+
+  SOLARUS_PROFILE("MapPrefetcher::prefetch");
+
+  PrefetchedMap prefetched_map;
+  prefetched_map.preloader = NULL;
+  prefetched_map.size = 0;
+
+  // Data file and tileset.
+  // Errors are not reported here: the hero may never go to this map,
+  // and the map will be loaded again normally if the hero goes there.
+  MapPreloader* preloader = new MapPreloader(map_id);
+  if (!preloader->try_load()) {
+    delete preloader;
+    return prefetched_map;
+  }
+  prefetched_map.preloader = preloader;
+  prefetched_map.size = preloader->get_memory_size();
+
+  // Sprite images: decoding them once puts them in the image cache.
+  std::set<std::string> sprite_ids;
+  preloader->get_sprite_ids(sprite_ids);
+  std::set<std::string>::const_iterator it;
+  for (it = sprite_ids.begin(); it != sprite_ids.end(); ++it) {
+    if (FileTools::data_file_exists(std::string("sprites/") + *it + ".dat")) {
+      delete new SpriteAnimationSet(*it);
+    }
+  }
+
+  // Music file.
+  const std::string& music_id = preloader->get_music_id();
+  if (music_id != Music::none && music_id != Music::unchanged) {
+    std::string file_name;
+    Music::Format format;
+    Music::find_music_file(music_id, file_name, format);
+    if (!file_name.empty()) {
+      size_t size = FileTools::data_file_prefetch(file_name);
+      if (size > 0) {
+        prefetched_map.music_file_name = file_name;
+        prefetched_map.size += size;
+      }
+    }
+  }
+
+  return prefetched_map;
+}
+
+/**
+ * \brief Frees a map read in advance.
+ * \param prefetched_map The map to free.
+ */
+void MapPrefetcher::discard(PrefetchedMap& prefetched_map) {
+
+  delete prefetched_map.preloader;
+  prefetched_map.preloader = NULL;
+  if (!prefetched_map.music_file_name.empty()) {
+    FileTools::data_file_discard_prefetched(prefetched_map.music_file_name);
+  }
+}
+
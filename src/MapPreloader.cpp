@@ -0,0 +1,445 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "MapPreloader.h"
+#include "MapLoader.h"
+#include "entities/TilesetCache.h"
+#include "lowlevel/FileTools.h"
+#include "lowlevel/Music.h"
+#include "lowlevel/Debug.h"
+#include "lowlevel/StringConcat.h"
+#include "lua/LuaContext.h"
+#include <lua.hpp>
+
+SDL_SpinLock MapPreloader::compiled_maps_lock = 0;
+std::map<std::string, MapPreloader::CompiledMap> MapPreloader::compiled_maps;
+
+/**
+ * \brief Creates a preloader for a map.
+ * \param map_id Id of the map to read.
+ */
+MapPreloader::MapPreloader(const std::string& map_id):
+  map_id(map_id),
+  l(NULL),
+  tileset(NULL),
+  thread(NULL) {
+
+  SDL_AtomicSet(&finished, 0);
+}
+
+/**
+ * \brief Destructor.
+ *
+ * Waits for the background thread if it is still running.
+ */
+MapPreloader::~MapPreloader() {
+
+  wait();
+
+  TilesetCache::release_tileset(tileset);
+  if (l != NULL) {
+    lua_close(l);
+  }
+}
+
+/**
+ * \brief Starts loading the map data in a background thread.
+ *
+ * If the thread cannot be created, the data is loaded right now.
+ */
+void MapPreloader::start() {
+
+  Debug::check_assertion(thread == NULL && !is_finished(),
+      "This map is already being preloaded");
+
+  thread = SDL_CreateThread(thread_main, "solarus_map_preloader", this);
+  if (thread == NULL) {
+    Debug::warning(std::string("Failed to create the map preloader thread: ")
+        + SDL_GetError());
+    load();
+  }
+}
+
+/**
+ * \brief Function executed by the background thread.
+ * \param preloader The map preloader.
+ * \return 0.
+ */
+int MapPreloader::thread_main(void* preloader) {
+
+  static_cast<MapPreloader*>(preloader)->load();
+  return 0;
+}
+
+/**
+ * \brief Loads the map data in the current thread.
+ *
+ * Reads the map data file and the tileset.
+ * Stops the program if the map data file is invalid.
+ */
+void MapPreloader::load() {
+
+  if (!try_load()) {
+    Debug::die(error_message);
+  }
+}
+
+/**
+ * \brief Loads the map data in the current thread, without stopping the
+ * program in case of error.
+ *
+ * This is used to read maps in advance: the error will only be reported
+ * if the map is loaded normally later.
+ *
+ * \return false if the map data file is invalid or if its tileset does not
+ * exist (see get_error_message()).
+ */
+bool MapPreloader::try_load() {
+
+  bool success = load_data_file();
+
+  if (success) {
+    if (FileTools::data_file_exists(std::string("tilesets/") + tileset_id + ".dat")) {
+      tileset = TilesetCache::get_tileset(tileset_id);
+    }
+    else {
+      error_message = StringConcat() << "No such tileset: '" << tileset_id
+          << "' in map '" << map_id << "'";
+      success = false;
+    }
+  }
+
+  SDL_AtomicSet(&finished, 1);
+  return success;
+}
+
+/**
+ * \brief Returns why the map data could not be loaded.
+ * \return The error message of the last call to try_load(),
+ * or an empty string.
+ */
+const std::string& MapPreloader::get_error_message() const {
+  return error_message;
+}
+
+/**
+ * \brief Returns whether all data of the map is loaded.
+ * \return true if the map data is ready.
+ */
+bool MapPreloader::is_finished() {
+  return SDL_AtomicGet(&finished) == 1;
+}
+
+/**
+ * \brief Blocks until the background thread has loaded the map data.
+ *
+ * Does nothing if there is no background thread.
+ */
+void MapPreloader::wait() {
+
+  if (thread != NULL) {
+    SDL_WaitThread(thread, NULL);
+    thread = NULL;
+  }
+}
+
+/**
+ * \brief Reads and executes the map data file.
+ *
+ * The compiled chunk is kept in memory to avoid parsing the file again
+ * the next time this map is loaded, unless the file has changed.
+ * The properties table is stored in the registry as "properties" and the
+ * table of each entity in the registry table "entities".
+ *
+ * \return false in case of error (the message is stored in error_message).
+ */
+bool MapPreloader::load_data_file() {
+
+  // Open the map data file in an independent Lua world.
+  const std::string& file_name = std::string("maps/") + map_id + ".dat";
+  if (!FileTools::data_file_exists(file_name)) {
+    error_message = StringConcat() << "No such map data file: '"
+        << file_name << "'";
+    return false;
+  }
+  l = luaL_newstate();
+  const int64_t modification_time =
+      FileTools::data_file_get_modification_time(file_name);
+  int load_result;
+
+  bool compiled = false;
+  std::string bytecode;
+  SDL_AtomicLock(&compiled_maps_lock);
+  std::map<std::string, CompiledMap>::iterator it =
+      compiled_maps.find(map_id);
+  if (it != compiled_maps.end()
+      && modification_time != -1
+      && it->second.modification_time == modification_time) {
+    compiled = true;
+    bytecode = it->second.bytecode;
+  }
+  SDL_AtomicUnlock(&compiled_maps_lock);
+
+  if (compiled) {
+    load_result = luaL_loadbuffer(l, bytecode.data(), bytecode.size(),
+        file_name.c_str());
+  }
+  else {
+    size_t size;
+    char* buffer;
+    FileTools::data_file_open_buffer(file_name, &buffer, &size);
+    load_result = luaL_loadbuffer(l, buffer, size, file_name.c_str());
+    FileTools::data_file_close_buffer(buffer);
+
+    if (load_result == 0 && modification_time != -1) {
+      lua_dump(l, l_dump_chunk, &bytecode);
+      SDL_AtomicLock(&compiled_maps_lock);
+      CompiledMap& compiled_map = compiled_maps[map_id];
+      compiled_map.modification_time = modification_time;
+      compiled_map.bytecode = bytecode;
+      SDL_AtomicUnlock(&compiled_maps_lock);
+    }
+  }
+
+  if (load_result != 0) {
+    error_message = StringConcat() << "Failed to load map data file '"
+        << file_name << "': " << lua_tostring(l, -1);
+    lua_pop(l, 1);
+    return false;
+  }
+
+  // Record the declarations instead of executing them:
+  // entities can only be created by the main thread.
+  lua_pushlightuserdata(l, this);
+  lua_setfield(l, LUA_REGISTRYINDEX, "preloader");
+  lua_newtable(l);
+  lua_setfield(l, LUA_REGISTRYINDEX, "entities");
+  lua_register(l, "properties", l_properties);
+  for (int i = 0; MapLoader::entity_creation_functions[i].name != NULL; ++i) {
+    lua_pushinteger(l, i);
+    lua_pushcclosure(l, l_entity, 1);
+    lua_setglobal(l, MapLoader::entity_creation_functions[i].name);
+  }
+
+  // Execute the Lua code.
+  if (lua_pcall(l, 0, 0, 0) != 0) {
+    error_message = StringConcat() << "Failed to load map data file '"
+        << file_name << "': " << lua_tostring(l, -1);
+    lua_pop(l, 1);
+    return false;
+  }
+
+  if (tileset_id.empty()) {
+    error_message = StringConcat() <<
+        "Missing map properties in map data file '" << file_name << "'";
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * \brief Returns the Lua world where the map data file was executed.
+ *
+ * The map properties are stored in its registry as "properties" and
+ * the table of each entity in the registry table "entities".
+ * This Lua world must not be used before the data is loaded,
+ * and must be used by one thread at a time.
+ *
+ * \return The Lua state.
+ */
+lua_State* MapPreloader::get_lua_state() {
+  return l;
+}
+
+/**
+ * \brief Returns the id of the tileset declared by the map properties.
+ * \return The tileset id.
+ */
+const std::string& MapPreloader::get_tileset_id() const {
+  return tileset_id;
+}
+
+/**
+ * \brief Returns the id of the music declared by the map properties.
+ * \return The music id, possibly Music::none or Music::unchanged.
+ */
+const std::string& MapPreloader::get_music_id() const {
+  return music_id;
+}
+
+/**
+ * \brief Gives the loaded tileset to the caller.
+ * \return The tileset. The caller becomes the owner of the reference
+ * and has to release it with TilesetCache::release_tileset().
+ */
+Tileset* MapPreloader::release_tileset() {
+
+  Tileset* tileset = this->tileset;
+  this->tileset = NULL;
+  return tileset;
+}
+
+/**
+ * \brief Returns the memory used by the Lua world of the data file and by
+ * the tileset if it is not released yet.
+ * \return The estimated size in bytes.
+ */
+size_t MapPreloader::get_memory_size() {
+
+  size_t size = size_t(lua_gc(l, LUA_GCCOUNT, 0)) * 1024;
+  if (tileset != NULL) {
+    size += TilesetCache::get_size(*tileset);
+  }
+  return size;
+}
+
+/**
+ * \brief Returns the sprites that the entities of the map declare.
+ *
+ * These are the values of the "sprite" field of the entity declarations.
+ * Sprites that entities create from their scripts are not known.
+ *
+ * \param[out] sprite_ids The animation set ids found are added to this set.
+ */
+void MapPreloader::get_sprite_ids(std::set<std::string>& sprite_ids) {
+
+  lua_getfield(l, LUA_REGISTRYINDEX, "entities");
+  for (unsigned int i = 1; i <= entities.size(); ++i) {
+    lua_rawgeti(l, -1, i);
+    lua_getfield(l, -1, "sprite");
+    if (lua_type(l, -1) == LUA_TSTRING) {
+      sprite_ids.insert(lua_tostring(l, -1));
+    }
+    lua_pop(l, 2);
+  }
+  lua_pop(l, 1);
+}
+
+/**
+ * \brief Returns the number of entities declared in the map data file.
+ * \return The number of entities.
+ */
+int MapPreloader::get_nb_entities() const {
+  return int(entities.size());
+}
+
+/**
+ * \brief Returns the type of an entity declared in the map data file.
+ * \param index Index of the entity in the order of the data file.
+ * \return Index of its creation function in MapLoader.
+ */
+int MapPreloader::get_entity_type(int index) const {
+  return entities[index].type;
+}
+
+/**
+ * \brief Returns the position of an entity declaration in the map data file.
+ * \param index Index of the entity in the order of the data file.
+ * \return A string like "maps/foo.dat:12:", for error messages.
+ */
+const std::string& MapPreloader::get_entity_location(int index) const {
+  return entities[index].location;
+}
+
+/**
+ * \brief Returns the preloader stored in a Lua world.
+ * \param l The Lua state.
+ * \return The preloader that executes a data file in this Lua state.
+ */
+MapPreloader& MapPreloader::get_preloader(lua_State* l) {
+
+  lua_getfield(l, LUA_REGISTRYINDEX, "preloader");
+  MapPreloader* preloader = static_cast<MapPreloader*>(lua_touserdata(l, -1));
+  lua_pop(l, 1);
+
+  return *preloader;
+}
+
+/**
+ * \brief Implementation of the properties() function of the Lua map data file.
+ *
+ * Only the tileset and the music are read here.
+ * The properties table is kept for MapLoader.
+ *
+ * \param l The Lua state that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int MapPreloader::l_properties(lua_State* l) {
+
+  MapPreloader& preloader = get_preloader(l);
+
+  luaL_checktype(l, 1, LUA_TTABLE);
+  preloader.tileset_id = LuaContext::check_string_field(l, 1, "tileset");
+  preloader.music_id = LuaContext::opt_string_field(l, 1, "music", Music::none);
+
+  lua_settop(l, 1);
+  lua_setfield(l, LUA_REGISTRYINDEX, "properties");
+
+  return 0;
+}
+
+/**
+ * \brief Implementation of the entity creation functions of the Lua map
+ * data file.
+ *
+ * The table describing the entity is kept for MapLoader.
+ * The index of the corresponding creation function is the upvalue of this
+ * closure.
+ *
+ * \param l The Lua state that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int MapPreloader::l_entity(lua_State* l) {
+
+  MapPreloader& preloader = get_preloader(l);
+
+  luaL_checktype(l, 1, LUA_TTABLE);
+  if (preloader.tileset_id.empty()) {
+    luaL_error(l, "properties() must be called before declaring entities");
+  }
+
+  EntityDeclaration declaration;
+  declaration.type = int(lua_tointeger(l, lua_upvalueindex(1)));
+  luaL_where(l, 1);
+  declaration.location = lua_tostring(l, -1);
+  lua_pop(l, 1);
+  preloader.entities.push_back(declaration);
+
+  lua_getfield(l, LUA_REGISTRYINDEX, "entities");
+  lua_pushvalue(l, 1);
+  lua_rawseti(l, -2, int(preloader.entities.size()));
+  lua_pop(l, 1);
+
+  return 0;
+}
+
+/**
+ * \brief Writer function given to lua_dump() to save a compiled chunk.
+ * \param l The Lua state.
+ * \param data A piece of the compiled chunk.
+ * \param size Size of this piece in bytes.
+ * \param bytecode The string where the chunk is appended.
+ * \return 0 (success).
+ */
+int MapPreloader::l_dump_chunk(lua_State* l, const void* data, size_t size,
+    void* bytecode) {
+
+  static_cast<std::string*>(bytecode)->append(
+      static_cast<const char*>(data), size);
+  return 0;
+}
+
@@ -102,6 +102,44 @@ void AnimatedTilePattern::update() {
   }
 }
 
+/**
+ * \brief Returns the current value of the frame counter shared by all
+ * animated tile patterns.
+ *
+ * The frame of every animated tile pattern only depends on this counter.
+ *
+ * \return The frame counter (0 to 11).
+ */
+int AnimatedTilePattern::get_frame_counter() {
+  return frame_counter;
+}
+
+/**
+ * \brief Sets the frame counter shared by all animated tile patterns.
+ *
+ * This is used to pre-render animated tiles with a specific frame.
+ * The date of the next frame change is not modified.
+ *
+ * \param frame_counter The new frame counter (0 to 11).
+ */
+void AnimatedTilePattern::set_frame_counter(int frame_counter) {
+
+  AnimatedTilePattern::frame_counter = frame_counter;
+  current_frames[1] = frames[0][frame_counter];
+  current_frames[2] = frames[1][frame_counter];
+}
+
+/**
+ * \brief Returns the frame displayed by a sequence for a value of the
+ * frame counter.
+ * \param sequence An animation sequence type.
+ * \param frame_counter A frame counter value (0 to 11).
+ * \return The frame (0 to 2).
+ */
+int AnimatedTilePattern::get_frame(AnimationSequence sequence, int frame_counter) {
+  return frames[sequence - 1][frame_counter];
+}
+
 /**
  * \brief Draws the tile image on a surface.
  * \param dst_surface the surface to draw
@@ -143,3 +181,13 @@ bool AnimatedTilePattern::is_drawn_at_its_position() {
   return !parallax;
 }
 
+/**
+ * \brief Returns the sequence of frames that animates this tile pattern,
+ * if its appearance only depends on the current frame of animated tiles.
+ * \return The animation sequence, or 0 if the tile pattern also makes
+ * parallax scrolling.
+ */
+int AnimatedTilePattern::get_frame_sequence() {
+  return parallax ? 0 : sequence;
+}
+
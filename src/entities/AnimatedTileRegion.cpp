@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "entities/AnimatedTileRegion.h"
+#include "entities/AnimatedTilePattern.h"
+#include "entities/Tile.h"
+#include "lowlevel/Surface.h"
+#include "lowlevel/Color.h"
+#include "lowlevel/Debug.h"
+#include "Map.h"
+#include <algorithm>
+#include <map>
+
+/**
+ * \brief Creates an empty animated tile region.
+ * \param area Bounding box of the region in the map (must be aligned on
+ * the 8*8 grid).
+ */
+AnimatedTileRegion::AnimatedTileRegion(const Rectangle& area):
+  area(area),
+  squares((area.get_width() / 8) * (area.get_height() / 8), false) {
+
+  for (int i = 0; i < 12; ++i) {
+    frame_surface_indexes[i] = 0;
+  }
+}
+
+/**
+ * \brief Destructor.
+ */
+AnimatedTileRegion::~AnimatedTileRegion() {
+  clear_frame_surfaces();
+}
+
+/**
+ * \brief Returns the bounding box of this region.
+ * \return The bounding box of this region in the map.
+ */
+const Rectangle& AnimatedTileRegion::get_area() const {
+  return area;
+}
+
+/**
+ * \brief Marks an 8*8 square of the map as part of this region.
+ * \param x8 X coordinate of the square on the map grid.
+ * \param y8 Y coordinate of the square on the map grid.
+ */
+void AnimatedTileRegion::add_square(int x8, int y8) {
+
+  const int width8 = area.get_width() / 8;
+  const int i = y8 - area.get_y() / 8;
+  const int j = x8 - area.get_x() / 8;
+
+  Debug::check_assertion(i >= 0 && j >= 0
+      && j < width8 && i < area.get_height() / 8,
+      "Square outside of the animated tile region");
+
+  squares[i * width8 + j] = true;
+}
+
+/**
+ * \brief Adds a tile to this region.
+ *
+ * Tiles must be added in the order they are drawn.
+ *
+ * \param tile A tile that overlaps this region.
+ */
+void AnimatedTileRegion::add_tile(Tile& tile) {
+  tiles.push_back(&tile);
+}
+
+/**
+ * \brief Returns the tiles of this region.
+ * \return The tiles of this region in drawing order.
+ */
+const std::vector<Tile*>& AnimatedTileRegion::get_tiles() const {
+  return tiles;
+}
+
+/**
+ * \brief Pre-renders this region for each combination of frames.
+ *
+ * This function should be called again when the tileset changes.
+ *
+ * \param pixel_budget Number of pixels that can still be pre-rendered for
+ * the map. It is decreased by the size of the frames of this region in
+ * case of success.
+ * \return true in case of success, false if this region cannot be
+ * pre-rendered: its tiles should then be drawn individually.
+ */
+bool AnimatedTileRegion::build(int& pixel_budget) {
+
+  clear_frame_surfaces();
+
+  // Find which animation sequences the region depends on.
+  int sequences = 0;
+  std::vector<Tile*>::const_iterator it;
+  for (it = tiles.begin(); it != tiles.end(); ++it) {
+
+    TilePattern& pattern = (*it)->get_tile_pattern();
+    if (pattern.is_animated()) {
+      int sequence = pattern.get_frame_sequence();
+      if (sequence == 0) {
+        // This pattern also depends on the time or on the viewport.
+        return false;
+      }
+      sequences |= sequence;
+    }
+  }
+
+  // Several values of the frame counter give the same combination of frames.
+  std::map<int, int> combination_indexes;
+  for (int i = 0; i < 12; ++i) {
+
+    int combination = 0;
+    if (sequences & AnimatedTilePattern::ANIMATION_SEQUENCE_012) {
+      combination += AnimatedTilePattern::get_frame(
+          AnimatedTilePattern::ANIMATION_SEQUENCE_012, i);
+    }
+    if (sequences & AnimatedTilePattern::ANIMATION_SEQUENCE_0121) {
+      combination += 3 * AnimatedTilePattern::get_frame(
+          AnimatedTilePattern::ANIMATION_SEQUENCE_0121, i);
+    }
+
+    std::map<int, int>::iterator index_it = combination_indexes.find(combination);
+    if (index_it == combination_indexes.end()) {
+      int index = combination_indexes.size();
+      index_it = combination_indexes.insert(std::make_pair(combination, index)).first;
+    }
+    frame_surface_indexes[i] = index_it->second;
+  }
+
+  const int nb_frames = combination_indexes.size();
+  const int nb_pixels = area.get_width() * area.get_height() * nb_frames;
+  if (nb_pixels > pixel_budget) {
+    // The map already uses too much memory for its animated tiles.
+    return false;
+  }
+  pixel_budget -= nb_pixels;
+
+  // Draw the tiles with each combination.
+  const int frame_counter = AnimatedTilePattern::get_frame_counter();
+  frame_surfaces.resize(nb_frames, NULL);
+  const int width8 = area.get_width() / 8;
+  const int height8 = area.get_height() / 8;
+  for (int i = 0; i < 12; ++i) {
+
+    const int index = frame_surface_indexes[i];
+    if (frame_surfaces[index] != NULL) {
+      continue;
+    }
+
+    AnimatedTilePattern::set_frame_counter(i);
+    Surface* surface = new Surface(area.get_width(), area.get_height());
+    surface->set_transparency_color(Color::get_magenta());
+    surface->fill_with_color(Color::get_magenta());
+    for (it = tiles.begin(); it != tiles.end(); ++it) {
+      (*it)->draw(*surface, area);
+    }
+
+    // Erase the squares of the bounding box that belong to other regions
+    // or to non-animated tiles.
+    for (int y8 = 0; y8 < height8; ++y8) {
+      for (int x8 = 0; x8 < width8; ++x8) {
+        if (!squares[y8 * width8 + x8]) {
+          Rectangle square(x8 * 8, y8 * 8, 8, 8);
+          surface->fill_with_color(Color::get_magenta(), square);
+        }
+      }
+    }
+    frame_surfaces[index] = surface;
+  }
+  AnimatedTilePattern::set_frame_counter(frame_counter);
+
+  return true;
+}
+
+/**
+ * \brief Returns whether this region is pre-rendered.
+ * \return true if build() succeeded.
+ */
+bool AnimatedTileRegion::is_built() const {
+  return !frame_surfaces.empty();
+}
+
+/**
+ * \brief Draws the visible part of this pre-rendered region on the map.
+ * \param map The map.
+ */
+void AnimatedTileRegion::draw(Map& map) {
+
+  const Rectangle& camera_position = map.get_camera_position();
+  const int x1 = std::max(area.get_x(), camera_position.get_x());
+  const int y1 = std::max(area.get_y(), camera_position.get_y());
+  const int x2 = std::min(area.get_x() + area.get_width(),
+      camera_position.get_x() + camera_position.get_width());
+  const int y2 = std::min(area.get_y() + area.get_height(),
+      camera_position.get_y() + camera_position.get_height());
+
+  if (x1 >= x2 || y1 >= y2) {
+    // Not visible.
+    return;
+  }
+
+  Surface& surface = *frame_surfaces[
+      frame_surface_indexes[AnimatedTilePattern::get_frame_counter()]];
+  Rectangle src(x1 - area.get_x(), y1 - area.get_y(), x2 - x1, y2 - y1);
+  Rectangle dst(x1 - camera_position.get_x(), y1 - camera_position.get_y());
+  surface.draw_region(src, map.get_visible_surface(), dst);
+}
+
+/**
+ * \brief Destroys the pre-rendered frames of this region.
+ */
+void AnimatedTileRegion::clear_frame_surfaces() {
+
+  std::vector<Surface*>::const_iterator it;
+  for (it = frame_surfaces.begin(); it != frame_surfaces.end(); ++it) {
+    delete *it;
+  }
+  frame_surfaces.clear();
+}
+
@@ -447,6 +447,23 @@ void CarriedItem::draw_on_map() {
   }
 }
 
+/**
+ * \brief Returns a rectangle that contains everything this item may draw.
+ *
+ * When the item is thrown, its sprite is drawn above its shadow.
+ *
+ * \return The bounding box of what is drawn, in map coordinates.
+ */
+Rectangle CarriedItem::get_max_drawn_bounding_box() const {
+
+  Rectangle box = MapEntity::get_max_drawn_bounding_box();
+  if (is_throwing) {
+    box.add_y(-item_height);
+    box.add_height(item_height);
+  }
+  return box;
+}
+
 /**
  * \brief This function is called when this carried item collides an enemy.
  * \param enemy the enemy
@@ -80,6 +80,17 @@ void DynamicTile::set_map(Map &map) {
   this->tile_pattern = &map.get_tileset().get_tile_pattern(tile_pattern_id);
 }
 
+/**
+ * \brief Notifies this entity that the tileset of its map has changed.
+ *
+ * The tile pattern is taken from the new tileset object.
+ */
+void DynamicTile::notify_tileset_changed() {
+
+  MapEntity::notify_tileset_changed();
+  this->tile_pattern = &get_map().get_tileset().get_tile_pattern(tile_pattern_id);
+}
+
 /**
  * \brief Returns whether entities of this type can override the ground
  * of where they are placed.
@@ -878,6 +878,29 @@ void Enemy::draw_on_map() {
   get_lua_context().enemy_on_post_draw(*this);
 }
 
+/**
+ * \brief Returns a rectangle that contains everything this enemy may draw.
+ *
+ * If the script of the enemy draws things itself, it may draw anywhere:
+ * the enemy is then drawn as long as it is not too far from the camera.
+ *
+ * \return The bounding box of what is drawn, in map coordinates.
+ */
+Rectangle Enemy::get_max_drawn_bounding_box() const {
+
+  Rectangle box = Detector::get_max_drawn_bounding_box();
+  if (has_lua_field("on_pre_draw") || has_lua_field("on_post_draw")) {
+    int margin = get_optimization_distance();
+    if (margin <= 0) {
+      margin = get_map().get_width() + get_map().get_height();
+    }
+    box.add_xy(-margin, -margin);
+    box.add_width(2 * margin);
+    box.add_height(2 * margin);
+  }
+  return box;
+}
+
 /**
  * \brief Notifies this entity that it was just enabled or disabled.
  * \param enabled true if the entity is now enabled
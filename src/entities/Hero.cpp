@@ -459,6 +459,23 @@ void Hero::draw_on_map() {
   }
 }
 
+/**
+ * \brief Returns a rectangle that contains everything the hero may draw.
+ *
+ * The sprites of the hero are managed separately by HeroSprites,
+ * and its state may also draw the sword or a carried item above its head.
+ *
+ * \return The bounding box of what is drawn, in map coordinates.
+ */
+Rectangle Hero::get_max_drawn_bounding_box() const {
+
+  Rectangle box = MapEntity::get_max_drawn_bounding_box();
+  box.add_xy(-32, -32);
+  box.add_width(64);
+  box.add_height(64);
+  return box;
+}
+
 /**
  * \brief This function is called when a game command is pressed
  * and the game is not suspended.
@@ -876,11 +893,10 @@ bool Hero::is_on_raised_blocks() const {
  */
 Stairs* Hero::get_stairs_overlapping() {
 
-  std::list<Stairs*> all_stairs = get_entities().get_stairs(get_layer());
-  std::list<Stairs*>::iterator it;
-  for (it = all_stairs.begin(); it != all_stairs.end(); it++) {
+  const std::vector<Stairs*>& all_stairs = get_entities().get_stairs(get_layer());
+  for (unsigned int i = 0; i < all_stairs.size(); i++) {
 
-    Stairs* stairs = *it;
+    Stairs* stairs = all_stairs[i];
 
     if (overlaps(*stairs)) {
       return stairs;
@@ -301,6 +301,23 @@ void Hookshot::draw_on_map() {
   }
 }
 
+/**
+ * \brief Returns a rectangle that contains everything the hookshot may draw.
+ *
+ * The links are drawn between the hookshot and the hero, who is never
+ * farther than 120 pixels.
+ *
+ * \return The bounding box of what is drawn, in map coordinates.
+ */
+Rectangle Hookshot::get_max_drawn_bounding_box() const {
+
+  Rectangle box = MapEntity::get_max_drawn_bounding_box();
+  box.add_xy(-120, -120);
+  box.add_width(240);
+  box.add_height(240);
+  return box;
+}
+
 /**
  * \brief Returns whether the hookshot is currently flying.
  * \return true if the hookshot was shot, is not going back and has not reached any target yet
@@ -19,6 +19,8 @@
 #include "entities/Tile.h"
 #include "entities/Tileset.h"
 #include "entities/TilePattern.h"
+#include "entities/AnimatedTileRegion.h"
+#include "entities/NonAnimatedTileChunks.h"
 #include "entities/Layer.h"
 #include "entities/CrystalBlock.h"
 #include "entities/Boomerang.h"
@@ -32,8 +34,52 @@
 #include "lowlevel/Music.h"
 #include "lowlevel/Debug.h"
 #include "lowlevel/StringConcat.h"
+#include "lowlevel/Profiler.h"
+#include <algorithm>
+#include <set>
 using std::list;
 
+namespace {
+
+/**
+ * \brief Removes an element from an unordered vector of entities.
+ *
+ * The last element is moved to the place of the removed one, so the
+ * removal does not shift the rest of the vector.
+ * Nothing happens if the element is not in the vector.
+ *
+ * \param entities The vector to remove an element from.
+ * \param entity The element to remove.
+ */
+template<typename T>
+void swap_remove(std::vector<T>& entities, const T& entity) {
+
+  typename std::vector<T>::iterator it =
+      std::find(entities.begin(), entities.end(), entity);
+  if (it != entities.end()) {
+    *it = entities.back();
+    entities.pop_back();
+  }
+}
+
+/**
+ * \brief Removes an element from a vector of entities, keeping the order
+ * of the other ones.
+ * \param entities The vector to remove an element from.
+ * \param entity The element to remove.
+ */
+template<typename T>
+void ordered_remove(std::vector<T>& entities, const T& entity) {
+
+  typename std::vector<T>::iterator it =
+      std::find(entities.begin(), entities.end(), entity);
+  if (it != entities.end()) {
+    entities.erase(it);
+  }
+}
+
+}
+
 /**
  * \brief Constructor.
  * \param game the game
@@ -42,8 +88,12 @@ using std::list;
 MapEntities::MapEntities(Game& game, Map& map):
   game(game),
   map(map),
+  animated_tiles_pixel_budget(max_animated_tiles_pixels),
   hero(game.get_hero()),
+  last_creation_index(0),
+  walkability_grid(map),
   default_destination(NULL),
+  entities_grid(NULL),
   boomerang(NULL),
   music_before_miniboss(Music::none) {
 
@@ -52,9 +102,16 @@ MapEntities::MapEntities(Game& game, Map& map):
   this->entities_drawn_y_order[layer].push_back(&hero);
   this->named_entities[hero.get_name()] = &hero;
 
+  // update level of detail: disabled by default
+  for (int type = 0; type < ENTITY_NUMBER; type++) {
+    default_update_lod_margins[type] = 0;
+    default_update_lod_intervals[type] = 0;
+  }
+
   // surfaces to pre-render static tiles
   for (int layer = 0; layer < LAYER_NB; layer++) {
-    non_animated_tiles_surfaces[layer] = NULL;
+    non_animated_tiles[layer] = NULL;
+    ground_modifiers_grid[layer] = NULL;
   }
 }
 
@@ -83,27 +140,35 @@ void MapEntities::destroy_all_entities() {
     tiles[layer].clear();
     delete[] tiles_ground[layer];
     delete[] animated_tiles[layer];
-    delete non_animated_tiles_surfaces[layer];
+    delete non_animated_tiles[layer];
+    non_animated_tiles[layer] = NULL;
+    destroy_animated_tile_regions(layer);
 
     entities_drawn_first[layer].clear();
     entities_drawn_y_order[layer].clear();
     obstacle_entities[layer].clear();
     ground_observers[layer].clear();
     ground_modifiers[layer].clear();
+    delete ground_modifiers_grid[layer];
+    ground_modifiers_grid[layer] = NULL;
     stairs[layer].clear();
+    crystal_blocks[layer].clear();
   }
 
   // delete the other entities
-
-  list<MapEntity*>::iterator i;
-  for (i = all_entities.begin(); i != all_entities.end(); i++) {
-    destroy_entity(*i);
+  for (unsigned int i = 0; i < all_entities.size(); i++) {
+    destroy_entity(all_entities[i]);
   }
   all_entities.clear();
   named_entities.clear();
 
   detectors.clear();
   entities_to_remove.clear();
+
+  delete entities_grid;
+  entities_grid = NULL;
+
+  walkability_grid.invalidate();
 }
 
 /**
@@ -138,7 +203,7 @@ Hero& MapEntities::get_hero() {
  * \param layer The layer.
  * \return The obstacle entities on that layer.
  */
-const list<MapEntity*>& MapEntities::get_obstacle_entities(Layer layer) {
+const std::vector<MapEntity*>& MapEntities::get_obstacle_entities(Layer layer) {
   return obstacle_entities[layer];
 }
 
@@ -147,7 +212,7 @@ const list<MapEntity*>& MapEntities::get_obstacle_entities(Layer layer) {
  * \param layer The layer.
  * \return The ground observers on that layer.
  */
-const list<MapEntity*>& MapEntities::get_ground_observers(Layer layer) {
+const std::vector<MapEntity*>& MapEntities::get_ground_observers(Layer layer) {
   return ground_observers[layer];
 }
 
@@ -156,18 +221,99 @@ const list<MapEntity*>& MapEntities::get_ground_observers(Layer layer) {
  * \param layer The layer.
  * \return The ground observers on that layer.
  */
-const list<MapEntity*>& MapEntities::get_ground_modifiers(Layer layer) {
+const std::vector<MapEntity*>& MapEntities::get_ground_modifiers(Layer layer) {
   return ground_modifiers[layer];
 }
 
+/**
+ * \brief Returns the entities that may change the ground at a point.
+ *
+ * Only ground modifiers stored in the grid cell of the point are returned,
+ * in the same order as get_ground_modifiers(Layer).
+ * The caller still has to test the exact overlapping.
+ *
+ * \param layer The layer.
+ * \param x X coordinate of the point.
+ * \param y Y coordinate of the point.
+ * \return The ground modifiers near this point.
+ * This vector is only valid until the next call.
+ */
+const std::vector<MapEntity*>& MapEntities::get_ground_modifiers(
+    Layer layer, int x, int y) {
+
+  ground_modifiers_found.clear();
+  ground_modifiers_grid[layer]->get_elements(Rectangle(x, y, 1, 1), ground_modifiers_found);
+  return ground_modifiers_found;
+}
+
+/**
+ * \brief Returns the cache of terrain obstacles of the map.
+ * \return The walkability cache.
+ */
+const WalkabilityGrid& MapEntities::get_walkability_grid() const {
+  return walkability_grid;
+}
+
 /**
  * \brief Returns all detectors on the map.
  * \return the detectors
  */
-const list<Detector*>& MapEntities::get_detectors() {
+const std::vector<Detector*>& MapEntities::get_detectors() {
   return detectors;
 }
 
+/**
+ * \brief Returns the entities that may be obstacles in a rectangle.
+ *
+ * Only entities stored in the grid cells overlapped by the rectangle are
+ * returned, so this is much faster than get_obstacle_entities(Layer) on big
+ * maps. The caller still has to test the exact overlapping.
+ *
+ * \param layer The layer.
+ * \param where The rectangle to check.
+ * \param[out] obstacle_entities The obstacle entities on that layer near
+ * this rectangle are appended to this vector.
+ */
+void MapEntities::get_obstacle_entities(Layer layer, const Rectangle& where,
+    std::vector<MapEntity*>& obstacle_entities) {
+
+  entities_found.clear();
+  entities_grid->get_elements(where, entities_found);
+
+  // Only keep the obstacles of this layer.
+  std::vector<MapEntity*>::const_iterator it;
+  for (it = entities_found.begin(); it != entities_found.end(); ++it) {
+    MapEntity* entity = *it;
+    if (entity->can_be_obstacle()
+        && (entity->get_layer() == layer || entity->has_layer_independent_collisions())) {
+      obstacle_entities.push_back(entity);
+    }
+  }
+}
+
+/**
+ * \brief Returns the detectors that may collide with a rectangle.
+ *
+ * Only detectors stored in the grid cells overlapped by the rectangle are
+ * returned, in the same order as get_detectors().
+ *
+ * \param where The rectangle to check.
+ * \param[out] detectors The detectors found are appended to this vector.
+ */
+void MapEntities::get_detectors(const Rectangle& where, std::vector<Detector*>& detectors) {
+
+  entities_found.clear();
+  entities_grid->get_elements(where, entities_found);
+
+  std::vector<MapEntity*>::const_iterator it;
+  for (it = entities_found.begin(); it != entities_found.end(); ++it) {
+    MapEntity* entity = *it;
+    if (entity->is_detector()) {
+      detectors.push_back(static_cast<Detector*>(entity));
+    }
+  }
+}
+
 /**
  * \brief Returns the default destination of the map.
  * \return The default destination, or NULL if there exists no destination
@@ -182,7 +328,7 @@ Destination* MapEntities::get_default_destination() {
  * \param layer the layer
  * \return the stairs on this layer
  */
-const list<Stairs*>& MapEntities::get_stairs(Layer layer) {
+const std::vector<Stairs*>& MapEntities::get_stairs(Layer layer) {
   return stairs[layer];
 }
 
@@ -191,7 +337,7 @@ const list<Stairs*>& MapEntities::get_stairs(Layer layer) {
  * \param layer the layer
  * \return the crystal blocks on this layer
  */
-const list<CrystalBlock*>& MapEntities::get_crystal_blocks(Layer layer) {
+const std::vector<CrystalBlock*>& MapEntities::get_crystal_blocks(Layer layer) {
   return crystal_blocks[layer];
 }
 
@@ -264,8 +410,28 @@ MapEntity* MapEntities::find_entity(const std::string& name) {
   return entity;
 }
 
+/**
+ * \brief Returns whether an entity can be returned by prefix queries.
+ *
+ * Tiles and the hero are stored in the named entities but are not part
+ * of all_entities, so they are excluded.
+ *
+ * \param entity An entity.
+ * \return \c true if prefix queries can return this entity.
+ */
+bool MapEntities::is_in_prefix_query(const MapEntity& entity) const {
+
+  return !entity.is_being_removed()
+      && &entity != &hero
+      && entity.get_type() != ENTITY_TILE;
+}
+
 /**
  * \brief Returns the entities of the map having the specified name prefix.
+ *
+ * Named entities are sorted by name, so this costs O(log n + k)
+ * unless the prefix is empty (all entities are then returned).
+ *
  * \param prefix Prefix of the name.
  * \return The entities of this type and having this prefix in their name.
  */
@@ -273,11 +439,25 @@ list<MapEntity*> MapEntities::get_entities_with_prefix(const std::string& prefix
 
   list<MapEntity*> entities;
 
-  list<MapEntity*>::iterator i;
-  for (i = all_entities.begin(); i != all_entities.end(); i++) {
+  if (prefix.empty()) {
+    // Unnamed entities also match.
+    for (unsigned int i = 0; i < all_entities.size(); i++) {
 
-    MapEntity* entity = *i;
-    if (entity->has_prefix(prefix) && !entity->is_being_removed()) {
+      MapEntity* entity = all_entities[i];
+      if (!entity->is_being_removed()) {
+        entities.push_back(entity);
+      }
+    }
+    return entities;
+  }
+
+  std::map<std::string, MapEntity*>::const_iterator it;
+  for (it = named_entities.lower_bound(prefix);
+      it != named_entities.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+      ++it) {
+
+    MapEntity* entity = it->second;
+    if (is_in_prefix_query(*entity)) {
       entities.push_back(entity);
     }
   }
@@ -295,14 +475,15 @@ list<MapEntity*> MapEntities::get_entities_with_prefix(const std::string& prefix
 list<MapEntity*> MapEntities::get_entities_with_prefix(
     EntityType type, const std::string& prefix) {
 
-  list<MapEntity*> entities;
+  list<MapEntity*> entities = get_entities_with_prefix(prefix);
 
-  list<MapEntity*>::iterator i;
-  for (i = all_entities.begin(); i != all_entities.end(); i++) {
-
-    MapEntity* entity = *i;
-    if (entity->get_type() == type && entity->has_prefix(prefix) && !entity->is_being_removed()) {
-      entities.push_back(entity);
+  list<MapEntity*>::iterator i = entities.begin();
+  while (i != entities.end()) {
+    if ((*i)->get_type() != type) {
+      i = entities.erase(i);
+    }
+    else {
+      ++i;
     }
   }
 
@@ -317,16 +498,92 @@ list<MapEntity*> MapEntities::get_entities_with_prefix(
  */
 bool MapEntities::has_entity_with_prefix(const std::string& prefix) const {
 
-  list<MapEntity*>::const_iterator i;
-  for (i = all_entities.begin(); i != all_entities.end(); i++) {
+  if (prefix.empty()) {
+    // Unnamed entities also match.
+    return get_entities_count_with_prefix(prefix) > 0;
+  }
+
+  return get_next_entity_with_prefix(prefix, "") != NULL;
+}
+
+/**
+ * \brief Returns the number of entities having the specified name prefix.
+ * \param prefix Prefix of the name.
+ * \return The number of entities with this prefix.
+ */
+int MapEntities::get_entities_count_with_prefix(const std::string& prefix) const {
+
+  int count = 0;
 
-    const MapEntity* entity = *i;
-    if (entity->has_prefix(prefix) && !entity->is_being_removed()) {
-      return true;
+  if (prefix.empty()) {
+    for (unsigned int i = 0; i < all_entities.size(); i++) {
+      if (!all_entities[i]->is_being_removed()) {
+        ++count;
+      }
     }
+    return count;
   }
 
-  return false;
+  std::map<std::string, MapEntity*>::const_iterator it;
+  for (it = named_entities.lower_bound(prefix);
+      it != named_entities.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+      ++it) {
+    if (is_in_prefix_query(*it->second)) {
+      ++count;
+    }
+  }
+
+  return count;
+}
+
+/**
+ * \brief Returns the named entity that follows another one in the
+ * alphabetical order among the ones having the specified name prefix.
+ *
+ * This allows to iterate on a prefix without copying the entities,
+ * even if entities are created or removed between two calls.
+ * Entities without name are never returned.
+ *
+ * \param prefix Prefix of the name.
+ * \param previous_name Name of the previous entity of the iteration,
+ * or an empty string to get the first one.
+ * \param max_creation_index Entities added after this one are skipped
+ * (see get_last_creation_index()).
+ * \return The next entity with this prefix, or NULL if there is no more.
+ */
+MapEntity* MapEntities::get_next_entity_with_prefix(
+    const std::string& prefix, const std::string& previous_name,
+    uint32_t max_creation_index) const {
+
+  std::map<std::string, MapEntity*>::const_iterator it;
+  if (previous_name.empty()) {
+    it = named_entities.lower_bound(prefix);
+  }
+  else {
+    it = named_entities.upper_bound(previous_name);
+  }
+
+  for (; it != named_entities.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+      ++it) {
+    if (is_in_prefix_query(*it->second)
+        && it->second->get_creation_index() <= max_creation_index) {
+      return it->second;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * \brief Returns the creation index of the last entity added to the map.
+ *
+ * Remembering this value allows to iterate later on the entities that
+ * existed at that time only.
+ *
+ * \return The creation index of the last entity added.
+ */
+uint32_t MapEntities::get_last_creation_index() const {
+  return last_creation_index;
 }
 
 /**
@@ -351,14 +608,17 @@ void MapEntities::bring_to_front(MapEntity* entity) {
  */
 void MapEntities::notify_map_started() {
 
-  list<MapEntity*>::iterator i;
-  for (i = all_entities.begin(); i != all_entities.end(); i++) {
-    MapEntity* entity = *i;
+  for (unsigned int i = 0; i < all_entities.size(); i++) {
+    MapEntity* entity = all_entities[i];
     entity->notify_map_started();
     entity->notify_tileset_changed();
+
+    // Entities may have moved while the map was being loaded.
+    notify_entity_bounding_box_changed(*entity);
   }
   hero.notify_map_started();
   hero.notify_tileset_changed();
+  notify_entity_bounding_box_changed(hero);
 
   // pre-render non-animated tiles
   build_non_animated_tiles();
@@ -370,9 +630,8 @@ void MapEntities::notify_map_started() {
  */
 void MapEntities::notify_map_opening_transition_finished() {
 
-  list<MapEntity*>::iterator i;
-  for (i = all_entities.begin(); i != all_entities.end(); i++) {
-    MapEntity* entity = *i;
+  for (unsigned int i = 0; i < all_entities.size(); i++) {
+    MapEntity* entity = all_entities[i];
     entity->notify_map_opening_transition_finished();
   }
   hero.notify_map_opening_transition_finished();
@@ -384,15 +643,21 @@ void MapEntities::notify_map_opening_transition_finished() {
  */
 void MapEntities::notify_tileset_changed() {
 
+  // Tiles refer to the patterns of the previous tileset object.
+  for (int layer = 0; layer < LAYER_NB; layer++) {
+    for (unsigned int i = 0; i < tiles[layer].size(); i++) {
+      tiles[layer][i]->notify_tileset_changed();
+    }
+  }
+
   // Redraw optimized tiles (i.e. non animated ones).
   redraw_non_animated_tiles();
 
-  list<MapEntity*>::iterator i;
-  for (i = all_entities.begin(); i != all_entities.end(); i++) {
-    MapEntity* entity = *i;
+  for (unsigned int i = 0; i < all_entities.size(); i++) {
+    MapEntity* entity = all_entities[i];
     entity->notify_tileset_changed();
   }
-  hero.notify_map_opening_transition_finished();
+  hero.notify_tileset_changed();
 }
 
 /**
@@ -584,6 +849,11 @@ void MapEntities::add_entity(MapEntity* entity) {
       detectors.push_back(static_cast<Detector*>(entity));
     }
 
+    // update the collision grid
+    if (is_in_entities_grid(*entity)) {
+      entities_grid->add(entity, entity->get_bounding_box());
+    }
+
     // update the obstacle list
     if (entity->can_be_obstacle()) {
 
@@ -607,6 +877,8 @@ void MapEntities::add_entity(MapEntity* entity) {
     // update the ground modifiers list
     if (entity->is_ground_modifier()) {
       ground_modifiers[layer].push_back(entity);
+      ground_modifiers_grid[layer]->add(entity, entity->get_bounding_box());
+      walkability_grid.invalidate(layer, entity->get_bounding_box());
     }
 
     // update the sprites list
@@ -660,6 +932,7 @@ void MapEntities::add_entity(MapEntity* entity) {
         << "An entity with name '" << name << "' already exists.");
     named_entities[name] = entity;
   }
+  entity->set_creation_index(++last_creation_index);
   entity->increment_refcount();
 
   // notify the entity
@@ -727,39 +1000,46 @@ void MapEntities::remove_marked_entities() {
 
       if (entity->has_layer_independent_collisions()) {
         for (int i = 0; i < LAYER_NB; i++) {
-          obstacle_entities[i].remove(entity);
+          swap_remove(obstacle_entities[i], entity);
         }
       }
       else {
-        obstacle_entities[layer].remove(entity);
+        swap_remove(obstacle_entities[layer], entity);
       }
     }
 
     // remove it from the detectors list if present
     if (entity->is_detector()) {
-      detectors.remove(static_cast<Detector*>(entity));
+      // (keep the order: it is the order of collision checks)
+      ordered_remove(detectors, static_cast<Detector*>(entity));
     }
 
+    // remove it from the collision grid
+    entities_grid->remove(entity);
+
     // remove it from the ground obsevers list if present
     if (entity->is_ground_observer()) {
-      ground_observers[layer].remove(entity);
+      swap_remove(ground_observers[layer], entity);
     }
 
     // remove it from the ground modifiers list if present
     if (entity->is_ground_modifier()) {
-      ground_modifiers[layer].remove(entity);
+      ordered_remove(ground_modifiers[layer], entity);
+      ground_modifiers_grid[layer]->remove(entity);
+      walkability_grid.invalidate(layer, entity->get_bounding_box());
     }
 
     // remove it from the sprite entities list if present
     if (entity->is_drawn_in_y_order()) {
-      entities_drawn_y_order[layer].remove(entity);
+      std::vector<MapEntity*>& y_order = entities_drawn_y_order[layer];
+      y_order.erase(std::remove(y_order.begin(), y_order.end(), entity), y_order.end());
     }
     else if (entity->can_be_drawn()) {
       entities_drawn_first[layer].remove(entity);
     }
 
-    // remove it from the whole list
-    all_entities.remove(entity);
+    // remove it from the whole list, which gives the update order
+    ordered_remove(all_entities, entity);
     const std::string& name = entity->get_name();
     if (!name.empty()) {
       named_entities.erase(name);
@@ -769,11 +1049,11 @@ void MapEntities::remove_marked_entities() {
     switch (entity->get_type()) {
 
       case ENTITY_STAIRS:
-        stairs[layer].remove(static_cast<Stairs*>(entity));
+        swap_remove(stairs[layer], static_cast<Stairs*>(entity));
         break;
 
       case ENTITY_CRYSTAL_BLOCK:
-        crystal_blocks[layer].remove(static_cast<CrystalBlock*>(entity));
+        swap_remove(crystal_blocks[layer], static_cast<CrystalBlock*>(entity));
         break;
 
       case ENTITY_SEPARATOR:
@@ -799,6 +1079,8 @@ void MapEntities::remove_marked_entities() {
  *
  * This function is called by the map when the game
  * is being suspended or resumed.
+ * Entities suspended by their update level of detail are then no longer
+ * resumed by it: they follow the map (see MapEntity::check_update_lod()).
  *
  * \param suspended true to suspend the movement and the animations,
  * false to resume them
@@ -809,12 +1091,8 @@ void MapEntities::set_suspended(bool suspended) {
   hero.set_suspended(suspended);
 
   // other entities
-  list<MapEntity*>::iterator i;
-  for (i = all_entities.begin();
-       i != all_entities.end();
-       i++) {
-
-    (*i)->set_suspended(suspended);
+  for (unsigned int i = 0; i < all_entities.size(); i++) {
+    all_entities[i]->set_suspended(suspended);
   }
 
   // note that we don't suspend the tiles
@@ -825,25 +1103,25 @@ void MapEntities::set_suspended(bool suspended) {
  */
 void MapEntities::update() {
 
+  SOLARUS_PROFILE("MapEntities::update");
+
   Debug::check_assertion(map.is_started(), "The map is not started");
 
   // First update the hero.
   hero.update();
 
-  // Update the dynamic entities.
-  list<MapEntity*>::iterator it;
-  for (int layer = 0; layer < LAYER_NB; layer++) {
+  // Sort the entities drawn in y order.
+  sort_entities_drawn_y_order();
 
-    // Sort the entities drawn in y order.
-    entities_drawn_y_order[layer].sort(compare_y);
-  }
-
-  for (it = all_entities.begin();
-       it != all_entities.end();
-       it++) {
-
-    if (!(*it)->is_being_removed()) {
-      (*it)->update();
+  // Update the dynamic entities.
+  // Entities created during this loop are added at the end of the vector,
+  // so we use indexes: iterators would be invalidated.
+  for (unsigned int i = 0; i < all_entities.size(); i++) {
+
+    MapEntity* entity = all_entities[i];
+    if (!entity->is_being_removed()
+        && entity->check_update_lod()) {
+      entity->update();
     }
   }
 
@@ -852,26 +1130,53 @@ void MapEntities::update() {
 }
 
 /**
- * \brief Determines which rectangles are animated and draws all non-animated
- * rectangles of tiles on intermediate surfaces.
+ * \brief Returns the update level of detail of an entity type.
+ * \param type A type of entity.
+ * \param margin Receives the distance from the visible area beyond which
+ * entities of this type are updated less often (0 means never).
+ * \param interval Receives the delay between two updates beyond this
+ * distance (0 means no update).
+ */
+void MapEntities::get_default_update_lod(EntityType type,
+    int& margin, int& interval) const {
+
+  margin = default_update_lod_margins[type];
+  interval = default_update_lod_intervals[type];
+}
+
+/**
+ * \brief Sets the update level of detail of an entity type.
+ *
+ * This applies to the entities of this type that don't have their own
+ * setting (see MapEntity::set_update_lod()).
+ *
+ * \param type A type of entity.
+ * \param margin Distance from the visible area beyond which entities of
+ * this type are updated less often (0 to disable).
+ * \param interval Delay between two updates beyond this distance
+ * (0 to suspend the entities).
+ */
+void MapEntities::set_default_update_lod(EntityType type,
+    int margin, int interval) {
+
+  default_update_lod_margins[type] = margin;
+  default_update_lod_intervals[type] = interval;
+}
+
+/**
+ * \brief Determines which rectangles are animated and prepares the chunks
+ * where non-animated tiles will be rendered.
+ *
+ * Chunks are only rendered when they get close to the camera.
  */
 void MapEntities::build_non_animated_tiles() {
 
-  const Rectangle map_size(0, 0, map.get_width(), map.get_height());
+  animated_tiles_pixel_budget = max_animated_tiles_pixels;
   for (int layer = 0; layer < LAYER_NB; layer++) {
 
-    delete non_animated_tiles_surfaces[layer];
-    non_animated_tiles_surfaces[layer] = new Surface(map_size.get_width(), map_size.get_height());
-    non_animated_tiles_surfaces[layer]->set_transparency_color(Color::get_magenta());
-    non_animated_tiles_surfaces[layer]->fill_with_color(Color::get_magenta());
-
     for (unsigned int i = 0; i < tiles[layer].size(); i++) {
       Tile& tile = *tiles[layer][i];
-      if (!tile.is_animated()) {
-        // non-animated tile: optimize its displaying
-        tile.draw(*non_animated_tiles_surfaces[layer], map_size);
-      }
-      else {
+      if (tile.is_animated()) {
         // animated tile: mark its region as non-optimizable
         // (otherwise, a non-animated tile above an animated one would screw us)
 
@@ -894,63 +1199,61 @@ void MapEntities::build_non_animated_tiles() {
       }
     }
 
-    // erase the rectangles that contain animated tiles
-    int index = 0;
-    for (int y = 0; y < map.get_height(); y += 8) {
-      for (int x = 0; x < map.get_width(); x += 8) {
-
-        if (animated_tiles[layer][index]) {
-          Rectangle animated_square(x, y, 8, 8);
-          non_animated_tiles_surfaces[layer]->fill_with_color(Color::get_magenta(), animated_square);
-        }
-        index++;
-      }
-    }
+    // non-animated tiles: optimize their displaying
+    // (the rectangles that contain animated tiles are erased from the chunks)
+    add_non_animated_tiles_to_chunks(layer);
 
     // build the list of animated tiles and tiles overlapping them
+    tiles_in_animated_regions[layer].clear();
     for (unsigned int i = 0; i < tiles[layer].size(); i++) {
       Tile& tile = *tiles[layer][i];
       if (tile.is_animated() || overlaps_animated_tile(tile)) {
         tiles_in_animated_regions[layer].push_back(&tile);
       }
     }
+
+    // group them by region and pre-render each region
+    build_animated_tile_regions(layer);
+    build_animated_tile_frames(layer);
   }
 }
 
 /**
- * \brief Draws all non-animated rectangles of tiles on intermediate surfaces.
+ * \brief Prepares again the rendering of all tiles.
  *
  * This function is similar to build_non_animated_tiles() except that it
  * assumes that animated and non-animated rectangles were already determined.
+ * Chunks of non-animated tiles will be rendered again when they are needed.
  *
  * This function is called when the tileset changes.
  */
 void MapEntities::redraw_non_animated_tiles() {
 
-  const Rectangle map_size(0, 0, map.get_width(), map.get_height());
+  animated_tiles_pixel_budget = max_animated_tiles_pixels;
   for (int layer = 0; layer < LAYER_NB; layer++) {
 
-    non_animated_tiles_surfaces[layer]->fill_with_color(Color::get_magenta());
+    add_non_animated_tiles_to_chunks(layer);
 
-    for (unsigned int i = 0; i < tiles[layer].size(); i++) {
-      Tile& tile = *tiles[layer][i];
-      if (!tile.is_animated()) {
-        // Non-animated tile: optimize its displaying.
-        tile.draw(*non_animated_tiles_surfaces[layer], map_size);
-      }
-    }
+    // Pre-render animated regions again with the new tileset.
+    build_animated_tile_frames(layer);
+  }
+}
 
-    // Erase rectangles that contain animated tiles.
-    int index = 0;
-    for (int y = 0; y < map.get_height(); y += 8) {
-      for (int x = 0; x < map.get_width(); x += 8) {
+/**
+ * \brief Creates the chunks of a layer and puts its non-animated tiles
+ * in them.
+ * \param layer A layer.
+ */
+void MapEntities::add_non_animated_tiles_to_chunks(int layer) {
 
-        if (animated_tiles[layer][index]) {
-          Rectangle animated_square(x, y, 8, 8);
-          non_animated_tiles_surfaces[layer]->fill_with_color(Color::get_magenta(), animated_square);
-        }
-        index++;
-      }
+  delete non_animated_tiles[layer];
+  non_animated_tiles[layer] = new NonAnimatedTileChunks(
+      map.get_width(), map.get_height(), animated_tiles[layer]);
+
+  for (unsigned int i = 0; i < tiles[layer].size(); i++) {
+    Tile& tile = *tiles[layer][i];
+    if (!tile.is_animated()) {
+      non_animated_tiles[layer]->add_tile(tile);
     }
   }
 }
@@ -986,6 +1289,166 @@ bool MapEntities::overlaps_animated_tile(Tile& tile) {
   return false;
 }
 
+/**
+ * \brief Groups the animated squares of a layer into connected regions.
+ *
+ * Regions are also split on the boundaries of chunks of
+ * animated_tiles_chunk_size pixels, so that a large or sparse group of
+ * animated squares does not need to be pre-rendered as a whole rectangle.
+ *
+ * Each tile of tiles_in_animated_regions is added to the regions it
+ * overlaps.
+ *
+ * \param layer A layer.
+ */
+void MapEntities::build_animated_tile_regions(int layer) {
+
+  destroy_animated_tile_regions(layer);
+
+  // Find the connected groups of animated squares.
+  const bool* animated_tiles_layer = animated_tiles[layer];
+  std::vector<int> region_indexes(tiles_grid_size, -1);
+  std::vector<int> squares_to_visit;
+  std::vector<int> region_squares;
+  const int chunk_size8 = animated_tiles_chunk_size / 8;
+  for (int index = 0; index < tiles_grid_size; ++index) {
+
+    if (!animated_tiles_layer[index] || region_indexes[index] != -1) {
+      continue;
+    }
+
+    const int region_index = animated_tile_regions[layer].size();
+    const int chunk_x8 = (index % map_width8) / chunk_size8;
+    const int chunk_y8 = (index / map_width8) / chunk_size8;
+    int min_x8 = index % map_width8;
+    int max_x8 = min_x8;
+    int min_y8 = index / map_width8;
+    int max_y8 = min_y8;
+    region_squares.clear();
+    region_indexes[index] = region_index;
+    squares_to_visit.push_back(index);
+    while (!squares_to_visit.empty()) {
+
+      const int current = squares_to_visit.back();
+      squares_to_visit.pop_back();
+      region_squares.push_back(current);
+
+      const int x8 = current % map_width8;
+      const int y8 = current / map_width8;
+      min_x8 = std::min(min_x8, x8);
+      max_x8 = std::max(max_x8, x8);
+      min_y8 = std::min(min_y8, y8);
+      max_y8 = std::max(max_y8, y8);
+
+      // Stay in the same chunk.
+      const int neighbors[4] = {
+          (x8 > 0 && (x8 - 1) / chunk_size8 == chunk_x8) ? current - 1 : -1,
+          (x8 < map_width8 - 1 && (x8 + 1) / chunk_size8 == chunk_x8) ? current + 1 : -1,
+          (y8 > 0 && (y8 - 1) / chunk_size8 == chunk_y8) ? current - map_width8 : -1,
+          (y8 < map_height8 - 1 && (y8 + 1) / chunk_size8 == chunk_y8) ? current + map_width8 : -1
+      };
+      for (int i = 0; i < 4; ++i) {
+        const int neighbor = neighbors[i];
+        if (neighbor != -1
+            && animated_tiles_layer[neighbor]
+            && region_indexes[neighbor] == -1) {
+          region_indexes[neighbor] = region_index;
+          squares_to_visit.push_back(neighbor);
+        }
+      }
+    }
+
+    AnimatedTileRegion* region = new AnimatedTileRegion(Rectangle(
+        min_x8 * 8, min_y8 * 8,
+        (max_x8 - min_x8 + 1) * 8, (max_y8 - min_y8 + 1) * 8));
+    std::vector<int>::const_iterator it;
+    for (it = region_squares.begin(); it != region_squares.end(); ++it) {
+      region->add_square(*it % map_width8, *it / map_width8);
+    }
+    animated_tile_regions[layer].push_back(region);
+  }
+
+  // Add each tile to the regions it overlaps, keeping the drawing order.
+  std::vector<int> tile_regions;
+  for (unsigned int i = 0; i < tiles_in_animated_regions[layer].size(); i++) {
+
+    Tile& tile = *tiles_in_animated_regions[layer][i];
+    const int tile_x8 = tile.get_x() / 8;
+    const int tile_y8 = tile.get_y() / 8;
+    const int tile_width8 = tile.get_width() / 8;
+    const int tile_height8 = tile.get_height() / 8;
+
+    tile_regions.clear();
+    for (int y8 = tile_y8; y8 < tile_y8 + tile_height8; y8++) {
+      for (int x8 = tile_x8; x8 < tile_x8 + tile_width8; x8++) {
+
+        if (x8 >= 0 && x8 < map_width8 && y8 >= 0 && y8 < map_height8) {
+          const int region_index = region_indexes[y8 * map_width8 + x8];
+          if (region_index != -1
+              && std::find(tile_regions.begin(), tile_regions.end(), region_index) == tile_regions.end()) {
+            tile_regions.push_back(region_index);
+          }
+        }
+      }
+    }
+
+    std::vector<int>::const_iterator it;
+    for (it = tile_regions.begin(); it != tile_regions.end(); ++it) {
+      animated_tile_regions[layer][*it]->add_tile(tile);
+    }
+  }
+}
+
+/**
+ * \brief Pre-renders the animated regions of a layer for each frame.
+ *
+ * Regions are pre-rendered as long as animated_tiles_pixel_budget allows it.
+ * Tiles of regions that cannot be pre-rendered are put in
+ * tiles_drawn_individually.
+ *
+ * \param layer A layer.
+ */
+void MapEntities::build_animated_tile_frames(int layer) {
+
+  std::set<Tile*> tiles_not_prerendered;
+  std::vector<AnimatedTileRegion*>::const_iterator it;
+  for (it = animated_tile_regions[layer].begin();
+      it != animated_tile_regions[layer].end();
+      ++it) {
+
+    AnimatedTileRegion& region = *(*it);
+    if (!region.build(animated_tiles_pixel_budget)) {
+      const std::vector<Tile*>& region_tiles = region.get_tiles();
+      tiles_not_prerendered.insert(region_tiles.begin(), region_tiles.end());
+    }
+  }
+
+  // Keep the drawing order of tiles.
+  tiles_drawn_individually[layer].clear();
+  for (unsigned int i = 0; i < tiles_in_animated_regions[layer].size(); i++) {
+    Tile* tile = tiles_in_animated_regions[layer][i];
+    if (tiles_not_prerendered.find(tile) != tiles_not_prerendered.end()) {
+      tiles_drawn_individually[layer].push_back(tile);
+    }
+  }
+}
+
+/**
+ * \brief Destroys the animated regions of a layer.
+ * \param layer A layer.
+ */
+void MapEntities::destroy_animated_tile_regions(int layer) {
+
+  std::vector<AnimatedTileRegion*>::const_iterator it;
+  for (it = animated_tile_regions[layer].begin();
+      it != animated_tile_regions[layer].end();
+      ++it) {
+    delete *it;
+  }
+  animated_tile_regions[layer].clear();
+  tiles_drawn_individually[layer].clear();
+}
+
 /**
  * \brief Draws the entities on the map surface.
  */
@@ -997,14 +1460,26 @@ void MapEntities::draw() {
     // in other words, draw all regions containing animated tiles
     // (and maybe more, but we don't care because non-animated tiles
     // will be drawn later)
-    for (unsigned int i = 0; i < tiles_in_animated_regions[layer].size(); i++) {
-      tiles_in_animated_regions[layer][i]->draw_on_map();
+    const Rectangle& camera_position = map.get_camera_position();
+    for (unsigned int i = 0; i < tiles_drawn_individually[layer].size(); i++) {
+      Tile& tile = *tiles_drawn_individually[layer][i];
+      if (tile.overlaps(camera_position)) {
+        tile.draw_on_map();
+      }
+    }
+
+    // pre-rendered regions only need one blit of their visible part
+    for (unsigned int i = 0; i < animated_tile_regions[layer].size(); i++) {
+      AnimatedTileRegion& region = *animated_tile_regions[layer][i];
+      if (region.is_built()) {
+        region.draw(map);
+      }
     }
 
     // draw the non-animated tiles (with transparent rectangles on the regions of animated tiles
     // since they are already drawn)
-    non_animated_tiles_surfaces[layer]->draw_region(
-        map.get_camera_position(), map.get_visible_surface());
+    non_animated_tiles[layer]->draw(
+        map.get_visible_surface(), map.get_camera_position());
 
     // draw the first sprites
     list<MapEntity*>::iterator i;
@@ -1020,11 +1495,10 @@ void MapEntities::draw() {
 
     // draw the sprites at the hero's level, in the order
     // defined by their y position (including the hero)
-    for (i = entities_drawn_y_order[layer].begin();
-        i != entities_drawn_y_order[layer].end();
-        i++) {
+    const std::vector<MapEntity*>& y_order = entities_drawn_y_order[layer];
+    for (unsigned int j = 0; j < y_order.size(); j++) {
 
-      MapEntity* entity = *i;
+      MapEntity* entity = y_order[j];
       if (entity->is_enabled()) {
         entity->draw_on_map();
       }
@@ -1032,6 +1506,50 @@ void MapEntities::draw() {
   }
 }
 
+/**
+ * \brief Sorts the entities drawn in y order.
+ *
+ * Between two cycles, only a few entities change their y position, so the
+ * arrays are nearly sorted. An insertion sort only has to move these
+ * entities. The y coordinates are read once into a contiguous buffer.
+ * Like std::list::sort(), this keeps the order of entities with the same y.
+ */
+void MapEntities::sort_entities_drawn_y_order() {
+
+  SOLARUS_PROFILE("MapEntities::sort_entities_drawn_y_order");
+
+  for (int layer = 0; layer < LAYER_NB; layer++) {
+
+    std::vector<MapEntity*>& entities = entities_drawn_y_order[layer];
+    const int size = entities.size();
+
+    // Same criterion as compare_y(): the bottom of the bounding box.
+    y_order_keys.resize(size);
+    for (int i = 0; i < size; i++) {
+      const MapEntity& entity = *entities[i];
+      y_order_keys[i] = entity.get_top_left_y() + entity.get_height();
+    }
+
+    for (int i = 1; i < size; i++) {
+
+      const int key = y_order_keys[i];
+      if (key >= y_order_keys[i - 1]) {
+        continue;
+      }
+
+      MapEntity* entity = entities[i];
+      int j = i;
+      while (j > 0 && key < y_order_keys[j - 1]) {
+        y_order_keys[j] = y_order_keys[j - 1];
+        entities[j] = entities[j - 1];
+        j--;
+      }
+      y_order_keys[j] = key;
+      entities[j] = entity;
+    }
+  }
+}
+
 /**
  * \brief Compares the y position of two entities.
  * \param first an entity
@@ -1061,25 +1579,30 @@ void MapEntities::set_entity_layer(MapEntity& entity, Layer layer) {
 
     // update the obstacle list
     if (entity.can_be_obstacle() && !entity.has_layer_independent_collisions()) {
-      obstacle_entities[old_layer].remove(&entity);
+      swap_remove(obstacle_entities[old_layer], &entity);
       obstacle_entities[layer].push_back(&entity);
     }
 
     // update the ground observers list
     if (entity.is_ground_observer()) {
-      ground_observers[old_layer].remove(&entity);
+      swap_remove(ground_observers[old_layer], &entity);
       ground_observers[layer].push_back(&entity);
     }
 
     // update the ground modifiers list
     if (entity.is_ground_modifier()) {
-      ground_modifiers[old_layer].remove(&entity);
+      ordered_remove(ground_modifiers[old_layer], &entity);
       ground_modifiers[layer].push_back(&entity);
+      ground_modifiers_grid[old_layer]->remove(&entity);
+      ground_modifiers_grid[layer]->add(&entity, entity.get_bounding_box());
+      walkability_grid.invalidate(old_layer, entity.get_bounding_box());
+      walkability_grid.invalidate(layer, entity.get_bounding_box());
     }
 
     // update the sprites list
     if (entity.is_drawn_in_y_order()) {
-      entities_drawn_y_order[old_layer].remove(&entity);
+      std::vector<MapEntity*>& old_y_order = entities_drawn_y_order[old_layer];
+      old_y_order.erase(std::remove(old_y_order.begin(), old_y_order.end(), &entity), old_y_order.end());
       entities_drawn_y_order[layer].push_back(&entity);
     }
     else if (entity.can_be_drawn()) {
@@ -1092,6 +1615,98 @@ void MapEntities::set_entity_layer(MapEntity& entity, Layer layer) {
   }
 }
 
+/**
+ * \brief Returns whether an entity has to be stored in the collision grid.
+ *
+ * Only obstacles and detectors are stored because they are the only ones
+ * searched by location.
+ *
+ * \param entity An entity.
+ * \return \c true if this entity belongs to the collision grid.
+ */
+bool MapEntities::is_in_entities_grid(const MapEntity& entity) const {
+
+  return entity.can_be_obstacle() || entity.is_detector();
+}
+
+/**
+ * \brief Updates the location of an entity in the collision grids.
+ *
+ * This function is called by the entity when its bounding box has changed.
+ * Entities that are not in the grid are ignored.
+ *
+ * \param entity The entity whose bounding box has just changed.
+ */
+void MapEntities::notify_entity_bounding_box_changed(MapEntity& entity) {
+
+  if (entities_grid != NULL) {
+    entities_grid->move(&entity, entity.get_bounding_box());
+  }
+
+  const Layer layer = entity.get_layer();
+  Grid<MapEntity*>* grid = ground_modifiers_grid[layer];
+  if (grid != NULL && grid->has(&entity)) {
+    // The ground has changed under the old and the new position.
+    // The cells of the old position are the 8x8 squares it overlapped.
+    walkability_grid.invalidate(layer, grid->get_cells_area(&entity));
+    grid->move(&entity, entity.get_bounding_box());
+    walkability_grid.invalidate(layer, entity.get_bounding_box());
+  }
+}
+
+/**
+ * \brief Notifies this object that the ground defined by an entity may have
+ * changed.
+ *
+ * This happens for example when the entity is enabled, disabled or destroyed.
+ *
+ * \param ground_modifier An entity that modifies the ground.
+ */
+void MapEntities::notify_ground_modifier_changed(MapEntity& ground_modifier) {
+
+  walkability_grid.invalidate(ground_modifier.get_layer(),
+      ground_modifier.get_bounding_box());
+}
+
+/**
+ * \brief Returns the number of collision grid queries since the last reset.
+ * \return The number of queries.
+ */
+int MapEntities::get_num_grid_queries() const {
+
+  if (entities_grid == NULL) {
+    return 0;
+  }
+  return entities_grid->get_num_queries();
+}
+
+/**
+ * \brief Returns the number of candidates tested by collision grid queries
+ * since the last reset.
+ *
+ * Divide it by get_num_grid_queries() to get the number of candidates
+ * tested per query.
+ *
+ * \return The number of candidates.
+ */
+int MapEntities::get_num_grid_candidates() const {
+
+  if (entities_grid == NULL) {
+    return 0;
+  }
+  return entities_grid->get_num_candidates();
+}
+
+/**
+ * \brief Resets the collision grid statistics.
+ */
+void MapEntities::reset_grid_statistics() {
+
+  if (entities_grid != NULL) {
+    entities_grid->reset_statistics();
+  }
+}
+
 /**
  * \brief Returns whether a rectangle overlaps with a raised crystal block.
  * \param layer the layer to check
@@ -1101,11 +1716,10 @@ void MapEntities::set_entity_layer(MapEntity& entity, Layer layer) {
 bool MapEntities::overlaps_raised_blocks(Layer layer, const Rectangle& rectangle) {
 
   bool overlaps = false;
-  std::list<CrystalBlock*> blocks = get_crystal_blocks(layer);
+  const std::vector<CrystalBlock*>& blocks = get_crystal_blocks(layer);
 
-  std::list<CrystalBlock*>::iterator it;
-  for (it = blocks.begin(); it != blocks.end() && !overlaps; it++) {
-    overlaps = (*it)->overlaps(rectangle) && (*it)->is_raised();
+  for (unsigned int i = 0; i < blocks.size() && !overlaps; i++) {
+    overlaps = blocks[i]->overlaps(rectangle) && blocks[i]->is_raised();
   }
 
   return overlaps;
@@ -1136,9 +1750,8 @@ void MapEntities::remove_boomerang() {
 void MapEntities::remove_arrows() {
 
   // TODO this function may be slow if there are a lot of entities: store the arrows?
-  std::list<MapEntity*>::iterator it;
-  for (it = all_entities.begin(); it != all_entities.end(); it++) {
-    MapEntity* entity = *it;
+  for (unsigned int i = 0; i < all_entities.size(); i++) {
+    MapEntity* entity = all_entities[i];
     if (entity->get_type() == ENTITY_ARROW) {
       remove_entity(entity);
     }
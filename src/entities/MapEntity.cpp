@@ -32,6 +32,7 @@
 #include "Map.h"
 #include "Sprite.h"
 #include "SpriteAnimationSet.h"
+#include <algorithm>
 
 const Rectangle MapEntity::directions_to_xy_moves[] = {
   Rectangle( 1, 0),
@@ -114,7 +115,12 @@ MapEntity::MapEntity(
   suspended(false),
   when_suspended(0),
   optimization_distance(default_optimization_distance),
-  optimization_distance2(default_optimization_distance * default_optimization_distance) {
+  optimization_distance2(default_optimization_distance * default_optimization_distance),
+  update_lod_margin(-1),
+  update_lod_interval(0),
+  next_lod_update_date(0),
+  lod_suspended(false),
+  creation_index(0) {
 
 }
 
@@ -222,12 +228,13 @@ void MapEntity::update_ground_observers() {
     return;
   }
 
+  get_entities().notify_ground_modifier_changed(*this);
+
   // Update overlapping entities sensible to their ground.
-  std::list<MapEntity*>::const_iterator it;
-  const std::list<MapEntity*>& ground_observers =
+  const std::vector<MapEntity*>& ground_observers =
       get_entities().get_ground_observers(get_layer());
-  for (it = ground_observers.begin(); it != ground_observers.end(); ++it) {
-    MapEntity& ground_observer = *(*it);
+  for (unsigned int i = 0; i < ground_observers.size(); i++) {
+    MapEntity& ground_observer = *ground_observers[i];
     if (overlaps(ground_observer.get_ground_point())) {
       ground_observer.update_ground_below();
     }
@@ -334,6 +341,7 @@ void MapEntity::set_map(Map& map) {
   }
 
   this->ground_below = GROUND_EMPTY;
+  notify_bounding_box_changed();
 }
 
 /**
@@ -368,6 +376,25 @@ void MapEntity::notify_tileset_changed() {
   }
 }
 
+/**
+ * \brief Returns the order in which this entity was added to its map.
+ * \return The creation index of this entity (0 for the hero).
+ */
+uint32_t MapEntity::get_creation_index() const {
+  return creation_index;
+}
+
+/**
+ * \brief Sets the order in which this entity was added to its map.
+ *
+ * This function is called by class MapEntities when adding the entity.
+ *
+ * \param creation_index The creation index of this entity.
+ */
+void MapEntity::set_creation_index(uint32_t creation_index) {
+  this->creation_index = creation_index;
+}
+
 /**
  * \brief Returns the map where this entity is.
  * \return the map
@@ -602,6 +629,7 @@ int MapEntity::get_y() const {
  */
 void MapEntity::set_x(int x) {
   bounding_box.set_x(x - origin.get_x());
+  notify_bounding_box_changed();
 }
 
 /**
@@ -613,6 +641,7 @@ void MapEntity::set_x(int x) {
  */
 void MapEntity::set_y(int y) {
   bounding_box.set_y(y - origin.get_y());
+  notify_bounding_box_changed();
 }
 
 /**
@@ -635,8 +664,8 @@ const Rectangle MapEntity::get_xy() const {
  * \param y the new y coordinate of the entity on the map
  */
 void MapEntity::set_xy(int x, int y) {
-  set_x(x);
-  set_y(y);
+  bounding_box.set_xy(x - origin.get_x(), y - origin.get_y());
+  notify_bounding_box_changed();
 }
 
 /**
@@ -672,6 +701,7 @@ int MapEntity::get_top_left_y() const {
  */
 void MapEntity::set_top_left_x(int x) {
   bounding_box.set_x(x);
+  notify_bounding_box_changed();
 }
 
 /**
@@ -680,6 +710,7 @@ void MapEntity::set_top_left_x(int x) {
  */
 void MapEntity::set_top_left_y(int y) {
   bounding_box.set_y(y);
+  notify_bounding_box_changed();
 }
 
 /**
@@ -691,8 +722,8 @@ void MapEntity::set_top_left_y(int y) {
  * \param y y position of the entity
  */
 void MapEntity::set_top_left_xy(int x, int y) {
-  set_top_left_x(x);
-  set_top_left_y(y);
+  bounding_box.set_xy(x, y);
+  notify_bounding_box_changed();
 }
 
 /**
@@ -745,6 +776,7 @@ const Rectangle& MapEntity::get_size() const {
  */
 void MapEntity::set_size(int width, int height) {
   bounding_box.set_size(width, height);
+  notify_bounding_box_changed();
 }
 
 /**
@@ -753,6 +785,7 @@ void MapEntity::set_size(int width, int height) {
  */
 void MapEntity::set_size(const Rectangle &size) {
   bounding_box.set_size(size);
+  notify_bounding_box_changed();
 }
 
 /**
@@ -777,6 +810,20 @@ const Rectangle& MapEntity::get_bounding_box() const {
  */
 void MapEntity::set_bounding_box(const Rectangle &bounding_box) {
   this->bounding_box = bounding_box;
+  notify_bounding_box_changed();
+}
+
+/**
+ * \brief Notifies the map that the bounding box of this entity has changed.
+ *
+ * This keeps the map's collision grid up to date.
+ * This function is called after any change of position or size.
+ */
+void MapEntity::notify_bounding_box_changed() {
+
+  if (is_on_map() && map->is_loaded()) {
+    get_entities().notify_entity_bounding_box_changed(*this);
+  }
 }
 
 /**
@@ -974,6 +1021,7 @@ void MapEntity::set_origin(int x, int y) {
 
   bounding_box.add_xy(origin.get_x() - x, origin.get_y() - y);
   origin.set_xy(x, y);
+  notify_bounding_box_changed();
 }
 
 /**
@@ -1016,6 +1064,96 @@ void MapEntity::set_optimization_distance(int distance) {
   this->optimization_distance2 = distance * distance;
 }
 
+/**
+ * \brief Returns the distance beyond which this entity is updated less often.
+ * \return The distance from the visible area in pixels (0 means that the
+ * entity is always updated, -1 means that the default value of its type
+ * is used).
+ */
+int MapEntity::get_update_lod_margin() const {
+  return update_lod_margin;
+}
+
+/**
+ * \brief Returns the delay between two updates of this entity when it is
+ * far from the visible area.
+ * \return The delay in milliseconds (0 means no update at all).
+ */
+int MapEntity::get_update_lod_interval() const {
+  return update_lod_interval;
+}
+
+/**
+ * \brief Sets the update level of detail of this entity.
+ *
+ * When the entity is farther than a margin from the visible area,
+ * it is only updated from time to time, or not at all.
+ * This is disabled by default.
+ *
+ * \param margin The distance from the visible area in pixels (0 to always
+ * update the entity, -1 to use the default value of its type, see
+ * MapEntities::set_default_update_lod()).
+ * \param interval The delay between two updates beyond this margin in
+ * milliseconds (0 to suspend the entity).
+ */
+void MapEntity::set_update_lod(int margin, int interval) {
+  this->update_lod_margin = margin;
+  this->update_lod_interval = interval;
+}
+
+/**
+ * \brief Applies the update level of detail of this entity.
+ *
+ * This function is called by the map before each update of the entity.
+ * When the entity is far from the visible area, it is only updated
+ * every update_lod_interval milliseconds. If the interval is zero, it is
+ * suspended instead until it gets closer: suspending it (rather than only
+ * skipping its updates) makes its movement and sprites resume normally.
+ * An entity that was suspended for another reason (like the whole map
+ * being suspended) is not resumed here.
+ *
+ * \return true if update() should be called during this cycle.
+ */
+bool MapEntity::check_update_lod() {
+
+  int margin = update_lod_margin;
+  int interval = update_lod_interval;
+  if (margin < 0) {
+    get_entities().get_default_update_lod(get_type(), margin, interval);
+  }
+
+  bool close = margin <= 0 || !is_drawn_at_its_position();
+  if (!close) {
+    Rectangle close_area = get_map().get_camera_position();
+    close_area.add_xy(-margin, -margin);
+    close_area.add_width(2 * margin);
+    close_area.add_height(2 * margin);
+    close = bounding_box.overlaps(close_area);
+  }
+
+  if (close) {
+    if (lod_suspended) {
+      set_suspended(false);
+    }
+    return true;
+  }
+
+  if (interval <= 0) {
+    if (!is_suspended()) {
+      set_suspended(true);
+      lod_suspended = true;
+    }
+    return false;
+  }
+
+  uint32_t now = System::now();
+  if (now < next_lod_update_date) {
+    return false;
+  }
+  next_lod_update_date = now + interval;
+  return true;
+}
+
 /**
  * \brief Returns whether the entity has at least one sprite.
  * \return true if the entity has at least one sprite.
@@ -1752,6 +1890,42 @@ bool MapEntity::overlaps_camera() const {
   return found;
 }
 
+/**
+ * \brief Returns a rectangle that contains everything this entity may draw.
+ *
+ * The size of the current frame of a sprite may change at any time,
+ * so the biggest frame of each sprite is used. Since a frame always
+ * contains its origin, a sprite never draws farther than the size of its
+ * biggest frame from its position.
+ * Subclasses that draw more than their sprites should redefine this
+ * function.
+ *
+ * \return The bounding box of what is drawn, in map coordinates.
+ */
+Rectangle MapEntity::get_max_drawn_bounding_box() const {
+
+  int x1 = bounding_box.get_x();
+  int y1 = bounding_box.get_y();
+  int x2 = x1 + bounding_box.get_width();
+  int y2 = y1 + bounding_box.get_height();
+
+  const Rectangle& displayed_xy = get_displayed_xy();
+  std::vector<Sprite*>::const_iterator it;
+  for (it = sprites.begin(); it != sprites.end(); ++it) {
+    const Sprite& sprite = *(*it);
+    const Rectangle& max_size = sprite.get_max_size();
+    const int x = displayed_xy.get_x() + sprite.get_xy().get_x();
+    const int y = displayed_xy.get_y() + sprite.get_xy().get_y();
+    x1 = std::min(x1, x - max_size.get_width());
+    y1 = std::min(y1, y - max_size.get_height());
+    x2 = std::max(x2, x + max_size.get_width());
+    y2 = std::max(y2, y + max_size.get_height());
+  }
+
+  return Rectangle(x1 - drawn_margin, y1 - drawn_margin,
+      x2 - x1 + 2 * drawn_margin, y2 - y1 + 2 * drawn_margin);
+}
+
 /**
  * \brief Returns whether or not this entity's origin point is in
  * the specified rectangle.
@@ -2107,6 +2281,9 @@ void MapEntity::set_suspended(bool suspended) {
 
   this->suspended = suspended;
 
+  // the level of detail no longer decides when to resume the entity
+  lod_suspended = false;
+
   // remember the date if the entity is being suspended
   if (suspended) {
     when_suspended = System::now();
@@ -2237,9 +2414,8 @@ void MapEntity::update() {
 bool MapEntity::is_drawn() const {
 
   return is_visible()
-      && (overlaps_camera()
-          || get_distance_to_camera2() < optimization_distance2
-          || !is_drawn_at_its_position()
+      && (!is_drawn_at_its_position()
+          || get_max_drawn_bounding_box().overlaps(get_map().get_camera_position())
       );
 }
 
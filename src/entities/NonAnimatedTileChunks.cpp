@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "entities/NonAnimatedTileChunks.h"
+#include "entities/Tile.h"
+#include "lowlevel/Surface.h"
+#include "lowlevel/Color.h"
+#include <algorithm>
+
+/**
+ * \brief Creates the chunks of a layer, without building them.
+ * \param map_width Width of the map in pixels.
+ * \param map_height Height of the map in pixels.
+ * \param animated_squares Array that tells which 8*8 squares of the map
+ * contain animated tiles. It must live as long as this object.
+ */
+NonAnimatedTileChunks::NonAnimatedTileChunks(int map_width, int map_height,
+    const bool* animated_squares):
+  map_width(map_width),
+  map_height(map_height),
+  animated_squares(animated_squares),
+  nb_columns((map_width + chunk_size - 1) / chunk_size),
+  nb_rows((map_height + chunk_size - 1) / chunk_size),
+  chunks(nb_columns * nb_rows),
+  nb_chunks_built(0),
+  draw_index(0) {
+
+  std::vector<Chunk>::iterator it;
+  for (it = chunks.begin(); it != chunks.end(); ++it) {
+    it->surface = NULL;
+    it->last_draw_index = 0;
+  }
+}
+
+/**
+ * \brief Destructor.
+ */
+NonAnimatedTileChunks::~NonAnimatedTileChunks() {
+  clear();
+}
+
+/**
+ * \brief Adds a non-animated tile to the chunks it overlaps.
+ *
+ * Tiles must be added in the order they are drawn, before the first call
+ * to draw().
+ *
+ * \param tile A non-animated tile.
+ */
+void NonAnimatedTileChunks::add_tile(Tile& tile) {
+
+  int first_column, first_row, last_column, last_row;
+  get_chunks_in_rectangle(tile.get_bounding_box(),
+      first_column, first_row, last_column, last_row);
+
+  for (int row = first_row; row <= last_row; ++row) {
+    for (int column = first_column; column <= last_column; ++column) {
+      chunks[row * nb_columns + column].tiles.push_back(&tile);
+    }
+  }
+}
+
+/**
+ * \brief Destroys all chunks that were built.
+ *
+ * They will be built again when they are needed.
+ * This function is called when the tileset changes.
+ */
+void NonAnimatedTileChunks::clear() {
+
+  std::vector<Chunk>::iterator it;
+  for (it = chunks.begin(); it != chunks.end(); ++it) {
+    delete it->surface;
+    it->surface = NULL;
+  }
+  nb_chunks_built = 0;
+}
+
+/**
+ * \brief Draws the part of the layer that is visible in the camera.
+ *
+ * Visible chunks that are not built yet are built now.
+ * In addition, one chunk close to the camera is built in advance if needed.
+ *
+ * \param dst_surface The surface where to draw (the visible part of the map).
+ * \param camera_position The visible rectangle of the map.
+ */
+void NonAnimatedTileChunks::draw(Surface& dst_surface,
+    const Rectangle& camera_position) {
+
+  ++draw_index;
+
+  int first_column, first_row, last_column, last_row;
+  get_chunks_in_rectangle(camera_position,
+      first_column, first_row, last_column, last_row);
+
+  for (int row = first_row; row <= last_row; ++row) {
+    for (int column = first_column; column <= last_column; ++column) {
+
+      Chunk& chunk = chunks[row * nb_columns + column];
+      if (chunk.surface == NULL) {
+        build_chunk(column, row);
+      }
+      chunk.last_draw_index = draw_index;
+
+      // Only draw the intersection of the chunk and the camera.
+      const int chunk_x = column * chunk_size;
+      const int chunk_y = row * chunk_size;
+      const int x1 = std::max(chunk_x, camera_position.get_x());
+      const int y1 = std::max(chunk_y, camera_position.get_y());
+      const int x2 = std::min(chunk_x + chunk.surface->get_width(),
+          camera_position.get_x() + camera_position.get_width());
+      const int y2 = std::min(chunk_y + chunk.surface->get_height(),
+          camera_position.get_y() + camera_position.get_height());
+      if (x1 < x2 && y1 < y2) {
+        Rectangle src(x1 - chunk_x, y1 - chunk_y, x2 - x1, y2 - y1);
+        Rectangle dst(x1 - camera_position.get_x(), y1 - camera_position.get_y());
+        chunk.surface->draw_region(src, dst_surface, dst);
+      }
+    }
+  }
+
+  // Prepare one chunk that may become visible soon.
+  Rectangle close_area(camera_position);
+  close_area.add_xy(-prefetch_margin, -prefetch_margin);
+  close_area.add_width(2 * prefetch_margin);
+  close_area.add_height(2 * prefetch_margin);
+  get_chunks_in_rectangle(close_area,
+      first_column, first_row, last_column, last_row);
+
+  bool prefetched = false;
+  for (int row = first_row; row <= last_row && !prefetched; ++row) {
+    for (int column = first_column; column <= last_column && !prefetched; ++column) {
+
+      Chunk& chunk = chunks[row * nb_columns + column];
+      if (chunk.surface == NULL) {
+        build_chunk(column, row);
+        chunk.last_draw_index = draw_index;
+        prefetched = true;
+      }
+    }
+  }
+
+  destroy_old_chunks();
+}
+
+/**
+ * \brief Returns the range of chunks that overlap a rectangle of the map.
+ *
+ * The rectangle is clipped to the map.
+ *
+ * \param where A rectangle in map coordinates.
+ * \param first_column Receives the first column of chunks.
+ * \param first_row Receives the first row of chunks.
+ * \param last_column Receives the last column of chunks (inclusive).
+ * If no chunk overlaps the rectangle, last_column is less than first_column.
+ * \param last_row Receives the last row of chunks (inclusive).
+ * If no chunk overlaps the rectangle, last_row is less than first_row.
+ */
+void NonAnimatedTileChunks::get_chunks_in_rectangle(const Rectangle& where,
+    int& first_column, int& first_row, int& last_column, int& last_row) const {
+
+  const int x1 = std::max(where.get_x(), 0);
+  const int y1 = std::max(where.get_y(), 0);
+  const int x2 = std::min(where.get_x() + where.get_width(), map_width) - 1;
+  const int y2 = std::min(where.get_y() + where.get_height(), map_height) - 1;
+
+  first_column = x1 / chunk_size;
+  first_row = y1 / chunk_size;
+  last_column = (x2 < x1) ? first_column - 1 : x2 / chunk_size;
+  last_row = (y2 < y1) ? first_row - 1 : y2 / chunk_size;
+}
+
+/**
+ * \brief Renders the tiles of a chunk on a new surface.
+ * \param column Column of the chunk.
+ * \param row Row of the chunk.
+ */
+void NonAnimatedTileChunks::build_chunk(int column, int row) {
+
+  Chunk& chunk = chunks[row * nb_columns + column];
+  const Rectangle chunk_area(column * chunk_size, row * chunk_size,
+      std::min(chunk_size, map_width - column * chunk_size),
+      std::min(chunk_size, map_height - row * chunk_size));
+
+  Surface* surface = new Surface(chunk_area.get_width(), chunk_area.get_height());
+  surface->set_transparency_color(Color::get_magenta());
+  surface->fill_with_color(Color::get_magenta());
+
+  std::vector<Tile*>::const_iterator it;
+  for (it = chunk.tiles.begin(); it != chunk.tiles.end(); ++it) {
+    (*it)->draw(*surface, chunk_area);
+  }
+
+  // Erase the squares that contain animated tiles.
+  const int map_width8 = map_width / 8;
+  const int x8_start = chunk_area.get_x() / 8;
+  const int y8_start = chunk_area.get_y() / 8;
+  const int x8_end = x8_start + chunk_area.get_width() / 8;
+  const int y8_end = y8_start + chunk_area.get_height() / 8;
+  for (int y8 = y8_start; y8 < y8_end; ++y8) {
+    for (int x8 = x8_start; x8 < x8_end; ++x8) {
+      if (animated_squares[y8 * map_width8 + x8]) {
+        Rectangle animated_square(x8 * 8 - chunk_area.get_x(),
+            y8 * 8 - chunk_area.get_y(), 8, 8);
+        surface->fill_with_color(Color::get_magenta(), animated_square);
+      }
+    }
+  }
+
+  chunk.surface = surface;
+  ++nb_chunks_built;
+}
+
+/**
+ * \brief Destroys the least recently drawn chunks while there are too many.
+ *
+ * Chunks drawn during the current call to draw() are never destroyed.
+ */
+void NonAnimatedTileChunks::destroy_old_chunks() {
+
+  while (nb_chunks_built > max_chunks) {
+
+    Chunk* oldest_chunk = NULL;
+    std::vector<Chunk>::iterator it;
+    for (it = chunks.begin(); it != chunks.end(); ++it) {
+      if (it->surface != NULL
+          && it->last_draw_index != draw_index
+          && (oldest_chunk == NULL || it->last_draw_index < oldest_chunk->last_draw_index)) {
+        oldest_chunk = &(*it);
+      }
+    }
+
+    if (oldest_chunk == NULL) {
+      // All chunks are in use.
+      return;
+    }
+
+    delete oldest_chunk->surface;
+    oldest_chunk->surface = NULL;
+    --nb_chunks_built;
+  }
+}
+
@@ -507,6 +507,23 @@ void Pickable::draw_on_map() {
   MapEntity::draw_on_map();
 }
 
+/**
+ * \brief Returns a rectangle that contains everything this pickable item
+ * may draw.
+ *
+ * The shadow stays on the ground while the item is falling.
+ *
+ * \return The bounding box of what is drawn, in map coordinates.
+ */
+Rectangle Pickable::get_max_drawn_bounding_box() const {
+
+  Rectangle box = MapEntity::get_max_drawn_bounding_box();
+  if (shadow_sprite != NULL && shadow_xy.get_y() > get_y()) {
+    box.add_height(shadow_xy.get_y() - get_y());
+  }
+  return box;
+}
+
 /**
  * \brief Returns the name identifying this type in Lua.
  * \return The name identifying this type in Lua.
@@ -119,6 +119,32 @@ EntityType Teletransporter::get_type() const {
   return ENTITY_TELETRANSPORTER;
 }
 
+/**
+ * \brief Returns the id of the map where this teletransporter leads.
+ * \return The destination map id.
+ */
+const std::string& Teletransporter::get_destination_map_id() const {
+  return destination_map_id;
+}
+
+/**
+ * \brief Updates this teletransporter.
+ *
+ * Collisions are only tested with entities that are close to the
+ * teletransporter, so this function makes sure that the teletransporter
+ * can be used again once the hero has left it.
+ */
+void Teletransporter::update() {
+
+  Detector::update();
+
+  if (transporting_hero
+      && !is_on_map_side()
+      && !overlaps(get_hero())) {
+    transporting_hero = false;
+  }
+}
+
 /**
  * \brief Returns whether this entity is an obstacle for another one.
  * \param other another entity
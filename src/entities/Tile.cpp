@@ -65,6 +65,17 @@ void Tile::set_map(Map& map) {
   this->tile_pattern = &map.get_tileset().get_tile_pattern(tile_pattern_id);
 }
 
+/**
+ * \brief Notifies this entity that the tileset of its map has changed.
+ *
+ * The tile pattern is taken from the new tileset object.
+ */
+void Tile::notify_tileset_changed() {
+
+  MapEntity::notify_tileset_changed();
+  this->tile_pattern = &get_map().get_tileset().get_tile_pattern(tile_pattern_id);
+}
+
 /**
  * \brief Returns whether this entity is drawn at its position on the map.
  * \return true if this entity is drawn where it is located.
@@ -122,6 +122,22 @@ bool TilePattern::is_drawn_at_its_position() {
   return true;
 }
 
+/**
+ * \brief Returns the sequence of frames that animates this tile pattern,
+ * if its appearance only depends on the current frame of animated tiles.
+ *
+ * Regions made of such tile patterns can be pre-rendered once for each
+ * frame. Returns 0 by default.
+ *
+ * \return AnimatedTilePattern::ANIMATION_SEQUENCE_012 or
+ * AnimatedTilePattern::ANIMATION_SEQUENCE_0121, or 0 if this tile pattern
+ * is not animated or depends on something else (like the time or the
+ * viewport)
+ */
+int TilePattern::get_frame_sequence() {
+  return 0;
+}
+
 /**
  * \brief Fills a rectangle by repeating this tile pattern.
  * \param dst_surface The destination surface.
@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "entities/TilesetCache.h"
+#include "entities/Tileset.h"
+#include "lowlevel/Surface.h"
+#include "lowlevel/Debug.h"
+#include "lowlevel/Profiler.h"
+#include <sstream>
+
+SDL_mutex* TilesetCache::mutex = NULL;
+std::map<std::string, TilesetCache::Entry> TilesetCache::tilesets;
+std::map<const Tileset*, std::string> TilesetCache::keys;
+std::list<std::string> TilesetCache::lru_keys;
+size_t TilesetCache::resident_bytes = 0;
+size_t TilesetCache::max_bytes = 16 * 1024 * 1024;
+int TilesetCache::nb_hits = 0;
+int TilesetCache::nb_misses = 0;
+double TilesetCache::load_time = 0.0;
+
+/**
+ * \brief Initializes the tileset cache.
+ *
+ * The memory budget can be set with the option
+ * "-tileset-cache-size=<kilobytes>".
+ *
+ * \param argc number of command line arguments
+ * \param argv command line arguments
+ */
+void TilesetCache::initialize(int argc, char** argv) {
+
+  // check the -tileset-cache-size option
+  const std::string option = "-tileset-cache-size=";
+  for (argv++; argc > 1; argv++, argc--) {
+    const std::string arg = *argv;
+    if (arg.find(option) == 0) {
+      std::istringstream iss(arg.substr(option.size()));
+      size_t kilobytes;
+      if (iss >> kilobytes) {
+        max_bytes = kilobytes * 1024;
+      }
+      else {
+        Debug::error(std::string("Invalid tileset cache size: '") + arg.substr(option.size()) + "'");
+      }
+    }
+  }
+
+  mutex = SDL_CreateMutex();
+  resident_bytes = 0;
+  nb_hits = 0;
+  nb_misses = 0;
+  load_time = 0.0;
+}
+
+/**
+ * \brief Destroys all tilesets kept by the cache.
+ *
+ * No map must be using them anymore.
+ */
+void TilesetCache::quit() {
+
+  SDL_LockMutex(mutex);
+  std::map<std::string, Entry>::iterator it;
+  for (it = tilesets.begin(); it != tilesets.end(); ++it) {
+    delete it->second.tileset;
+  }
+  tilesets.clear();
+  keys.clear();
+  lru_keys.clear();
+  resident_bytes = 0;
+  SDL_UnlockMutex(mutex);
+
+  SDL_DestroyMutex(mutex);
+  mutex = NULL;
+}
+
+/**
+ * \brief Returns a loaded tileset, loading it if necessary.
+ *
+ * The caller receives a new reference to the tileset and must release it
+ * with release_tileset().
+ *
+ * \param tileset_id Id of the tileset.
+ * \return The tileset.
+ */
+Tileset* TilesetCache::get_tileset(const std::string& tileset_id) {
+  return get_tileset(tileset_id, tileset_id);
+}
+
+/**
+ * \brief Returns a loaded tileset with the images of another one,
+ * loading it if necessary.
+ *
+ * The caller receives a new reference to the tileset and must release it
+ * with release_tileset().
+ *
+ * \param tileset_id Id of the tileset whose tile patterns are used.
+ * \param images_tileset_id Id of the tileset whose images and background
+ * color are used.
+ * \return The tileset.
+ */
+Tileset* TilesetCache::get_tileset(const std::string& tileset_id,
+    const std::string& images_tileset_id) {
+
+  std::string key = tileset_id;
+  if (images_tileset_id != tileset_id) {
+    key += "+" + images_tileset_id;
+  }
+
+  SDL_LockMutex(mutex);
+  std::map<std::string, Entry>::iterator it = tilesets.find(key);
+  if (it != tilesets.end()) {
+    // Move the tileset to the front of the LRU list.
+    ++nb_hits;
+    Entry& entry = it->second;
+    lru_keys.splice(lru_keys.begin(), lru_keys, entry.lru_position);
+    ++entry.refcount;
+    SDL_UnlockMutex(mutex);
+    return entry.tileset;
+  }
+
+  // Load the tileset without blocking the other threads.
+  ++nb_misses;
+  SDL_UnlockMutex(mutex);
+  const uint64_t start = SDL_GetPerformanceCounter();
+  Tileset* tileset = load_tileset(tileset_id, images_tileset_id);
+  const double duration = (SDL_GetPerformanceCounter() - start) * 1000.0
+      / SDL_GetPerformanceFrequency();
+
+  SDL_LockMutex(mutex);
+  load_time += duration;
+  it = tilesets.find(key);
+  if (it != tilesets.end()) {
+    // Another thread has loaded the same tileset meanwhile.
+    delete tileset;
+    ++it->second.refcount;
+    tileset = it->second.tileset;
+    SDL_UnlockMutex(mutex);
+    return tileset;
+  }
+
+  Entry& entry = tilesets[key];
+  entry.tileset = tileset;
+  entry.refcount = 1;
+  entry.size = get_size(*tileset);
+  lru_keys.push_front(key);
+  entry.lru_position = lru_keys.begin();
+  keys[tileset] = key;
+  resident_bytes += entry.size;
+
+  evict_unused_tilesets();
+  SDL_UnlockMutex(mutex);
+
+  return tileset;
+}
+
+/**
+ * \brief Releases a reference to a tileset obtained with get_tileset().
+ *
+ * The tileset stays in the cache until the memory budget is exceeded.
+ *
+ * \param tileset The tileset to release.
+ */
+void TilesetCache::release_tileset(Tileset* tileset) {
+
+  if (tileset == NULL) {
+    return;
+  }
+
+  SDL_LockMutex(mutex);
+  std::map<const Tileset*, std::string>::iterator it = keys.find(tileset);
+  Debug::check_assertion(it != keys.end(),
+      "This tileset does not come from the tileset cache");
+
+  Entry& entry = tilesets[it->second];
+  Debug::check_assertion(entry.refcount > 0,
+      "This tileset was already released");
+  --entry.refcount;
+
+  evict_unused_tilesets();
+  SDL_UnlockMutex(mutex);
+}
+
+/**
+ * \brief Loads a tileset.
+ * \param tileset_id Id of the tileset whose tile patterns are used.
+ * \param images_tileset_id Id of the tileset whose images and background
+ * color are used.
+ * \return The tileset loaded.
+ */
+Tileset* TilesetCache::load_tileset(const std::string& tileset_id,
+    const std::string& images_tileset_id) {
+
+  SOLARUS_PROFILE("TilesetCache::load_tileset");
+
+  Tileset* tileset = new Tileset(tileset_id);
+  tileset->load();
+
+  if (images_tileset_id != tileset_id) {
+    // Not shared: set_images() takes the images of the other tileset.
+    Tileset images_tileset(images_tileset_id);
+    images_tileset.load();
+    tileset->set_images(images_tileset);
+  }
+
+  return tileset;
+}
+
+/**
+ * \brief Estimates the memory used by a tileset.
+ *
+ * Only the images are counted: they take much more memory than the
+ * tile patterns.
+ *
+ * \param tileset A loaded tileset.
+ * \return The estimated size in bytes.
+ */
+size_t TilesetCache::get_size(Tileset& tileset) {
+
+  const Surface& tiles_image = tileset.get_tiles_image();
+  const Surface& entities_image = tileset.get_entities_image();
+  return 4 * (tiles_image.get_width() * tiles_image.get_height()
+      + entities_image.get_width() * entities_image.get_height());
+}
+
+/**
+ * \brief Destroys the least recently used tilesets until the memory budget
+ * is respected.
+ *
+ * Only tilesets that no map uses anymore are destroyed.
+ */
+void TilesetCache::evict_unused_tilesets() {
+
+  std::list<std::string>::iterator it = lru_keys.end();
+  while (resident_bytes > max_bytes && it != lru_keys.begin()) {
+
+    --it;
+    Entry& entry = tilesets[*it];
+    if (entry.refcount > 0) {
+      // Still used by a map.
+      continue;
+    }
+
+    resident_bytes -= entry.size;
+    keys.erase(entry.tileset);
+    delete entry.tileset;
+    tilesets.erase(*it);
+    it = lru_keys.erase(it);
+  }
+}
+
+/**
+ * \brief Returns the number of requests that found their tileset in the cache.
+ * \return The number of cache hits.
+ */
+int TilesetCache::get_nb_hits() {
+  return nb_hits;
+}
+
+/**
+ * \brief Returns the number of requests that had to load their tileset.
+ * \return The number of cache misses.
+ */
+int TilesetCache::get_nb_misses() {
+  return nb_misses;
+}
+
+/**
+ * \brief Returns the total time spent loading tilesets.
+ * \return The loading time of all cache misses in milliseconds.
+ */
+double TilesetCache::get_load_time() {
+  return load_time;
+}
+
+/**
+ * \brief Returns the memory used by the tilesets of the cache.
+ * \return The estimated size of all tilesets kept in bytes.
+ */
+size_t TilesetCache::get_resident_bytes() {
+  return resident_bytes;
+}
+
+/**
+ * \brief Returns the memory budget of the cache.
+ * \return The size above which unused tilesets are destroyed, in bytes.
+ */
+size_t TilesetCache::get_max_bytes() {
+  return max_bytes;
+}
+
+/**
+ * \brief Sets the memory budget of the cache.
+ * \param max_bytes The size above which unused tilesets are destroyed,
+ * in bytes.
+ */
+void TilesetCache::set_max_bytes(size_t max_bytes) {
+
+  SDL_LockMutex(mutex);
+  TilesetCache::max_bytes = max_bytes;
+  evict_unused_tilesets();
+  SDL_UnlockMutex(mutex);
+}
+
@@ -37,6 +37,8 @@ std::string FileTools::solarus_write_dir;
 std::string FileTools::quest_write_dir;
 std::string FileTools::language_code;
 std::vector<std::string> FileTools::temporary_files;
+SDL_mutex* FileTools::prefetched_files_mutex = NULL;
+std::map<std::string, FileTools::PrefetchedFile> FileTools::prefetched_files;
 
 /**
  * \brief Initializes the file tools.
@@ -84,6 +86,8 @@ void FileTools::initialize(int argc, char** argv) {
 
   // Set the engine root write directory.
   set_solarus_write_dir(SOLARUS_WRITE_DIR);
+
+  prefetched_files_mutex = SDL_CreateMutex();
 }
 
 /**
@@ -93,6 +97,14 @@ void FileTools::quit() {
 
   remove_temporary_files();
 
+  std::map<std::string, PrefetchedFile>::iterator it;
+  for (it = prefetched_files.begin(); it != prefetched_files.end(); ++it) {
+    delete[] it->second.buffer;
+  }
+  prefetched_files.clear();
+  SDL_DestroyMutex(prefetched_files_mutex);
+  prefetched_files_mutex = NULL;
+
   DialogResource::quit();
   StringResource::quit();
   PHYSFS_deinit();
@@ -239,6 +251,20 @@ bool FileTools::data_file_exists(const std::string& file_name,
   return PHYSFS_exists(full_file_name.c_str());
 }
 
+/**
+ * \brief Returns the last modification date of a data file.
+ *
+ * This also works for files in a data.solarus archive.
+ *
+ * \param file_name name of the file, relative to the data directory
+ * \return the last modification date in seconds since the epoch,
+ * or -1 if it cannot be determined
+ */
+int64_t FileTools::data_file_get_modification_time(const std::string& file_name) {
+
+  return PHYSFS_getLastModTime(file_name.c_str());
+}
+
 /**
  * \brief Opens in reading a text file in the Solarus data directory.
  *
@@ -292,6 +318,21 @@ void FileTools::data_file_open_buffer(const std::string& file_name, char** buffe
     full_file_name = file_name;
   }
 
+  // take the content if it was read in advance
+  if (!language_specific && prefetched_files_mutex != NULL) {
+    SDL_LockMutex(prefetched_files_mutex);
+    std::map<std::string, PrefetchedFile>::iterator it =
+        prefetched_files.find(full_file_name);
+    if (it != prefetched_files.end()) {
+      *buffer = it->second.buffer;
+      *size = it->second.size;
+      prefetched_files.erase(it);
+      SDL_UnlockMutex(prefetched_files_mutex);
+      return;
+    }
+    SDL_UnlockMutex(prefetched_files_mutex);
+  }
+
   // open the file
   Debug::check_assertion(PHYSFS_exists(full_file_name.c_str()), StringConcat()
       << "Data file " << full_file_name << " does not exist");
@@ -343,6 +384,60 @@ void FileTools::data_file_close_buffer(char* buffer) {
   delete[] buffer;
 }
 
+/**
+ * \brief Reads a data file in advance.
+ *
+ * The next call to data_file_open_buffer() for this file will get its
+ * content without reading it again.
+ * This function may be called from any thread.
+ *
+ * \param file_name Name of the file to read (not language-specific).
+ * \return The number of bytes read, or 0 if the file does not exist or was
+ * already read in advance.
+ */
+size_t FileTools::data_file_prefetch(const std::string& file_name) {
+
+  SDL_LockMutex(prefetched_files_mutex);
+  bool already_prefetched = prefetched_files.find(file_name) != prefetched_files.end();
+  SDL_UnlockMutex(prefetched_files_mutex);
+
+  if (already_prefetched || !data_file_exists(file_name)) {
+    return 0;
+  }
+
+  PrefetchedFile file;
+  data_file_open_buffer(file_name, &file.buffer, &file.size);
+
+  SDL_LockMutex(prefetched_files_mutex);
+  if (prefetched_files.find(file_name) != prefetched_files.end()) {
+    // Another thread was faster.
+    delete[] file.buffer;
+    file.size = 0;
+  }
+  else {
+    prefetched_files[file_name] = file;
+  }
+  SDL_UnlockMutex(prefetched_files_mutex);
+
+  return file.size;
+}
+
+/**
+ * \brief Frees a data file read in advance if it was not used.
+ * \param file_name Name of a file passed to data_file_prefetch().
+ */
+void FileTools::data_file_discard_prefetched(const std::string& file_name) {
+
+  SDL_LockMutex(prefetched_files_mutex);
+  std::map<std::string, PrefetchedFile>::iterator it =
+      prefetched_files.find(file_name);
+  if (it != prefetched_files.end()) {
+    delete[] it->second.buffer;
+    prefetched_files.erase(it);
+  }
+  SDL_UnlockMutex(prefetched_files_mutex);
+}
+
 /**
  * \brief Removes a file from the write directory.
  * \param file_name Name of the file to delete, relative to the Solarus
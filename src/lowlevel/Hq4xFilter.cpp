@@ -40,9 +40,23 @@ int Hq4xFilter::get_scaling_factor() const {
 }
 
 /**
- * \copydoc PixelFilter::filter
+ * \copydoc PixelFilter::filter_rows
  */
-void Hq4xFilter::filter(
+void Hq4xFilter::filter_rows(
+    const uint32_t* src,
+    int src_width,
+    int src_height,
+    uint32_t* dst,
+    int first_row,
+    int last_row) const {
+
+  hq4x_32_rows(const_cast<uint32_t*>(src), dst, src_width, src_height, first_row, last_row);
+}
+
+/**
+ * \copydoc PixelFilter::filter_reference
+ */
+void Hq4xFilter::filter_reference(
     const uint32_t* src,
     int src_width,
     int src_height,
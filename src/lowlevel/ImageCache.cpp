@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lowlevel/ImageCache.h"
+#include "lowlevel/FileTools.h"
+#include "lowlevel/Surface.h"
+#include "lowlevel/Debug.h"
+#include "lowlevel/StringConcat.h"
+
+SDL_mutex* ImageCache::mutex = NULL;
+std::map<std::string, ImageCache::Image> ImageCache::images;
+std::list<std::string> ImageCache::lru_keys;
+size_t ImageCache::resident_bytes = 0;
+size_t ImageCache::max_bytes = 32 * 1024 * 1024;
+int ImageCache::nb_hits = 0;
+int ImageCache::nb_misses = 0;
+
+/**
+ * \brief Initializes the image cache.
+ */
+void ImageCache::initialize() {
+
+  mutex = SDL_CreateMutex();
+  resident_bytes = 0;
+  nb_hits = 0;
+  nb_misses = 0;
+}
+
+/**
+ * \brief Releases all images kept by the cache.
+ *
+ * Surfaces still using some of them remain valid.
+ */
+void ImageCache::quit() {
+
+  SDL_LockMutex(mutex);
+  std::map<std::string, Image>::iterator it;
+  for (it = images.begin(); it != images.end(); ++it) {
+    SDL_FreeSurface(it->second.surface);
+  }
+  images.clear();
+  lru_keys.clear();
+  resident_bytes = 0;
+  SDL_UnlockMutex(mutex);
+
+  SDL_DestroyMutex(mutex);
+  mutex = NULL;
+}
+
+/**
+ * \brief Returns a decoded image file, loading it if necessary.
+ *
+ * The caller receives a new reference to the image and must release it
+ * with release_image().
+ * An assertion error occurs if the file cannot be loaded.
+ *
+ * \param file_name Name of the image file, relative to the data directory.
+ * \param language_specific true if the file is specific to the current language.
+ * \return The image.
+ */
+SDL_Surface* ImageCache::get_image(const std::string& file_name,
+    bool language_specific) {
+
+  std::string key = file_name;
+  if (language_specific) {
+    key = FileTools::get_language() + "/" + file_name;
+  }
+
+  SDL_LockMutex(mutex);
+  std::map<std::string, Image>::iterator it = images.find(key);
+  if (it != images.end()) {
+    // Move the image to the front of the LRU list.
+    ++nb_hits;
+    Image& image = it->second;
+    lru_keys.splice(lru_keys.begin(), lru_keys, image.lru_position);
+    ++image.surface->refcount;
+    SDL_UnlockMutex(mutex);
+    return image.surface;
+  }
+
+  // Decode the image without blocking the other threads.
+  ++nb_misses;
+  SDL_UnlockMutex(mutex);
+  SDL_Surface* surface = load_image(file_name, language_specific);
+
+  SDL_LockMutex(mutex);
+  it = images.find(key);
+  if (it != images.end()) {
+    // Another thread has decoded the same image meanwhile.
+    SDL_FreeSurface(surface);
+    surface = it->second.surface;
+    ++surface->refcount;
+    SDL_UnlockMutex(mutex);
+    return surface;
+  }
+
+  Image& image = images[key];
+  image.surface = surface;
+  image.size = surface->pitch * surface->h;
+  lru_keys.push_front(key);
+  image.lru_position = lru_keys.begin();
+  resident_bytes += image.size;
+
+  // Take the reference of the caller first so that the new image is not
+  // evicted right away.
+  ++surface->refcount;
+  evict_unused_images();
+
+  SDL_UnlockMutex(mutex);
+  return surface;
+}
+
+/**
+ * \brief Releases a reference to an image returned by get_image().
+ *
+ * The reference count of SDL surfaces is not atomic, so it is only
+ * modified with the lock held.
+ *
+ * \param image The image to release.
+ */
+void ImageCache::release_image(SDL_Surface* image) {
+
+  SDL_LockMutex(mutex);
+  SDL_FreeSurface(image);
+  SDL_UnlockMutex(mutex);
+}
+
+/**
+ * \brief Decodes an image file in the display pixel format.
+ *
+ * An assertion error occurs if the file cannot be loaded.
+ *
+ * \param file_name Name of the image file, relative to the data directory.
+ * \param language_specific true if the file is specific to the current language.
+ * \return The image decoded.
+ */
+SDL_Surface* ImageCache::load_image(const std::string& file_name,
+    bool language_specific) {
+
+  SDL_Surface* surface = Surface::load_image(file_name, language_specific);
+
+  Debug::check_assertion(surface != NULL, StringConcat() <<
+      "Cannot load image '" << file_name << "'");
+
+  // Cached images are never modified,
+  // so images with holes can be run-length encoded.
+  uint32_t colorkey;
+  if (SDL_GetColorKey(surface, &colorkey) == 0) {
+    SDL_SetSurfaceRLE(surface, 1);
+  }
+
+  return surface;
+}
+
+/**
+ * \brief Releases the least recently used images until the memory budget
+ * is respected.
+ *
+ * Only images that no surface uses anymore are released,
+ * since the other ones would stay in memory anyway.
+ */
+void ImageCache::evict_unused_images() {
+
+  std::list<std::string>::iterator it = lru_keys.end();
+  while (resident_bytes > max_bytes && it != lru_keys.begin()) {
+
+    --it;
+    Image& image = images[*it];
+    if (image.surface->refcount > 1) {
+      // Still used by a surface.
+      continue;
+    }
+
+    resident_bytes -= image.size;
+    SDL_FreeSurface(image.surface);
+    images.erase(*it);
+    it = lru_keys.erase(it);
+  }
+}
+
+/**
+ * \brief Returns the number of requests that found their image in the cache.
+ * \return The number of cache hits.
+ */
+int ImageCache::get_nb_hits() {
+
+  SDL_LockMutex(mutex);
+  int result = nb_hits;
+  SDL_UnlockMutex(mutex);
+  return result;
+}
+
+/**
+ * \brief Returns the number of requests that had to decode their image.
+ * \return The number of cache misses.
+ */
+int ImageCache::get_nb_misses() {
+
+  SDL_LockMutex(mutex);
+  int result = nb_misses;
+  SDL_UnlockMutex(mutex);
+  return result;
+}
+
+/**
+ * \brief Returns the memory used by the images of the cache.
+ * \return The size of all pixels kept in bytes.
+ */
+size_t ImageCache::get_resident_bytes() {
+
+  SDL_LockMutex(mutex);
+  size_t result = resident_bytes;
+  SDL_UnlockMutex(mutex);
+  return result;
+}
+
+/**
+ * \brief Returns the memory budget of the cache.
+ * \return The size above which unused images are evicted, in bytes.
+ */
+size_t ImageCache::get_max_bytes() {
+  return max_bytes;
+}
+
+/**
+ * \brief Sets the memory budget of the cache.
+ * \param max_bytes The size above which unused images are evicted, in bytes.
+ */
+void ImageCache::set_max_bytes(size_t max_bytes) {
+
+  SDL_LockMutex(mutex);
+  ImageCache::max_bytes = max_bytes;
+  evict_unused_images();
+  SDL_UnlockMutex(mutex);
+}
+
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lowlevel/InputRecording.h"
+#include "lowlevel/InputEvent.h"
+#include "lowlevel/Random.h"
+#include "lowlevel/Debug.h"
+#include "lowlevel/StringConcat.h"
+#include <cstring>
+
+const char InputRecording::magic[] = "SOLINPUT";
+const uint32_t InputRecording::version = 1;
+
+/**
+ * \brief Creates an input recording that neither records nor replays.
+ */
+InputRecording::InputRecording():
+  next_record(0),
+  end_date(0) {
+
+}
+
+/**
+ * \brief Destructor.
+ */
+InputRecording::~InputRecording() {
+
+}
+
+/**
+ * \brief Starts recording the input events in a file.
+ *
+ * The seed of the random number generator is saved too.
+ *
+ * \param file_name the file to create
+ * \return false if the file could not be created
+ */
+bool InputRecording::start_recording(const std::string& file_name) {
+
+  output.open(file_name.c_str(), std::ios::out | std::ios::binary);
+  if (!output) {
+    Debug::error(StringConcat() << "Cannot create the input recording file '"
+        << file_name << "'");
+    return false;
+  }
+
+  const uint32_t event_size = sizeof(SDL_Event);
+  const uint32_t seed = Random::get_seed();
+  output.write(magic, sizeof(magic) - 1);
+  output.write(reinterpret_cast<const char*>(&version), sizeof(version));
+  output.write(reinterpret_cast<const char*>(&event_size), sizeof(event_size));
+  output.write(reinterpret_cast<const char*>(&seed), sizeof(seed));
+  return true;
+}
+
+/**
+ * \brief Saves an input event.
+ *
+ * Events that contain pointers (dropped files, user events) are ignored.
+ *
+ * \param event the event to save
+ * \param date simulated date when the event was received
+ */
+void InputRecording::record_event(const InputEvent& event, uint32_t date) {
+
+  if (!output.is_open()) {
+    return;
+  }
+
+  const SDL_Event& internal_event = event.internal_event;
+  if (internal_event.type == SDL_DROPFILE
+      || internal_event.type == SDL_SYSWMEVENT
+      || internal_event.type >= SDL_USEREVENT) {
+    return;
+  }
+
+  write_record(date, internal_event);
+}
+
+/**
+ * \brief Ends the recording.
+ * \param date simulated date when the recording stops
+ */
+void InputRecording::stop_recording(uint32_t date) {
+
+  if (!output.is_open()) {
+    return;
+  }
+
+  SDL_Event end_event;
+  std::memset(&end_event, 0, sizeof(end_event));
+  end_event.type = SDL_FIRSTEVENT;
+  write_record(date, end_event);
+  output.close();
+}
+
+/**
+ * \brief Writes a record to the output file.
+ * \param date simulated date of the event
+ * \param event the event to write
+ */
+void InputRecording::write_record(uint32_t date, const SDL_Event& event) {
+
+  output.write(reinterpret_cast<const char*>(&date), sizeof(date));
+  output.write(reinterpret_cast<const char*>(&event), sizeof(event));
+}
+
+/**
+ * \brief Loads a recording file to replay it.
+ *
+ * The random number generator is reinitialized with the recorded seed.
+ *
+ * \param file_name the file to read
+ * \return false if the file could not be read
+ */
+bool InputRecording::start_replay(const std::string& file_name) {
+
+  std::ifstream input(file_name.c_str(), std::ios::in | std::ios::binary);
+  if (!input) {
+    Debug::error(StringConcat() << "Cannot open the input recording file '"
+        << file_name << "'");
+    return false;
+  }
+
+  char file_magic[sizeof(magic) - 1];
+  uint32_t file_version = 0;
+  uint32_t event_size = 0;
+  uint32_t seed = 0;
+  input.read(file_magic, sizeof(file_magic));
+  input.read(reinterpret_cast<char*>(&file_version), sizeof(file_version));
+  input.read(reinterpret_cast<char*>(&event_size), sizeof(event_size));
+  input.read(reinterpret_cast<char*>(&seed), sizeof(seed));
+  if (!input
+      || std::memcmp(file_magic, magic, sizeof(file_magic)) != 0
+      || file_version != version
+      || event_size != sizeof(SDL_Event)) {
+    Debug::error(StringConcat() << "Invalid input recording file '"
+        << file_name << "'");
+    return false;
+  }
+
+  records.clear();
+  next_record = 0;
+  end_date = 0;
+  Record record;
+  while (input.read(reinterpret_cast<char*>(&record.date), sizeof(record.date))
+      && input.read(reinterpret_cast<char*>(&record.event), sizeof(record.event))) {
+    if (record.event.type == SDL_FIRSTEVENT) {
+      end_date = record.date;
+      break;
+    }
+    records.push_back(record);
+    end_date = record.date;
+  }
+
+  Random::set_seed(seed);
+  return true;
+}
+
+/**
+ * \brief Returns the next recorded event that happens at a date.
+ * \param date the current simulated date
+ * \return the next event received at or before this date,
+ * or NULL if there is no more event to replay now
+ */
+InputEvent* InputRecording::get_event(uint32_t date) {
+
+  if (next_record >= records.size()
+      || records[next_record].date > date) {
+    return NULL;
+  }
+
+  return new InputEvent(records[next_record++].event);
+}
+
+/**
+ * \brief Returns whether the replay is over.
+ * \param date the current simulated date
+ * \return true if all events were replayed and the recorded session
+ * is finished
+ */
+bool InputRecording::is_replay_finished(uint32_t date) const {
+
+  return next_record >= records.size() && date >= end_date;
+}
+
@@ -17,15 +17,20 @@
 #include "lowlevel/Music.h"
 #include "lowlevel/SpcDecoder.h"
 #include "lowlevel/ItDecoder.h"
+#include "lowlevel/RingBuffer.h"
 #include "lowlevel/FileTools.h"
 #include "lowlevel/Debug.h"
 #include "lowlevel/StringConcat.h"
+#include <sstream>
 #include <vector>
 
 const int Music::nb_buffers;
 SpcDecoder* Music::spc_decoder = NULL;
 ItDecoder* Music::it_decoder = NULL;
+SDL_mutex* Music::decoder_mutex = NULL;
 float Music::volume = 1.0;
+int Music::buffer_duration = 1000;
+int Music::nb_underruns = 0;
 Music* Music::current_music = NULL;
 std::map<std::string, Music> Music::all_musics;
 
@@ -49,7 +54,15 @@ const std::string Music::format_names[] = {
  */
 Music::Music(const std::string& music_id):
   id(music_id),
-  format(OGG) {
+  format(OGG),
+  source(AL_NONE),
+  al_format(AL_NONE),
+  sample_rate(0),
+  chunk_size(0),
+  decoded_data(NULL),
+  decoding_thread(NULL) {
+
+  SDL_AtomicSet(&stopping, 0);
 
   if (!is_initialized() || music_id == none) {
     return;
@@ -77,12 +90,36 @@ Music::~Music() {
 
 /**
  * \brief Initializes the music system.
+ *
+ * The duration of music decoded in advance can be set with the option
+ * "-music-buffer=<milliseconds>".
+ *
+ * \param argc number of command line arguments
+ * \param argv command line arguments
  */
-void Music::initialize() {
+void Music::initialize(int argc, char** argv) {
+
+  // check the -music-buffer option
+  const std::string option = "-music-buffer=";
+  for (argv++; argc > 1; argv++, argc--) {
+    const std::string arg = *argv;
+    if (arg.find(option) == 0) {
+      std::istringstream iss(arg.substr(option.size()));
+      int milliseconds;
+      if (iss >> milliseconds && milliseconds > 0) {
+        buffer_duration = milliseconds;
+      }
+      else {
+        Debug::error(std::string("Invalid music buffer duration: '") + arg.substr(option.size()) + "'");
+      }
+    }
+  }
 
   // initialize the decoding features
   spc_decoder = new SpcDecoder();
   it_decoder = new ItDecoder();
+  decoder_mutex = SDL_CreateMutex();
+  nb_underruns = 0;
 
   set_volume(100);
 }
@@ -95,6 +132,8 @@ void Music::quit() {
     all_musics.clear();
     delete spc_decoder;
     delete it_decoder;
+    SDL_DestroyMutex(decoder_mutex);
+    decoder_mutex = NULL;
   }
 }
 
@@ -154,7 +193,10 @@ int Music::get_num_channels() {
   Debug::check_assertion(get_format() == IT,
       "This function is only supported for .it musics");
 
-  return it_decoder->get_num_channels();
+  SDL_LockMutex(decoder_mutex);
+  int num_channels = it_decoder->get_num_channels();
+  SDL_UnlockMutex(decoder_mutex);
+  return num_channels;
 }
 
 /**
@@ -170,7 +212,10 @@ int Music::get_channel_volume(int channel) {
   Debug::check_assertion(get_format() == IT,
       "This function is only supported for .it musics");
 
-  return it_decoder->get_channel_volume(channel);
+  SDL_LockMutex(decoder_mutex);
+  int volume = it_decoder->get_channel_volume(channel);
+  SDL_UnlockMutex(decoder_mutex);
+  return volume;
 }
 
 /**
@@ -186,7 +231,9 @@ void Music::set_channel_volume(int channel, int volume) {
   Debug::check_assertion(get_format() == IT,
       "This function is only supported for .it musics");
 
+  SDL_LockMutex(decoder_mutex);
   it_decoder->set_channel_volume(channel, volume);
+  SDL_UnlockMutex(decoder_mutex);
 }
 
 /**
@@ -201,7 +248,10 @@ int Music::get_tempo() {
   Debug::check_assertion(get_format() == IT,
       "This function is only supported for .it musics");
 
-  return it_decoder->get_tempo();
+  SDL_LockMutex(decoder_mutex);
+  int tempo = it_decoder->get_tempo();
+  SDL_UnlockMutex(decoder_mutex);
+  return tempo;
 }
 
 /**
@@ -216,7 +266,18 @@ void Music::set_tempo(int tempo) {
   Debug::check_assertion(get_format() == IT,
       "This function is only supported for .it musics");
 
+  SDL_LockMutex(decoder_mutex);
   it_decoder->set_tempo(tempo);
+  SDL_UnlockMutex(decoder_mutex);
+}
+
+/**
+ * \brief Returns the number of times the music was interrupted because
+ * it was not decoded fast enough.
+ * \return The number of buffer underruns since the audio system started.
+ */
+int Music::get_nb_underruns() {
+  return nb_underruns;
 }
 
 
@@ -345,119 +406,185 @@ void Music::update() {
 /**
  * \brief Updates this music when it is playing.
  *
- * This function handles the double buffering.
+ * Buffers that OpenAL has played are refilled with the data decoded in
+ * advance by the decoding thread.
  */
 void Music::update_playing() {
 
   // get the empty buffers
-  ALint nb_empty;
-  alGetSourcei(source, AL_BUFFERS_PROCESSED, &nb_empty);
-
-  // refill them
-  for (int i = 0; i < nb_empty; i++) {
+  ALint nb_processed;
+  alGetSourcei(source, AL_BUFFERS_PROCESSED, &nb_processed);
+  for (int i = 0; i < nb_processed; i++) {
     ALuint buffer;
-    alSourceUnqueueBuffers(source, 1, &buffer); // unqueue the buffer
-
-    // fill it by decoding more data
-    switch (format) {
-
-      case SPC:
-        decode_spc(buffer, 4096);
-        break;
-
-      case IT:
-        decode_it(buffer, 4096);
-        break;
-
-      case OGG:
-        decode_ogg(buffer, 4096);
-        break;
+    alSourceUnqueueBuffers(source, 1, &buffer);
+    empty_buffers.push_back(buffer);
+  }
 
-      case NO_FORMAT:
-        Debug::die("Invalid music format");
-        break;
-    }
-    alSourceQueueBuffers(source, 1, &buffer);   // queue it again
+  // refill them with the decoded data available
+  while (!empty_buffers.empty() && fill_buffer(empty_buffers.back())) {
+    alSourceQueueBuffers(source, 1, &empty_buffers.back());
+    empty_buffers.pop_back();
   }
 
   ALint status;
   alGetSourcei(source, AL_SOURCE_STATE, &status);
 
   if (status != AL_PLAYING) {
-    alSourcePlay(source);
+    if (status == AL_STOPPED) {
+      // all queued buffers were played before we could refill them
+      ++nb_underruns;
+    }
+
+    ALint nb_queued;
+    alGetSourcei(source, AL_BUFFERS_QUEUED, &nb_queued);
+    if (nb_queued > 0) {
+      alSourcePlay(source);
+    }
   }
 }
 
 /**
- * \brief Decodes a chunk of SPC data into PCM data for the current music.
- * \param destination_buffer the destination buffer to write
- * \param nb_samples number of samples to write
+ * \brief Fills an OpenAL buffer with data decoded in advance.
+ * \param buffer The buffer to fill.
+ * \return false if no decoded data was available.
  */
-void Music::decode_spc(ALuint destination_buffer, ALsizei nb_samples) {
+bool Music::fill_buffer(ALuint buffer) {
 
-  // decode the SPC data
-  std::vector<ALushort> raw_data(nb_samples);
-  spc_decoder->decode((int16_t*) &raw_data[0], nb_samples);
+  std::vector<char> data(chunk_size);
+  size_t size = decoded_data->read(&data[0], chunk_size);
+  if (size == 0) {
+    return false;
+  }
 
-  // put this decoded data into the buffer
-  alBufferData(destination_buffer, AL_FORMAT_STEREO16, &raw_data[0], nb_samples * 2, 32000);
+  alBufferData(buffer, al_format, &data[0], ALsizei(size), sample_rate);
 
   int error = alGetError();
-  Debug::check_assertion(error == AL_NO_ERROR,
-      StringConcat() << "Failed to fill the audio buffer with decoded SPC data for music file '" << file_name << ": error " << error);
+  if (error != AL_NO_ERROR) {
+    Debug::error(StringConcat()
+        << "Failed to fill the audio buffer with decoded data for music file '"
+        << file_name << "': error " << error);
+  }
+  return true;
 }
 
 /**
- * \brief Decodes a chunk of IT data into PCM data for the current music.
- * \param destination_buffer the destination buffer to write
- * \param nb_samples number of samples to write
+ * \brief Function executed by the decoding thread.
+ * \param music The music to decode.
+ * \return 0.
  */
-void Music::decode_it(ALuint destination_buffer, ALsizei nb_samples) {
+int Music::decoding_thread_main(void* music) {
 
-  // decode the IT data
-  std::vector<ALushort> raw_data(nb_samples);
-  it_decoder->decode(&raw_data[0], nb_samples);
+  static_cast<Music*>(music)->decode_ahead();
+  return 0;
+}
 
-  // put this decoded data into the buffer
-  alBufferData(destination_buffer, AL_FORMAT_STEREO16, &raw_data[0], nb_samples, 44100);
+/**
+ * \brief Decodes the music into the ring buffer until stop() is called.
+ *
+ * This function is executed by the decoding thread.
+ * It keeps the ring buffer as full as possible.
+ */
+void Music::decode_ahead() {
 
-  int error = alGetError();
-  Debug::check_assertion(error == AL_NO_ERROR,
-      StringConcat() << "Failed to fill the audio buffer with decoded IT data for music file '" << file_name << ": error " << error);
+  // Decode a quarter of an OpenAL buffer at a time so that decoding
+  // catches up regularly, keeping whole stereo frames.
+  std::vector<char> data(chunk_size / 16 * 4);
+  const Uint32 delay = std::max(1, buffer_duration / nb_buffers / 8);
+
+  while (SDL_AtomicGet(&stopping) == 0) {
+
+    if (decoded_data->get_free_size() < data.size()) {
+      // Enough data is decoded for now.
+      SDL_Delay(delay);
+      continue;
+    }
+
+    SDL_LockMutex(decoder_mutex);
+    size_t size = decode(&data[0], data.size());
+    SDL_UnlockMutex(decoder_mutex);
+
+    if (size == 0) {
+      // Decoding error: don't loop too fast.
+      SDL_Delay(delay);
+      continue;
+    }
+
+    decoded_data->write(&data[0], size);
+  }
 }
 
 /**
- * \brief Decodes a chunk of OGG data into PCM data for the current music.
- * \param destination_buffer the destination buffer to write
- * \param nb_samples number of samples to write
+ * \brief Decodes a chunk of the current music into PCM data.
+ * \param decoded_data Destination of the decoded data.
+ * \param size Number of bytes to decode (a multiple of the frame size).
+ * \return Number of bytes actually decoded.
  */
-void Music::decode_ogg(ALuint destination_buffer, ALsizei nb_samples) {
+size_t Music::decode(char* decoded_data, size_t size) {
 
-  // read the encoded music properties
-  vorbis_info* info = ov_info(&ogg_file, -1);
-  ALsizei sample_rate = ALsizei(info->rate);
+  switch (format) {
 
-  ALenum al_format = AL_NONE;
-  if (info->channels == 1) {
-    al_format = AL_FORMAT_MONO16;
-  }
-  else if (info->channels == 2) {
-    al_format = AL_FORMAT_STEREO16;
+    case SPC:
+      return decode_spc(decoded_data, size);
+
+    case IT:
+      return decode_it(decoded_data, size);
+
+    case OGG:
+      return decode_ogg(decoded_data, size);
+
+    case NO_FORMAT:
+      Debug::die("Invalid music format");
+      break;
   }
+  return 0;
+}
+
+/**
+ * \brief Decodes a chunk of SPC data into PCM data for the current music.
+ * \param decoded_data Destination of the decoded data.
+ * \param size Number of bytes to decode.
+ * \return Number of bytes actually decoded.
+ */
+size_t Music::decode_spc(char* decoded_data, size_t size) {
+
+  // decode the SPC data (the decoder counts 16-bit samples)
+  spc_decoder->decode((int16_t*) decoded_data, int(size / 2));
+  return size;
+}
+
+/**
+ * \brief Decodes a chunk of IT data into PCM data for the current music.
+ * \param decoded_data Destination of the decoded data.
+ * \param size Number of bytes to decode.
+ * \return Number of bytes actually decoded.
+ */
+size_t Music::decode_it(char* decoded_data, size_t size) {
+
+  // decode the IT data
+  it_decoder->decode(decoded_data, int(size));
+  return size;
+}
+
+/**
+ * \brief Decodes a chunk of OGG data into PCM data for the current music.
+ * \param decoded_data Destination of the decoded data.
+ * \param size Number of bytes to decode.
+ * \return Number of bytes actually decoded.
+ */
+size_t Music::decode_ogg(char* decoded_data, size_t size) {
 
   // decode the OGG data
-  std::vector<ALshort> raw_data(nb_samples * info->channels);
   int bitstream;
   long bytes_read;
   long total_bytes_read = 0;
-  long remaining_bytes = nb_samples * info->channels * sizeof(ALshort);
+  long remaining_bytes = long(size);
   do {
-    bytes_read = ov_read(&ogg_file, ((char*) &raw_data[0]) + total_bytes_read, int(remaining_bytes), 0, 2, 1, &bitstream);
+    bytes_read = ov_read(&ogg_file, decoded_data + total_bytes_read, int(remaining_bytes), 0, 2, 1, &bitstream);
     if (bytes_read < 0) {
       if (bytes_read != OV_HOLE) { // OV_HOLE is normal when the music loops
         Debug::error(StringConcat() << "Error while decoding ogg chunk: "
             << bytes_read);
-        return;
+        return 0;
       }
     }
     else {
@@ -467,15 +594,7 @@ void Music::decode_ogg(ALuint destination_buffer, ALsizei nb_samples) {
   }
   while (remaining_bytes > 0 && bytes_read > 0);
 
-  // put this decoded data into the buffer
-  alBufferData(destination_buffer, al_format, &raw_data[0], ALsizei(total_bytes_read), sample_rate);
-
-  int error = alGetError();
-  if (error != AL_NO_ERROR) {
-    Debug::error(StringConcat()
-        << "Failed to fill the audio buffer with decoded OGG data for music file '"
-        << file_name << "': error " << error);
-  }
+  return size_t(total_bytes_read);
 }
 
 /**
@@ -526,9 +645,8 @@ bool Music::start() {
       spc_decoder->load((int16_t*) sound_data, sound_size);
       FileTools::data_file_close_buffer(sound_data);
 
-      for (int i = 0; i < nb_buffers; i++) {
-        decode_spc(buffers[i], 4096);
-      }
+      al_format = AL_FORMAT_STEREO16;
+      sample_rate = 32000;
       break;
 
     case IT:
@@ -539,9 +657,8 @@ bool Music::start() {
       it_decoder->load(sound_data, sound_size);
       FileTools::data_file_close_buffer(sound_data);
 
-      for (int i = 0; i < nb_buffers; i++) {
-        decode_it(buffers[i], 4096);
-      }
+      al_format = AL_FORMAT_STEREO16;
+      sample_rate = 44100;
       break;
 
     case OGG:
@@ -556,11 +673,13 @@ bool Music::start() {
       if (error) {
         Debug::error(StringConcat() << "Cannot load music file '" << file_name
           << "' from memory: error " << error);
+        success = false;
       }
       else {
-        for (int i = 0; i < nb_buffers; i++) {
-          decode_ogg(buffers[i], 4096);
-        }
+        // read the encoded music properties
+        vorbis_info* info = ov_info(&ogg_file, -1);
+        sample_rate = ALsizei(info->rate);
+        al_format = (info->channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
       }
       break;
     }
@@ -570,20 +689,52 @@ bool Music::start() {
       break;
   }
 
-  // start the streaming
-  alSourceQueueBuffers(source, nb_buffers, buffers);
-  int error = alGetError();
-  if (error != AL_NO_ERROR) {
-    Debug::error(StringConcat() << "Cannot initialize buffers for music '"
-        << file_name << "': error " << error);
-    success = false;
-  }
+  // the OpenAL buffers and the ring buffer each hold buffer_duration
+  // milliseconds of decoded data
+  const int frame_size = (al_format == AL_FORMAT_MONO16) ? 2 : 4;
+  const size_t duration_size = size_t(sample_rate) * frame_size * buffer_duration / 1000;
+  chunk_size = std::max(size_t(4096), duration_size / nb_buffers / 4 * 4);
+  decoded_data = new RingBuffer(chunk_size * nb_buffers);
+
+  // decode the first buffers now, the other ones will be filled by update()
+  if (success) {
+    const int nb_initial_buffers = 2;
+    std::vector<char> data(chunk_size);
+    for (int i = 0; i < nb_initial_buffers; i++) {
+      size_t size = decode(&data[0], chunk_size);
+      alBufferData(buffers[i], al_format, &data[0], ALsizei(size), sample_rate);
+    }
+
+    // start the streaming
+    alSourceQueueBuffers(source, nb_initial_buffers, buffers);
+    int error = alGetError();
+    if (error != AL_NO_ERROR) {
+      Debug::error(StringConcat() << "Cannot initialize buffers for music '"
+          << file_name << "': error " << error);
+      success = false;
+    }
+    empty_buffers.assign(buffers + nb_initial_buffers, buffers + nb_buffers);
 
-  alSourcePlay(source);
+    alSourcePlay(source);
+
+    // decode the rest of the music while it is played
+    SDL_AtomicSet(&stopping, 0);
+    decoding_thread = SDL_CreateThread(decoding_thread_main, "solarus_music", this);
+    if (decoding_thread == NULL) {
+      Debug::error(std::string("Cannot create the music decoding thread: ")
+          + SDL_GetError());
+      success = false;
+    }
+  }
 
   // now the update() function will take care of filling the buffers
   current_music = this;
 
+  if (!success) {
+    // free what was created
+    stop();
+  }
+
   return success;
 }
 
@@ -600,6 +751,16 @@ void Music::stop() {
     return;
   }
 
+  // stop decoding
+  if (decoding_thread != NULL) {
+    SDL_AtomicSet(&stopping, 1);
+    SDL_WaitThread(decoding_thread, NULL);
+    decoding_thread = NULL;
+  }
+  delete decoded_data;
+  decoded_data = NULL;
+  empty_buffers.clear();
+
   // empty the source
   alSourceStop(source);
 
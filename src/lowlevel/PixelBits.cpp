@@ -42,6 +42,9 @@ PixelBits::PixelBits(const Surface& surface, const Rectangle& image_position) {
 
   int pixel_index = image_position.get_y() * surface.get_width() + image_position.get_x();
 
+  // The pixels of a run-length encoded surface are only available when locked.
+  SDL_LockSurface(surface.internal_surface);
+
   bits = new uint32_t*[height];
   for (int i = 0; i < height; i++) {
     bits[i] = new uint32_t[nb_integers_per_row];
@@ -67,6 +70,8 @@ PixelBits::PixelBits(const Surface& surface, const Rectangle& image_position) {
     }
     pixel_index += surface.get_width() - width;
   }
+
+  SDL_UnlockSurface(surface.internal_surface);
 }
 
 /**
@@ -15,6 +15,7 @@
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "lowlevel/PixelFilter.h"
+#include <algorithm>
 
 /**
  * \brief Constructor.
@@ -28,3 +29,82 @@ PixelFilter::PixelFilter() {
 PixelFilter::~PixelFilter() {
 }
 
+/**
+ * \brief Applies the algorithm on a rectangle of pixels.
+ * \param src The rectangle of pixels in RGBA format.
+ * Must be a buffer of size src_width * src_height.
+ * \param src_width Width of the rectangle.
+ * \param src_height Height of the rectangle.
+ * \param dst The destination rectangle to write.
+ * Must be a buffer of size
+ * src_width * src_height * get_scaling_factor()^2.
+ */
+void PixelFilter::filter(
+    const uint32_t* src,
+    int src_width,
+    int src_height,
+    uint32_t* dst) const {
+
+  filter_rows(src, src_width, src_height, dst, 0, src_height);
+}
+
+/**
+ * \brief Applies the algorithm on some rows of a rectangle of pixels with
+ * several threads.
+ *
+ * The rows are split into horizontal bands, one for each thread of the
+ * pool plus the calling one. The result is identical to the one of the
+ * single-threaded version.
+ *
+ * \param src The rectangle of pixels in RGBA format.
+ * Must be a buffer of size src_width * src_height.
+ * \param src_width Width of the rectangle.
+ * \param src_height Height of the rectangle.
+ * \param dst The destination rectangle to write.
+ * Must be a buffer of size
+ * src_width * src_height * get_scaling_factor()^2.
+ * \param first_row First source row to filter.
+ * \param last_row Source row after the last one to filter.
+ * \param workers The threads to use.
+ */
+void PixelFilter::filter(
+    const uint32_t* src,
+    int src_width,
+    int src_height,
+    uint32_t* dst,
+    int first_row,
+    int last_row,
+    WorkerPool& workers) const {
+
+  const int nb_rows = last_row - first_row;
+  const int nb_bands = std::min(workers.get_nb_threads() + 1, nb_rows);
+  if (nb_bands <= 1) {
+    filter_rows(src, src_width, src_height, dst, first_row, last_row);
+    return;
+  }
+
+  bands.resize(nb_bands);
+  band_jobs.resize(nb_bands);
+  for (int i = 0; i < nb_bands; ++i) {
+    Band& band = bands[i];
+    band.filter = this;
+    band.src = src;
+    band.src_width = src_width;
+    band.src_height = src_height;
+    band.dst = dst;
+    band.first_row = first_row + nb_rows * i / nb_bands;
+    band.last_row = first_row + nb_rows * (i + 1) / nb_bands;
+    band_jobs[i] = &band;
+  }
+
+  workers.run(band_jobs);
+}
+
+/**
+ * \brief Filters the rows of this band.
+ */
+void PixelFilter::Band::run() {
+
+  filter->filter_rows(src, src_width, src_height, dst, first_row, last_row);
+}
+
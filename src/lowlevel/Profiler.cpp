@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lowlevel/Profiler.h"
+#include "lowlevel/System.h"
+#include "lowlevel/Surface.h"
+#include "lowlevel/Color.h"
+#include "lowlevel/Rectangle.h"
+#include "lowlevel/Debug.h"
+#include "lowlevel/StringConcat.h"
+#include <SDL.h>
+#include <algorithm>
+#include <fstream>
+
+bool Profiler::enabled = false;
+std::string Profiler::trace_file_name;
+std::vector<Profiler::Sample> Profiler::samples;
+SDL_atomic_t Profiler::nb_samples;
+uint64_t Profiler::initial_counter = 0;
+double Profiler::counter_frequency = 1.0;
+
+/**
+ * \brief Initializes the profiler.
+ *
+ * Profiling is enabled by the -profile command-line option.
+ * The Chrome trace is written to the file given as -profile=file,
+ * or to solarus_profile.json in the current directory by default.
+ *
+ * \param argc number of command line arguments
+ * \param argv command line arguments
+ */
+void Profiler::initialize(int argc, char** argv) {
+
+  // check the -profile option
+  const std::string option = "-profile";
+  for (argv++; argc > 1; argv++, argc--) {
+    const std::string arg = *argv;
+    if (arg == option) {
+      enabled = true;
+      trace_file_name = "solarus_profile.json";
+    }
+    else if (arg.find(option + "=") == 0) {
+      enabled = true;
+      trace_file_name = arg.substr(option.size() + 1);
+    }
+  }
+
+  SDL_AtomicSet(&nb_samples, 0);
+  if (!enabled) {
+    return;
+  }
+
+  Sample unused_sample = { NULL, 0, 0, 0 };
+  samples.assign(max_samples, unused_sample);
+  initial_counter = SDL_GetPerformanceCounter();
+  counter_frequency = SDL_GetPerformanceFrequency() / 1000.0;
+}
+
+/**
+ * \brief Writes the recorded timings and stops profiling.
+ */
+void Profiler::quit() {
+
+  if (!enabled) {
+    return;
+  }
+
+  save_trace();
+  enabled = false;
+  samples.clear();
+}
+
+/**
+ * \brief Returns whether profiling is enabled.
+ * \return true if timings are recorded
+ */
+bool Profiler::is_enabled() {
+  return enabled;
+}
+
+/**
+ * \brief Returns the current value of the high resolution counter.
+ * \return the performance counter
+ */
+uint64_t Profiler::get_counter() {
+  return SDL_GetPerformanceCounter();
+}
+
+/**
+ * \brief Stores a timing in the ring buffer.
+ *
+ * This function can be called from any thread: each call reserves its own
+ * slot with an atomic increment. When the buffer is full, the oldest
+ * timings are overwritten.
+ *
+ * \param name name of the section
+ * \param start performance counter at the start of the section
+ * \param end performance counter at the end of the section
+ */
+void Profiler::record(const char* name, uint64_t start, uint64_t end) {
+
+  const unsigned int index = (unsigned int) SDL_AtomicAdd(&nb_samples, 1);
+  Sample& sample = samples[index & (max_samples - 1)];
+  sample.start = start;
+  sample.end = end;
+  sample.thread_id = SDL_ThreadID();
+  SDL_MemoryBarrierRelease();  // Publish the timing before its name.
+  sample.name = name;
+}
+
+/**
+ * \brief Computes the statistics of each section over the last second.
+ *
+ * Timings being recorded by other threads during this call may be
+ * ignored.
+ *
+ * \param statistics the map to fill (section name -> statistics)
+ */
+void Profiler::get_statistics(std::map<std::string, Statistics>& statistics) {
+
+  statistics.clear();
+  if (!enabled) {
+    return;
+  }
+
+  const unsigned int last = (unsigned int) SDL_AtomicGet(&nb_samples);
+  const unsigned int nb_available = std::min(last, (unsigned int) max_samples);
+  const uint64_t now = get_counter();
+  const uint64_t period = (uint64_t) (counter_frequency * 1000.0);
+
+  // Walk the buffer backwards until we reach timings older than one second.
+  for (unsigned int i = 0; i < nb_available; i++) {
+    const Sample& sample = samples[(last - 1 - i) & (max_samples - 1)];
+    const char* name = sample.name;
+    if (name == NULL) {
+      continue;
+    }
+    SDL_MemoryBarrierAcquire();  // See the timing published with the name.
+    if (sample.end + period < now) {
+      break;
+    }
+
+    const double duration = (sample.end - sample.start) / counter_frequency;
+    std::map<std::string, Statistics>::iterator it = statistics.find(name);
+    if (it == statistics.end()) {
+      Statistics section = { 0, 0.0, 0.0 };
+      it = statistics.insert(std::make_pair(name, section)).first;
+    }
+    Statistics& section = it->second;
+    ++section.nb_calls;
+    section.average += duration;
+    section.max = std::max(section.max, duration);
+  }
+
+  std::map<std::string, Statistics>::iterator it;
+  for (it = statistics.begin(); it != statistics.end(); ++it) {
+    it->second.average /= it->second.nb_calls;
+  }
+}
+
+/**
+ * \brief Draws the timings of the last second as an overlay.
+ *
+ * Each section is a horizontal bar, in the alphabetical order of the section
+ * names: the filled part is the average duration and the tick is the
+ * maximum one, with one pixel per 0.1 millisecond.
+ * The white vertical line is the duration of one simulation step.
+ *
+ * \param dst_surface the surface to draw on
+ */
+void Profiler::draw(Surface& dst_surface) {
+
+  if (!enabled) {
+    return;
+  }
+
+  static Color* const colors[] = {
+      &Color::get_red(),
+      &Color::get_green(),
+      &Color::get_blue(),
+      &Color::get_yellow(),
+      &Color::get_magenta(),
+      &Color::get_cyan()
+  };
+  static const int nb_colors = sizeof(colors) / sizeof(colors[0]);
+  static const int pixels_per_ms = 10;
+  static const int bar_height = 3;
+  const int max_width = dst_surface.get_width() - 8;
+
+  std::map<std::string, Statistics> statistics;
+  get_statistics(statistics);
+
+  int y = 4;
+  int i = 0;
+  std::map<std::string, Statistics>::const_iterator it;
+  for (it = statistics.begin(); it != statistics.end(); ++it) {
+    const Statistics& section = it->second;
+    Color& color = *colors[i % nb_colors];
+    const int average_width = std::min(max_width,
+        std::max(1, (int) (section.average * pixels_per_ms)));
+    const int max_x = std::min(max_width,
+        (int) (section.max * pixels_per_ms));
+    dst_surface.fill_with_color(color, Rectangle(4, y, average_width, bar_height));
+    dst_surface.fill_with_color(color, Rectangle(4 + max_x, y - 1, 1, bar_height + 2));
+    y += bar_height + 3;
+    ++i;
+  }
+
+  const int budget_x = 4 + System::timestep * pixels_per_ms;
+  dst_surface.fill_with_color(Color::get_white(), Rectangle(budget_x, 2, 1, y - 2));
+}
+
+/**
+ * \brief Writes the content of the ring buffer in the Chrome trace format.
+ *
+ * The resulting file can be opened in chrome://tracing.
+ */
+void Profiler::save_trace() {
+
+  std::ofstream out(trace_file_name.c_str());
+  if (!out) {
+    Debug::warning(StringConcat() << "Cannot write the profiling file '"
+        << trace_file_name << "'");
+    return;
+  }
+
+  const unsigned int last = (unsigned int) SDL_AtomicGet(&nb_samples);
+  const unsigned int nb_available = std::min(last, (unsigned int) max_samples);
+  const double counter_frequency_us = counter_frequency / 1000.0;
+
+  out << "{\"traceEvents\":[";
+  bool first = true;
+  for (unsigned int i = last - nb_available; i != last; i++) {
+    const Sample& sample = samples[i & (max_samples - 1)];
+    const char* name = sample.name;
+    if (name == NULL) {
+      continue;
+    }
+    SDL_MemoryBarrierAcquire();
+    if (!first) {
+      out << ",";
+    }
+    first = false;
+    out << "\n{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1"
+        << ",\"tid\":" << sample.thread_id
+        << ",\"ts\":" << (uint64_t) ((sample.start - initial_counter) / counter_frequency_us)
+        << ",\"dur\":" << (uint64_t) ((sample.end - sample.start) / counter_frequency_us)
+        << "}";
+  }
+  out << "\n]}\n";
+}
+
@@ -18,11 +18,13 @@
 #include <ctime>
 #include <cstdlib>
 
+unsigned int Random::seed = 0;
+
 /**
  * \brief Initializes the random number generator.
  */
 void Random::initialize() {
-  srand((int) time(NULL));
+  set_seed((unsigned int) time(NULL));
 }
 
 /**
@@ -32,6 +34,28 @@ void Random::quit() {
   // nothing to do
 }
 
+/**
+ * \brief Returns the seed of the random number generator.
+ * \return the last seed set
+ */
+unsigned int Random::get_seed() {
+  return seed;
+}
+
+/**
+ * \brief Reinitializes the random number generator with a seed.
+ *
+ * The same seed always produces the same sequence of numbers,
+ * which allows to replay a session exactly.
+ *
+ * \param seed the new seed
+ */
+void Random::set_seed(unsigned int seed) {
+
+  Random::seed = seed;
+  srand(seed);
+}
+
 /**
  * \brief Returns a random integer number in [0, x[ with a uniform distribution.
  *
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lowlevel/RingBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+/**
+ * \brief Creates an empty ring buffer.
+ * \param capacity Maximum number of bytes that the buffer can hold.
+ */
+RingBuffer::RingBuffer(size_t capacity):
+  data(new char[capacity + 1]),
+  storage_size(capacity + 1) {
+
+  SDL_AtomicSet(&read_position, 0);
+  SDL_AtomicSet(&write_position, 0);
+}
+
+/**
+ * \brief Destructor.
+ */
+RingBuffer::~RingBuffer() {
+
+  delete[] data;
+}
+
+/**
+ * \brief Returns the maximum number of bytes that the buffer can hold.
+ * \return The capacity.
+ */
+size_t RingBuffer::get_capacity() const {
+  return storage_size - 1;
+}
+
+/**
+ * \brief Returns the number of bytes that can be read.
+ *
+ * The result is exact for the reader. For the writer, more bytes may be
+ * available already.
+ *
+ * \return The number of bytes written and not read yet.
+ */
+size_t RingBuffer::get_available_size() {
+
+  const size_t read_index = SDL_AtomicGet(&read_position);
+  const size_t write_index = SDL_AtomicGet(&write_position);
+  return (write_index + storage_size - read_index) % storage_size;
+}
+
+/**
+ * \brief Returns the number of bytes that can be written.
+ *
+ * The result is exact for the writer. For the reader, more space may be
+ * free already.
+ *
+ * \return The free space in bytes.
+ */
+size_t RingBuffer::get_free_size() {
+  return get_capacity() - get_available_size();
+}
+
+/**
+ * \brief Appends data to the buffer.
+ *
+ * This function must only be called by the writer thread.
+ *
+ * \param data The bytes to write.
+ * \param size Number of bytes to write.
+ * \return Number of bytes actually written: less than size if the buffer
+ * is full.
+ */
+size_t RingBuffer::write(const char* data, size_t size) {
+
+  size = std::min(size, get_free_size());
+  const size_t write_index = SDL_AtomicGet(&write_position);
+
+  // The data may wrap around the end of the storage.
+  const size_t first_part_size = std::min(size, storage_size - write_index);
+  std::memcpy(this->data + write_index, data, first_part_size);
+  std::memcpy(this->data, data + first_part_size, size - first_part_size);
+
+  // Publish the bytes only once they are copied.
+  SDL_AtomicSet(&write_position, int((write_index + size) % storage_size));
+  return size;
+}
+
+/**
+ * \brief Removes data from the beginning of the buffer.
+ *
+ * This function must only be called by the reader thread.
+ *
+ * \param data Destination of the bytes read.
+ * \param size Maximum number of bytes to read.
+ * \return Number of bytes actually read: less than size if not enough
+ * data is available.
+ */
+size_t RingBuffer::read(char* data, size_t size) {
+
+  size = std::min(size, get_available_size());
+  const size_t read_index = SDL_AtomicGet(&read_position);
+
+  const size_t first_part_size = std::min(size, storage_size - read_index);
+  std::memcpy(data, this->data + read_index, first_part_size);
+  std::memcpy(data + first_part_size, this->data, size - first_part_size);
+
+  // Give the space back only once the bytes are copied.
+  SDL_AtomicSet(&read_position, int((read_index + size) % storage_size));
+  return size;
+}
+
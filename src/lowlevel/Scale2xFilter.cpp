@@ -37,9 +37,70 @@ int Scale2xFilter::get_scaling_factor() const {
 }
 
 /**
- * \copydoc PixelFilter::filter
+ * \copydoc PixelFilter::filter_rows
  */
-void Scale2xFilter::filter(
+void Scale2xFilter::filter_rows(
+    const uint32_t* src,
+    int src_width,
+    int src_height,
+    uint32_t* dst,
+    int first_row,
+    int last_row) const {
+
+  const int dst_width = src_width * 2;
+
+  for (int row = first_row; row < last_row; row++) {
+
+    // Rows above and below (the border is repeated).
+    const uint32_t* line = src + row * src_width;
+    const uint32_t* above = (row == 0) ? line : line - src_width;
+    const uint32_t* below = (row == src_height - 1) ? line : line + src_width;
+    uint32_t* dst_top = dst + row * 2 * dst_width;
+    uint32_t* dst_bottom = dst_top + dst_width;
+
+    int col = 0;
+    if (src_width > 0) {
+      filter_pixel(above, line, below, src_width, col, dst_top, dst_bottom);
+      col++;
+    }
+
+#ifdef __SSE2__
+    // Pixels that are not on the left or right border: four at a time.
+    for (; col + 4 < src_width; col += 4) {
+
+      const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + col));
+      const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + col - 1));
+      const __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + col));
+      const __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + col + 1));
+      const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(below + col));
+
+      // Pixels where b == h or d == f are simply copied.
+      const __m128i copy = _mm_or_si128(_mm_cmpeq_epi32(b, h), _mm_cmpeq_epi32(d, f));
+
+      const __m128i e1 = select(_mm_andnot_si128(copy, _mm_cmpeq_epi32(d, b)), d, e);
+      const __m128i e2 = select(_mm_andnot_si128(copy, _mm_cmpeq_epi32(b, f)), f, e);
+      const __m128i e3 = select(_mm_andnot_si128(copy, _mm_cmpeq_epi32(d, h)), d, e);
+      const __m128i e4 = select(_mm_andnot_si128(copy, _mm_cmpeq_epi32(h, f)), f, e);
+
+      __m128i* top = reinterpret_cast<__m128i*>(dst_top + col * 2);
+      __m128i* bottom = reinterpret_cast<__m128i*>(dst_bottom + col * 2);
+      _mm_storeu_si128(top, _mm_unpacklo_epi32(e1, e2));
+      _mm_storeu_si128(top + 1, _mm_unpackhi_epi32(e1, e2));
+      _mm_storeu_si128(bottom, _mm_unpacklo_epi32(e3, e4));
+      _mm_storeu_si128(bottom + 1, _mm_unpackhi_epi32(e3, e4));
+    }
+#endif
+
+    for (; col < src_width; col++) {
+      filter_pixel(above, line, below, src_width, col, dst_top, dst_bottom);
+    }
+  }
+}
+
+/**
+ * \copydoc PixelFilter::filter_reference
+ */
+void Scale2xFilter::filter_reference(
     const uint32_t* src,
     int src_width,
     int src_height,
@@ -94,6 +155,59 @@ void Scale2xFilter::filter(
     }
     e1 += dst_width;
   }
+}
+
+/**
+ * \brief Applies the algorithm on one pixel.
+ * \param above The source row above the pixel.
+ * \param line The source row of the pixel.
+ * \param below The source row below the pixel.
+ * \param src_width Width of the source rows.
+ * \param col Column of the pixel.
+ * \param dst_top The first destination row of the pixel.
+ * \param dst_bottom The second destination row of the pixel.
+ */
+void Scale2xFilter::filter_pixel(
+    const uint32_t* above,
+    const uint32_t* line,
+    const uint32_t* below,
+    int src_width,
+    int col,
+    uint32_t* dst_top,
+    uint32_t* dst_bottom) {
+
+  const uint32_t b = above[col];
+  const uint32_t d = (col == 0) ? line[col] : line[col - 1];
+  const uint32_t e = line[col];
+  const uint32_t f = (col == src_width - 1) ? line[col] : line[col + 1];
+  const uint32_t h = below[col];
+
+  uint32_t* e1 = dst_top + col * 2;
+  uint32_t* e3 = dst_bottom + col * 2;
+  if (b != h && d != f) {
+    e1[0] = (d == b) ? d : e;
+    e1[1] = (b == f) ? f : e;
+    e3[0] = (d == h) ? d : e;
+    e3[1] = (h == f) ? f : e;
+  }
+  else {
+    e1[0] = e1[1] = e3[0] = e3[1] = e;
+  }
+}
+
+#ifdef __SSE2__
+/**
+ * \brief Chooses between two vectors of pixels.
+ * \param condition A mask: all bits of a pixel are set or unset.
+ * \param if_true Pixels to take where the mask is set.
+ * \param if_false Pixels to take where the mask is unset.
+ * \return The selected pixels.
+ */
+__m128i Scale2xFilter::select(__m128i condition, __m128i if_true, __m128i if_false) {
 
+  return _mm_or_si128(
+      _mm_and_si128(condition, if_true),
+      _mm_andnot_si128(condition, if_false));
 }
+#endif
 
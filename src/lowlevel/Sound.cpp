@@ -18,17 +18,21 @@
 #include <cmath>
 #include <sstream>
 #include <vector>
+#include <physfs.h>
 #include "lowlevel/Sound.h"
 #include "lowlevel/Music.h"
 #include "lowlevel/FileTools.h"
 #include "lowlevel/Debug.h"
 #include "lowlevel/StringConcat.h"
+#include "lowlevel/Profiler.h"
 #include "QuestResourceList.h"
 
 ALCdevice* Sound::device = NULL;
 ALCcontext* Sound::context = NULL;
 bool Sound::initialized = false;
 bool Sound::sounds_preloaded = false;
+bool Sound::lazy_loading = false;
+bool Sound::pcm_cache_enabled = false;
 float Sound::volume = 1.0;
 std::list<Sound*> Sound::current_sounds;
 std::map<std::string, Sound> Sound::all_sounds;
@@ -38,6 +42,12 @@ ov_callbacks Sound::ogg_callbacks = {
     NULL,
     NULL
 };
+ov_callbacks Sound::seekable_ogg_callbacks = {
+    cb_read,
+    cb_seek,
+    NULL,
+    cb_tell
+};
 
 /**
  * \brief Creates a new Ogg Vorbis sound.
@@ -76,17 +86,27 @@ Sound::~Sound() {
  * This method should be called when the application starts.
  * If the argument -no-audio is provided, this function has no effect and
  * there will be no sound.
+ * The options -lazy-sounds and -sound-cache change how sound effects are
+ * loaded (see load_all()).
  *
  * \param argc command-line arguments number
  * \param argv command-line arguments
  */
 void Sound::initialize(int argc, char** argv) {
 
-  // check the -no-audio option
+  // check the -no-audio, -lazy-sounds and -sound-cache options
   bool disable = false;
-  for (argv++; argc > 1 && !disable; argv++, argc--) {
-    const std::string arg = *argv;
-    disable = (arg.find("-no-audio") == 0);
+  for (int i = 1; i < argc && !disable; ++i) {
+    const std::string arg = argv[i];
+    if (arg.find("-no-audio") == 0) {
+      disable = true;
+    }
+    else if (arg == "-lazy-sounds") {
+      lazy_loading = true;
+    }
+    else if (arg == "-sound-cache") {
+      pcm_cache_enabled = true;
+    }
   }
   if (disable) {
     return;
@@ -120,7 +140,7 @@ void Sound::initialize(int argc, char** argv) {
   set_volume(100);
 
   // initialize the music system
-  Music::initialize();
+  Music::initialize(argc, argv);
 }
 
 /**
@@ -160,25 +180,102 @@ bool Sound::is_initialized() {
 
 /**
  * \brief Loads and decodes all sounds listed in the game database.
+ *
+ * With the option -lazy-sounds, this function does nothing: each sound
+ * is decoded the first time it is played, or by load_sounds().
  */
 void Sound::load_all() {
 
-  if (is_initialized() && !sounds_preloaded) {
+  if (is_initialized() && !sounds_preloaded && !lazy_loading) {
 
     const std::vector<QuestResourceList::Element>& sound_elements =
         QuestResourceList::get_elements(QuestResourceList::RESOURCE_SOUND);
+    std::vector<std::string> sound_ids;
+    sound_ids.reserve(sound_elements.size());
     std::vector<QuestResourceList::Element>::const_iterator it;
     for (it = sound_elements.begin(); it != sound_elements.end(); ++it) {
-      const std::string& sound_id = it->first;
+      sound_ids.push_back(it->first);
+    }
+
+    load_sounds(sound_ids);
+    sounds_preloaded = true;
+  }
+}
+
+/**
+ * \brief Loads and decodes some sounds in advance.
+ *
+ * The files are decoded in parallel by worker threads.
+ * Sounds already loaded are skipped.
+ *
+ * \param sound_ids Id of the sounds to load.
+ */
+void Sound::load_sounds(const std::vector<std::string>& sound_ids) {
+
+  if (!is_initialized()) {
+    return;
+  }
 
+  SOLARUS_PROFILE("Sound::load_sounds");
+
+  std::vector<std::string> sound_ids_to_load;
+  std::vector<std::string>::const_iterator it;
+  for (it = sound_ids.begin(); it != sound_ids.end(); ++it) {
+    const std::string& sound_id = *it;
+    if (all_sounds.count(sound_id) == 0) {
       all_sounds[sound_id] = Sound(sound_id);
-      all_sounds[sound_id].load();
     }
+    if (all_sounds[sound_id].buffer == AL_NONE) {
+      sound_ids_to_load.push_back(sound_id);
+    }
+  }
 
-    sounds_preloaded = true;
+  if (sound_ids_to_load.empty()) {
+    return;
+  }
+
+  // Decode the files in parallel, by batches to limit the memory used by
+  // decoded data that is not in OpenAL buffers yet.
+  WorkerPool workers(WorkerPool::get_default_nb_threads());
+  const size_t batch_size = (workers.get_nb_threads() + 1) * 4;
+  std::vector<DecodingJob> jobs;
+  std::vector<WorkerPool::Job*> job_pointers;
+  for (size_t first = 0; first < sound_ids_to_load.size(); first += batch_size) {
+
+    const size_t nb_jobs = std::min(batch_size, sound_ids_to_load.size() - first);
+    jobs.clear();
+    jobs.resize(nb_jobs);
+    job_pointers.resize(nb_jobs);
+    for (size_t i = 0; i < nb_jobs; ++i) {
+      jobs[i].file_name = get_file_name(sound_ids_to_load[first + i]);
+      jobs[i].sample_rate = 0;
+      jobs[i].success = false;
+      job_pointers[i] = &jobs[i];
+    }
+
+    workers.run(job_pointers);
+
+    // Only the main thread uses OpenAL.
+    for (size_t i = 0; i < nb_jobs; ++i) {
+      if (jobs[i].success) {
+        Sound& sound = all_sounds[sound_ids_to_load[first + i]];
+        sound.buffer = sound.create_buffer(
+            jobs[i].file_name, jobs[i].samples, jobs[i].sample_rate);
+      }
+    }
   }
 }
 
+/**
+ * \brief Decodes the sound file of this job.
+ *
+ * This function may be called from any thread.
+ */
+void Sound::DecodingJob::run() {
+
+  success = decode_file(file_name, samples, sample_rate);
+}
+
 /**
  * \brief Returns whether a sound exists.
  * \param sound_id id of the sound to test
@@ -284,17 +381,31 @@ void Sound::load() {
     Debug::error("Previous audio error not cleaned");
   }
 
-  std::string file_name = std::string("sounds/" + id);
-  if (id.find(".") == std::string::npos) {
-    file_name += ".ogg";
-  }
-
   // Create an OpenAL buffer with the sound decoded by the library.
-  buffer = decode_file(file_name);
+  const std::string& file_name = get_file_name(id);
+  std::vector<char> samples;
+  ALsizei sample_rate;
+  if (decode_file(file_name, samples, sample_rate)) {
+    buffer = create_buffer(file_name, samples, sample_rate);
+  }
 
   // buffer is now AL_NONE if there was an error.
 }
 
+/**
+ * \brief Returns the name of the file of a sound.
+ * \param sound_id Id of a sound.
+ * \return The file name, relative to the data directory.
+ */
+std::string Sound::get_file_name(const std::string& sound_id) {
+
+  std::string file_name = std::string("sounds/" + sound_id);
+  if (sound_id.find(".") == std::string::npos) {
+    file_name += ".ogg";
+  }
+  return file_name;
+}
+
 /**
  * \brief Plays the sound.
  * \return true if the sound was loaded successfully, false otherwise
@@ -344,17 +455,26 @@ bool Sound::start() {
 }
 
 /**
- * \brief Loads the specified sound file and decodes its content into an OpenAL buffer.
+ * \brief Loads the specified sound file and decodes its content into memory.
+ *
+ * The PCM cache is used if it is enabled.
+ * This function does not use OpenAL and may be called from any thread.
+ *
  * \param file_name name of the file to open
- * \return the buffer created, or AL_NONE if the sound could not be loaded
+ * \param samples the decoded 16-bit stereo samples
+ * \param sample_rate the sample rate of the decoded samples
+ * \return false if the sound could not be loaded
  */
-ALuint Sound::decode_file(const std::string& file_name) {
-
-  ALuint buffer = AL_NONE;
+bool Sound::decode_file(const std::string& file_name,
+    std::vector<char>& samples, ALsizei& sample_rate) {
 
   if (!FileTools::data_file_exists(file_name)) {
     Debug::error(StringConcat() << "Cannot find sound file '" << file_name << "'");
-    return AL_NONE;
+    return false;
+  }
+
+  if (read_pcm_cache(file_name, samples, sample_rate)) {
+    return true;
   }
 
   // load the sound file
@@ -363,8 +483,9 @@ ALuint Sound::decode_file(const std::string& file_name) {
   mem.position = 0;
   FileTools::data_file_open_buffer(file_name, &mem.data, &mem.size);
 
+  bool success = false;
   OggVorbis_File file;
-  int error = ov_open_callbacks(&mem, &file, NULL, 0, ogg_callbacks);
+  int error = ov_open_callbacks(&mem, &file, NULL, 0, seekable_ogg_callbacks);
 
   if (error) {
     Debug::error(StringConcat() << "Cannot load sound file '" << file_name
@@ -374,76 +495,210 @@ ALuint Sound::decode_file(const std::string& file_name) {
 
     // read the encoded sound properties
     vorbis_info* info = ov_info(&file, -1);
-    ALsizei sample_rate = ALsizei(info->rate);
+    sample_rate = ALsizei(info->rate);
 
-    ALenum format = AL_NONE;
-    if (info->channels == 1) {
-      format = AL_FORMAT_MONO16;
-    }
-    else if (info->channels == 2) {
-      format = AL_FORMAT_STEREO16;
-    }
-
-    if (format == AL_NONE) {
+    if (info->channels != 1 && info->channels != 2) {
       Debug::error(StringConcat() << "Invalid audio format for sound file '"
           << file_name << "'");
     }
     else {
-      // decode the sound with vorbisfile
-      std::vector<char> samples;
+      // allocate the decoded data once: the total length is known,
+      // and mono sounds will be converted to stereo in place
+      const size_t frame_size = info->channels * 2;
+      const ogg_int64_t nb_frames = ov_pcm_total(&file, -1);
+      samples.clear();
+      if (nb_frames > 0) {
+        samples.reserve(size_t(nb_frames) * 4 + 4096);
+        samples.resize(size_t(nb_frames) * frame_size);
+      }
+
+      // decode the sound with vorbisfile, directly into the samples
       int bitstream;
       long bytes_read;
-      long total_bytes_read = 0;
-      const int buffer_size = 4096;
-      char samples_buffer[buffer_size];
+      size_t total_bytes_read = 0;
       do {
-        bytes_read = ov_read(&file, samples_buffer, buffer_size, 0, 2, 1, &bitstream);
+        if (total_bytes_read == samples.size()) {
+          // end of the file or unknown length: make some room,
+          // without reallocating if possible
+          if (samples.capacity() > samples.size()) {
+            samples.resize(samples.capacity());
+          }
+          else {
+            samples.resize(samples.size() + std::max(samples.size() / 2, size_t(65536)));
+          }
+        }
+        bytes_read = ov_read(&file, &samples[total_bytes_read],
+            int(std::min(samples.size() - total_bytes_read, size_t(1 << 20))),
+            0, 2, 1, &bitstream);
         if (bytes_read < 0) {
           Debug::error(StringConcat() << "Error while decoding ogg chunk in sound file '"
               << file_name << "': " << bytes_read);
         }
         else {
           total_bytes_read += bytes_read;
-          if (format == AL_FORMAT_STEREO16) {
-            samples.insert(samples.end(), samples_buffer, samples_buffer + bytes_read);
-          }
-          else {
-            // mono sound files make no sound on some machines
-            // workaround: convert them on-the-fly into stereo sounds
-            // TODO find a better solution
-            for (int i = 0; i < bytes_read; i += 2) {
-              samples.insert(samples.end(), samples_buffer + i, samples_buffer + i + 2);
-              samples.insert(samples.end(), samples_buffer + i, samples_buffer + i + 2);
-            }
-            total_bytes_read += bytes_read;
-          }
         }
       }
       while (bytes_read > 0);
-
-      // copy the samples into an OpenAL buffer
-      alGenBuffers(1, &buffer);
-      if (alGetError() != AL_NO_ERROR) {
-          Debug::error("Failed to generate audio buffer");
-      }
-      alBufferData(buffer,
-          AL_FORMAT_STEREO16,
-          reinterpret_cast<ALshort*>(&samples[0]),
-          ALsizei(total_bytes_read),
-          sample_rate);
-      ALenum error = alGetError();
-      if (error != AL_NO_ERROR) {
-        Debug::error(StringConcat() << "Cannot copy the sound samples of '"
-            << file_name << "' into buffer " << buffer
-            << ": error " << error);
-        buffer = AL_NONE;
+      samples.resize(total_bytes_read);
+
+      if (info->channels == 1) {
+        // mono sound files make no sound on some machines
+        // workaround: convert them into stereo sounds
+        // TODO find a better solution
+        const size_t nb_mono_samples = samples.size() / 2;
+        samples.resize(nb_mono_samples * 4);
+        int16_t* data = reinterpret_cast<int16_t*>(&samples[0]);
+        for (size_t i = nb_mono_samples; i > 0; --i) {
+          // going backwards, the mono samples are not overwritten before being read
+          data[2 * i - 1] = data[2 * i - 2] = data[i - 1];
+        }
       }
+      success = true;
     }
     ov_clear(&file);
   }
 
   FileTools::data_file_close_buffer(mem.data);
 
+  if (success) {
+    write_pcm_cache(file_name, samples, sample_rate);
+  }
+
+  return success;
+}
+
+/**
+ * \brief Reads the decoded data of a sound file from the PCM cache.
+ *
+ * This function may be called from any thread.
+ *
+ * \param file_name name of the sound file
+ * \param samples the decoded 16-bit stereo samples
+ * \param sample_rate the sample rate of the decoded samples
+ * \return false if the cache is disabled or has no valid data for this file
+ */
+bool Sound::read_pcm_cache(const std::string& file_name,
+    std::vector<char>& samples, ALsizei& sample_rate) {
+
+  if (!pcm_cache_enabled || FileTools::get_quest_write_dir().empty()) {
+    return false;
+  }
+
+  const std::string cache_file_name = "sound_cache/" + file_name + ".pcm";
+  if (!FileTools::data_file_exists(cache_file_name)) {
+    return false;
+  }
+
+  char* buffer;
+  size_t size;
+  FileTools::data_file_open_buffer(cache_file_name, &buffer, &size);
+
+  // check that the cached data corresponds to the current sound file
+  PcmCacheHeader header;
+  bool valid = size >= sizeof(header);
+  if (valid) {
+    std::memcpy(&header, buffer, sizeof(header));
+    valid = std::memcmp(header.magic, "SPCM", 4) == 0
+        && header.modification_time == FileTools::data_file_get_modification_time(file_name)
+        && size == sizeof(header) + header.size;
+  }
+
+  if (valid) {
+    samples.assign(buffer + sizeof(header), buffer + size);
+    sample_rate = ALsizei(header.sample_rate);
+  }
+  FileTools::data_file_close_buffer(buffer);
+
+  return valid;
+}
+
+/**
+ * \brief Saves the decoded data of a sound file into the PCM cache.
+ *
+ * Nothing is done if the cache is disabled.
+ * Errors are ignored: the sound will just be decoded again next time.
+ * This function may be called from any thread.
+ *
+ * \param file_name name of the sound file
+ * \param samples the decoded 16-bit stereo samples
+ * \param sample_rate the sample rate of the decoded samples
+ */
+void Sound::write_pcm_cache(const std::string& file_name,
+    const std::vector<char>& samples, ALsizei sample_rate) {
+
+  if (!pcm_cache_enabled || FileTools::get_quest_write_dir().empty()) {
+    return;
+  }
+
+  PcmCacheHeader header;
+  std::memcpy(header.magic, "SPCM", 4);
+  header.modification_time = FileTools::data_file_get_modification_time(file_name);
+  header.sample_rate = uint32_t(sample_rate);
+  header.size = uint32_t(samples.size());
+  if (header.modification_time == -1) {
+    // cannot tell later if the cached data is still valid
+    return;
+  }
+
+  const std::string cache_file_name = "sound_cache/" + file_name + ".pcm";
+  FileTools::data_file_mkdir(cache_file_name.substr(0, cache_file_name.rfind('/')));
+
+  // the cache is optional: unlike data_file_save_buffer(), don't stop the
+  // program if the file cannot be written (e.g. the disk is full)
+  PHYSFS_file* file = PHYSFS_openWrite(cache_file_name.c_str());
+  if (file == NULL) {
+    return;
+  }
+
+  bool success = PHYSFS_write(file, &header, sizeof(header), 1) == 1;
+  if (success && !samples.empty()) {
+    success = PHYSFS_write(file, &samples[0], PHYSFS_uint32(samples.size()), 1) == 1;
+  }
+  PHYSFS_close(file);
+
+  if (!success) {
+    // don't leave a truncated file (it would be rejected anyway)
+    PHYSFS_delete(cache_file_name.c_str());
+  }
+}
+
+/**
+ * \brief Copies decoded samples into a new OpenAL buffer.
+ *
+ * This function must be called from the main thread.
+ *
+ * \param file_name name of the sound file (for error messages)
+ * \param samples the decoded 16-bit stereo samples
+ * \param sample_rate the sample rate of the decoded samples
+ * \return the buffer created, or AL_NONE in case of error
+ */
+ALuint Sound::create_buffer(const std::string& file_name,
+    const std::vector<char>& samples, ALsizei sample_rate) {
+
+  if (samples.empty()) {
+    Debug::error(StringConcat() << "Sound file '" << file_name << "' is empty");
+    return AL_NONE;
+  }
+
+  // copy the samples into an OpenAL buffer
+  ALuint buffer = AL_NONE;
+  alGenBuffers(1, &buffer);
+  if (alGetError() != AL_NO_ERROR) {
+      Debug::error("Failed to generate audio buffer");
+  }
+  alBufferData(buffer,
+      AL_FORMAT_STEREO16,
+      reinterpret_cast<const ALshort*>(&samples[0]),
+      ALsizei(samples.size()),
+      sample_rate);
+  ALenum error = alGetError();
+  if (error != AL_NO_ERROR) {
+    Debug::error(StringConcat() << "Cannot copy the sound samples of '"
+        << file_name << "' into buffer " << buffer
+        << ": error " << error);
+    buffer = AL_NONE;
+  }
+
   return buffer;
 }
 
@@ -480,3 +735,57 @@ size_t Sound::cb_read(void* ptr, size_t size, size_t nb_bytes, void* datasource)
   return nb_bytes;
 }
 
+/**
+ * \brief Moves the position in an encoded sound loaded in memory.
+ *
+ * This function respects the prototype specified by libvorbisfile.
+ *
+ * \param datasource source of the data to read
+ * \param offset the new position relative to whence
+ * \param whence SEEK_SET, SEEK_CUR or SEEK_END
+ * \return 0 in case of success, -1 otherwise
+ */
+int Sound::cb_seek(void* datasource, ogg_int64_t offset, int whence) {
+
+  SoundFromMemory* mem = (SoundFromMemory*) datasource;
+
+  ogg_int64_t position;
+  switch (whence) {
+
+    case SEEK_SET:
+      position = offset;
+      break;
+
+    case SEEK_CUR:
+      position = ogg_int64_t(mem->position) + offset;
+      break;
+
+    case SEEK_END:
+      position = ogg_int64_t(mem->size) + offset;
+      break;
+
+    default:
+      return -1;
+  }
+
+  if (position < 0 || position > ogg_int64_t(mem->size)) {
+    return -1;
+  }
+
+  mem->position = size_t(position);
+  return 0;
+}
+
+/**
+ * \brief Returns the position in an encoded sound loaded in memory.
+ *
+ * This function respects the prototype specified by libvorbisfile.
+ *
+ * \param datasource source of the data to read
+ * \return the current position in bytes
+ */
+long Sound::cb_tell(void* datasource) {
+
+  SoundFromMemory* mem = (SoundFromMemory*) datasource;
+  return long(mem->position);
+}
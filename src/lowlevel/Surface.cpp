@@ -18,11 +18,15 @@
 #include "lowlevel/Color.h"
 #include "lowlevel/Rectangle.h"
 #include "lowlevel/FileTools.h"
+#include "lowlevel/ImageCache.h"
 #include "lowlevel/Debug.h"
 #include "lowlevel/StringConcat.h"
+#include "lowlevel/System.h"
 #include "lua/LuaContext.h"
 #include "Transition.h"
 #include <SDL_image.h>
+#include <algorithm>
+#include <iostream>
 
 /**
  * \brief Creates a surface with the specified size.
@@ -33,6 +37,7 @@ Surface::Surface(int width, int height):
   Drawable(),
   internal_surface(NULL),
   owns_internal_surface(true),
+  cached_internal_surface(false),
   with_colorkey(false),
   colorkey(0) {
 
@@ -51,6 +56,7 @@ Surface::Surface(const Rectangle& size):
   Drawable(),
   internal_surface(NULL),
   owns_internal_surface(true),
+  cached_internal_surface(false),
   with_colorkey(false),
   colorkey(0) {
 
@@ -72,28 +78,15 @@ Surface::Surface(const std::string& file_name, ImageDirectory base_directory):
   Drawable(),
   internal_surface(NULL),
   owns_internal_surface(true),
+  cached_internal_surface(false),
   with_colorkey(false),
   colorkey(0) {
 
-  std::string prefix = "";
-  bool language_specific = false;
+  bool language_specific;
+  const std::string& prefixed_file_name =
+      get_prefixed_file_name(file_name, base_directory, language_specific);
 
-  if (base_directory == DIR_SPRITES) {
-    prefix = "sprites/";
-  }
-  else if (base_directory == DIR_LANGUAGE) {
-    language_specific = true;
-    prefix = "images/";
-  }
-  std::string prefixed_file_name = prefix + file_name;
-
-  size_t size;
-  char* buffer;
-  FileTools::data_file_open_buffer(prefixed_file_name, &buffer, &size, language_specific);
-  SDL_RWops* rw = SDL_RWFromMem(buffer, int(size));
-  this->internal_surface = IMG_Load_RW(rw, 0);
-  FileTools::data_file_close_buffer(buffer);
-  SDL_RWclose(rw);
+  this->internal_surface = load_image(prefixed_file_name, language_specific);
 
   Debug::check_assertion(internal_surface != NULL, StringConcat() <<
       "Cannot load image '" << prefixed_file_name << "'");
@@ -115,6 +108,7 @@ Surface::Surface(SDL_Surface* internal_surface):
   Drawable(),
   internal_surface(internal_surface),
   owns_internal_surface(false),
+  cached_internal_surface(false),
   with_colorkey(false),
   colorkey(0) {
 
@@ -135,6 +129,7 @@ Surface::Surface(Surface& other):
   Drawable(),
   internal_surface(other.internal_surface),
   owns_internal_surface(other.owns_internal_surface),
+  cached_internal_surface(other.cached_internal_surface),
   with_colorkey(other.with_colorkey),
   colorkey(other.colorkey) {
 
@@ -147,7 +142,12 @@ Surface::Surface(Surface& other):
 Surface::~Surface() {
 
   if (owns_internal_surface) {
-    SDL_FreeSurface(internal_surface);
+    if (cached_internal_surface) {
+      ImageCache::release_image(internal_surface);
+    }
+    else {
+      SDL_FreeSurface(internal_surface);
+    }
   }
 }
 
@@ -164,8 +164,67 @@ Surface::~Surface() {
 Surface* Surface::create_from_file(const std::string& file_name,
     ImageDirectory base_directory) {
 
+  bool language_specific;
+  const std::string& prefixed_file_name =
+      get_prefixed_file_name(file_name, base_directory, language_specific);
+
+  if (!FileTools::data_file_exists(prefixed_file_name, language_specific)) {
+    // File not found.
+    return NULL;
+  }
+
+  SDL_Surface* internal_surface = load_image(prefixed_file_name, language_specific);
+
+  if (internal_surface == NULL) {
+    // Not a valid image.
+    return NULL;
+  }
+
+  Surface* surface = new Surface(internal_surface);
+  surface->owns_internal_surface = true;
+  return surface;
+}
+
+/**
+ * \brief Creates a surface that shares the pixels of an image file with
+ * the other surfaces created from the same file.
+ *
+ * The image is decoded only once and kept in the ImageCache.
+ * Use this for images that are only drawn from, like sprite sheets,
+ * tilesets and bitmap fonts: the surface returned must not be modified.
+ * An assertion error occurs if the file cannot be loaded.
+ *
+ * \param file_name Name of the image file to load, relative to the base directory specified.
+ * \param base_directory The base directory to use.
+ * \return The surface created.
+ */
+Surface* Surface::create_from_cache(const std::string& file_name,
+    ImageDirectory base_directory) {
+
+  bool language_specific;
+  const std::string& prefixed_file_name =
+      get_prefixed_file_name(file_name, base_directory, language_specific);
+
+  Surface* surface = new Surface(
+      ImageCache::get_image(prefixed_file_name, language_specific));
+  surface->owns_internal_surface = true;
+  surface->cached_internal_surface = true;
+  return surface;
+}
+
+/**
+ * \brief Returns the name of an image file relative to the data directory.
+ * \param file_name Name of the image file, relative to the base directory specified.
+ * \param base_directory The base directory to use.
+ * \param language_specific Set to true if the file is specific to the
+ * current language.
+ * \return The file name relative to the data directory.
+ */
+std::string Surface::get_prefixed_file_name(const std::string& file_name,
+    ImageDirectory base_directory, bool& language_specific) {
+
   std::string prefix;
-  bool language_specific = false;
+  language_specific = false;
 
   if (base_directory == DIR_SPRITES) {
     prefix = "sprites/";
@@ -174,29 +233,228 @@ Surface* Surface::create_from_file(const std::string& file_name,
     language_specific = true;
     prefix = "images/";
   }
-  std::string prefixed_file_name = prefix + file_name;
+  return prefix + file_name;
+}
 
-  if (!FileTools::data_file_exists(prefixed_file_name, language_specific)) {
-    // File not found.
-    return NULL;
-  }
+/**
+ * \brief Decodes an image file and converts it to the pixel format used
+ * for drawing.
+ * \param prefixed_file_name Name of the image file, relative to the data directory.
+ * \param language_specific true if the file is specific to the current language.
+ * \return The image, or NULL if the file is not a valid image.
+ */
+SDL_Surface* Surface::load_image(const std::string& prefixed_file_name,
+    bool language_specific) {
 
   size_t size;
   char* buffer;
   FileTools::data_file_open_buffer(prefixed_file_name, &buffer, &size, language_specific);
   SDL_RWops* rw = SDL_RWFromMem(buffer, int(size));
-  SDL_Surface* internal_surface = IMG_Load_RW(rw, 0);
+  SDL_Surface* image = IMG_Load_RW(rw, 0);
   FileTools::data_file_close_buffer(buffer);
   SDL_RWclose(rw);
 
-  if (internal_surface == NULL) {
-    // Not a valid image.
+  if (image == NULL) {
     return NULL;
   }
 
-  Surface* surface = new Surface(internal_surface);
-  surface->owns_internal_surface = true;
-  return surface;
+  return convert_to_display_format(image);
+}
+
+/**
+ * \brief Converts an image to the pixel format of the surfaces it is
+ * drawn on.
+ *
+ * Paletted and 24-bit images would otherwise go through SDL's slow generic
+ * blitter each time they are drawn.
+ * Images with an alpha channel are converted to 32-bit ARGB to keep their
+ * transparency. Other images get the format of the quest surfaces and keep
+ * their colorkey.
+ *
+ * \param image An image just decoded. It is freed by this function.
+ * \return The converted image, or the image itself if it already has the
+ * right format or cannot be converted.
+ */
+SDL_Surface* Surface::convert_to_display_format(SDL_Surface* image) {
+
+  SDL_PixelFormat* format = image->format;
+  bool with_alpha = format->Amask != 0;
+  if (format->palette != NULL) {
+    // Paletted images store their transparency in the palette.
+    uint32_t colorkey;
+    bool has_colorkey = SDL_GetColorKey(image, &colorkey) == 0;
+    for (int i = 0; i < format->palette->ncolors && !with_alpha; i++) {
+      if (format->palette->colors[i].a != 255
+          && !(has_colorkey && colorkey == uint32_t(i))) {
+        with_alpha = true;
+      }
+    }
+  }
+
+  SDL_Surface* converted;
+  if (with_alpha) {
+    if (format->format == SDL_PIXELFORMAT_ARGB8888) {
+      return image;
+    }
+    converted = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_ARGB8888, 0);
+  }
+  else {
+    const SDL_PixelFormat* display_format = Color::format_surface->format;
+    if (format->format == display_format->format) {
+      return image;
+    }
+    converted = SDL_ConvertSurface(image, display_format, 0);
+  }
+
+  if (converted == NULL) {
+    // Keep the original format.
+    return image;
+  }
+
+  SDL_FreeSurface(image);
+  return converted;
+}
+
+/**
+ * \brief Measures how many images per second can be drawn depending on
+ * their pixel format, before and after their conversion at load time.
+ *
+ * This is done at the end of the benchmark mode.
+ * A sprite with transparent holes is generated in the pixel formats that
+ * image files usually have, and drawn repeatedly on a quest surface.
+ * The converted image is also measured with run-length encoding, like
+ * images of the image cache.
+ */
+void Surface::run_blits_benchmark() {
+
+  const uint32_t pixel_formats[] = {
+      SDL_PIXELFORMAT_INDEX8,
+      SDL_PIXELFORMAT_RGB24,
+      SDL_PIXELFORMAT_ABGR8888
+  };
+  const char* pixel_format_names[] = {
+      "8-bit paletted",
+      "24-bit",
+      "32-bit with alpha"
+  };
+
+  Surface dst_surface(320, 240);
+  for (int i = 0; i < 3; ++i) {
+
+    SDL_Surface* image = create_benchmark_image(pixel_formats[i]);
+    if (image == NULL) {
+      Debug::error(StringConcat() << "Cannot create a " << pixel_format_names[i]
+          << " image: " << SDL_GetError());
+      continue;
+    }
+    const double before = measure_blits(image, dst_surface.internal_surface);
+
+    // convert_to_display_format() frees the image it converts.
+    SDL_Surface* copy = SDL_ConvertSurface(image, image->format, 0);
+    if (copy == NULL) {
+      Debug::error(StringConcat() << "Cannot copy a " << pixel_format_names[i]
+          << " image: " << SDL_GetError());
+      SDL_FreeSurface(image);
+      continue;
+    }
+    SDL_Surface* converted = convert_to_display_format(copy);
+    const double after = measure_blits(converted, dst_surface.internal_surface);
+    SDL_SetSurfaceRLE(converted, 1);
+    const double after_rle = measure_blits(converted, dst_surface.internal_surface);
+
+    std::cout << "  blits/s (" << pixel_format_names[i] << " image): "
+        << before << " before conversion, "
+        << after << " converted, "
+        << after_rle << " converted with RLE" << std::endl;
+
+    SDL_FreeSurface(converted);
+    SDL_FreeSurface(image);
+  }
+}
+
+/**
+ * \brief Creates a 64x64 image with transparent holes for the blits
+ * benchmark.
+ *
+ * Holes are made of transparent pixels if the format has an alpha channel,
+ * and of a colorkey otherwise, like in image files.
+ *
+ * \param pixel_format Pixel format of the image to create.
+ * \return The image created, or NULL in case of error.
+ */
+SDL_Surface* Surface::create_benchmark_image(uint32_t pixel_format) {
+
+  const int size = 64;
+  int bpp;
+  uint32_t r_mask, g_mask, b_mask, a_mask;
+  if (!SDL_PixelFormatEnumToMasks(pixel_format, &bpp,
+      &r_mask, &g_mask, &b_mask, &a_mask)) {
+    return NULL;
+  }
+  SDL_Surface* image = SDL_CreateRGBSurface(
+      SDL_SWSURFACE, size, size, bpp, r_mask, g_mask, b_mask, a_mask);
+  if (image == NULL) {
+    return NULL;
+  }
+
+  // Color 0 is the transparent one.
+  const int nb_colors = 16;
+  SDL_Color colors[nb_colors];
+  for (int i = 0; i < nb_colors; ++i) {
+    colors[i].r = uint8_t(i * 16);
+    colors[i].g = uint8_t(255 - i * 16);
+    colors[i].b = uint8_t(i * 64);
+    colors[i].a = 255;
+  }
+  colors[0].r = 255;
+  colors[0].g = 0;
+  colors[0].b = 255;
+  if (image->format->palette != NULL) {
+    SDL_SetPaletteColors(image->format->palette, colors, 0, nb_colors);
+  }
+  const bool with_alpha = a_mask != 0;
+
+  SDL_Rect pixel = { 0, 0, 1, 1 };
+  for (pixel.y = 0; pixel.y < size; ++pixel.y) {
+    for (pixel.x = 0; pixel.x < size; ++pixel.x) {
+      int index = 1 + (pixel.x / 8 + pixel.y / 8) % (nb_colors - 1);
+      if (pixel.x % 16 < 4 || pixel.y % 16 < 4) {
+        index = 0;
+      }
+      const SDL_Color& color = colors[index];
+      const uint8_t alpha = (with_alpha && index == 0) ? 0 : 255;
+      SDL_FillRect(image, &pixel,
+          SDL_MapRGBA(image->format, color.r, color.g, color.b, alpha));
+    }
+  }
+
+  if (!with_alpha) {
+    SDL_SetColorKey(image, SDL_TRUE,
+        SDL_MapRGB(image->format, colors[0].r, colors[0].g, colors[0].b));
+  }
+  return image;
+}
+
+/**
+ * \brief Draws an image many times and measures the speed.
+ * \param image The image to draw.
+ * \param dst_surface The surface to draw on.
+ * \return The number of blits per second.
+ */
+double Surface::measure_blits(SDL_Surface* image, SDL_Surface* dst_surface) {
+
+  const int nb_blits = 5000;
+  const int max_x = std::max(1, dst_surface->w - image->w);
+  const int max_y = std::max(1, dst_surface->h - image->h);
+
+  const double start_date = System::get_precise_real_time();
+  for (int i = 0; i < nb_blits; ++i) {
+    SDL_Rect dst_position = { (i * 37) % max_x, (i * 23) % max_y, 0, 0 };
+    SDL_BlitSurface(image, NULL, dst_surface, &dst_position);
+  }
+  const double duration = (System::get_precise_real_time() - start_date) / 1000.0;
+
+  return duration > 0.0 ? nb_blits / duration : 0.0;
 }
 
 /**
@@ -18,11 +18,14 @@
 #include "lowlevel/FileTools.h"
 #include "lowlevel/VideoManager.h"
 #include "lowlevel/Color.h"
+#include "lowlevel/ImageCache.h"
 #include "lowlevel/TextSurface.h"
 #include "lowlevel/Sound.h"
 #include "lowlevel/Random.h"
 #include "lowlevel/InputEvent.h"
+#include "lowlevel/Profiler.h"
 #include "Sprite.h"
+#include "entities/TilesetCache.h"
 #include <SDL.h>
 #ifdef SOLARUS_USE_APPLE_POOL 
 #  include "lowlevel/apple/AppleInterface.h"
@@ -49,12 +52,17 @@ void System::initialize(int argc, char** argv) {
   // initialize SDL
   SDL_Init(SDL_INIT_VIDEO | SDL_INIT_JOYSTICK);
 
+  // profiling
+  Profiler::initialize(argc, argv);
+
   // files
   FileTools::initialize(argc, argv);
 
   // video
   VideoManager::initialize(argc, argv);
   Color::initialize();
+  ImageCache::initialize();
+  TilesetCache::initialize(argc, argv);
   TextSurface::initialize();
   Sprite::initialize();
 
@@ -80,9 +88,12 @@ void System::quit() {
   Sound::quit();
   Sprite::quit();
   TextSurface::quit();
+  TilesetCache::quit();
+  ImageCache::quit();
   Color::quit();
   VideoManager::quit();
   FileTools::quit();
+  Profiler::quit();
 
   SDL_Quit();
 #ifdef SOLARUS_USE_APPLE_POOL 
@@ -99,6 +110,8 @@ void System::update() {
 
   // Use a constant timestep here to have deterministic updates.
   ticks += timestep;
+
+  SOLARUS_PROFILE("Sound::update");
   Sound::update();
 }
 
@@ -129,6 +142,18 @@ uint32_t System::get_real_time() {
   return SDL_GetTicks();
 }
 
+/**
+ * \brief Returns the real time with a sub-millisecond precision.
+ *
+ * Only differences between two calls are meaningful.
+ * This function is not deterministic, so use it at your own risks.
+ *
+ * \return The value of the high resolution counter in milliseconds.
+ */
+double System::get_precise_real_time() {
+  return SDL_GetPerformanceCounter() * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
 /**
  * \brief Makes the program sleep during some time.
  *
@@ -133,7 +133,7 @@ int TextSurface::l_font(lua_State* l) {
 
   if (extension == ".png" || extension == ".PNG") {
     // It's a bitmap font.
-    fonts[font_id].bitmap = new Surface(file_name, Surface::DIR_DATA);
+    fonts[font_id].bitmap = Surface::create_from_cache(file_name, Surface::DIR_DATA);
   }
   else {
     // It's a normal font.
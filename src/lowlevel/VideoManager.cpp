@@ -19,9 +19,15 @@
 #include "lowlevel/Color.h"
 #include "lowlevel/Scale2xFilter.h"
 #include "lowlevel/Hq4xFilter.h"
+#include "lowlevel/WorkerPool.h"
 #include "lowlevel/FileTools.h"
 #include "lowlevel/Debug.h"
 #include "lowlevel/StringConcat.h"
+#include "lowlevel/Profiler.h"
+#include "lowlevel/System.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
 #include <vector>
 
 VideoManager* VideoManager::instance = NULL;
@@ -60,7 +66,8 @@ const std::string VideoManager::video_mode_names[] = {
  * \brief Initializes the video system and creates the window.
  *
  * This method should be called when the application starts.
- * Options "-no-video" and "-quest-size=<width>x<height>" are recognized.
+ * Options "-no-video", "-render-thread" and "-quest-size=<width>x<height>"
+ * are recognized.
  *
  * \param argc Command-line arguments number.
  * \param argv Command-line arguments.
@@ -68,14 +75,18 @@ const std::string VideoManager::video_mode_names[] = {
 void VideoManager::initialize(int argc, char **argv) {
   // TODO pass options as an std::set<string> instead.
 
-  // check the -no-video and the -quest-size options.
+  // check the -no-video, -render-thread and -quest-size options.
   bool disable = false;
+  bool pipelined = false;
   std::string quest_size_string;
   for (argv++; argc > 1; argv++, argc--) {
     const std::string arg = *argv;
     if (arg == "-no-video") {
       disable = true;
     }
+    else if (arg == "-render-thread") {
+      pipelined = true;
+    }
     else if (arg.find("-quest-size=") == 0) {
       quest_size_string = arg.substr(12);
     }
@@ -90,7 +101,7 @@ void VideoManager::initialize(int argc, char **argv) {
     }
   }
   
-  instance = new VideoManager(disable, wanted_quest_size);
+  instance = new VideoManager(disable, pipelined, wanted_quest_size);
 }
 
 /**
@@ -111,10 +122,12 @@ VideoManager* VideoManager::get_instance() {
 /**
  * \brief Constructor.
  * \brief disable_window true to entirely disable the displaying.
+ * \param pipelined true to prepare frames in a separate render thread.
  * \param wanted_quest_size Size of the quest as requested by the user.
  */
 VideoManager::VideoManager(
     bool disable_window,
+    bool pipelined,
     const Rectangle& wanted_quest_size):
   disable_window(disable_window),
   main_window(NULL),
@@ -122,9 +135,25 @@ VideoManager::VideoManager(
   screen_texture(NULL),
   pixel_filter(NULL),
   scaled_surface(NULL),
+  pixel_filter_workers(NULL),
+  full_redraw_needed(true),
+  render_thread(NULL),
+  render_frame_ready(NULL),
+  render_frame_done(NULL),
+  render_thread_stopping(false),
+  render_frame_row_size(0),
+  render_first_row(0),
+  render_last_row(0),
   outset_title(std::string("Solarus ") + SOLARUS_VERSION),
   video_mode(NO_MODE),
   wanted_quest_size(wanted_quest_size) {
+
+  if (!disable_window) {
+    pixel_filter_workers = new WorkerPool(WorkerPool::get_default_nb_threads());
+    if (pipelined) {
+      start_render_thread();
+    }
+  }
 }
 
 /**
@@ -132,11 +161,14 @@ VideoManager::VideoManager(
  */
 VideoManager::~VideoManager() {
 
+  stop_render_thread();
+
   if (is_fullscreen()) {
     // Get back on desktop before destroy the window.
     SDL_SetWindowFullscreen(main_window, 0);
   }
   delete scaled_surface;
+  delete pixel_filter_workers;
   if (screen_texture != NULL) {
     SDL_DestroyTexture(screen_texture);
   }
@@ -314,6 +346,11 @@ bool VideoManager::set_video_mode(VideoMode mode) {
 
   if (!disable_window) {
 
+    if (render_thread != NULL) {
+      // Don't change the surfaces while the render thread uses them.
+      SDL_SemWait(render_frame_done);
+    }
+
     const Rectangle& window_size = mode_sizes[mode];
     Rectangle render_size = quest_size;
 
@@ -351,6 +388,14 @@ bool VideoManager::set_video_mode(VideoMode mode) {
     SDL_SetWindowSize(main_window, window_size.get_width(), window_size.get_height());
     SDL_RenderSetLogicalSize(main_renderer, render_size.get_width(), render_size.get_height());
     SDL_ShowCursor(show_cursor);
+    full_redraw_needed = true;
+
+    if (render_thread != NULL) {
+      // The frame prepared with the old surfaces is lost.
+      render_first_row = 0;
+      render_last_row = 0;
+      SDL_SemPost(render_frame_done);
+    }
   }
   this->video_mode = mode;
 
@@ -412,62 +457,372 @@ VideoManager::VideoMode VideoManager::get_video_mode_by_name(const std::string&
 
 /**
  * \brief Draws the quest surface on the screen with the current video mode.
+ *
+ * In pipelined mode, this function shows the frame prepared by the render
+ * thread from the previous call and gives it the new quest surface.
+ *
  * \param quest_surface The quest surface to draw on the screen.
  */
 void VideoManager::draw(Surface& quest_surface) {
 
+  SOLARUS_PROFILE("VideoManager::draw");
+
   if (disable_window) {
     return;
   }
-  
-  SDL_Surface* screen_sdl_surface;
-  if (pixel_filter != NULL) {
-    Debug::check_assertion(scaled_surface != NULL,
-        "Missing destination surface for scaling");
-    apply_pixel_filter(quest_surface, *scaled_surface);
-    screen_sdl_surface = scaled_surface->get_internal_surface();
+
+  SDL_Surface* internal_surface = quest_surface.get_internal_surface();
+
+  if (render_thread != NULL) {
+    // Wait for the render thread to finish the previous frame and show it.
+    SDL_SemWait(render_frame_done);
+    if (render_first_row < render_last_row) {
+      upload_changed_rows(render_first_row, render_last_row);
+    }
+    render_screen();
+
+    // Let the render thread prepare the new one while the simulation goes on.
+    const int height = internal_surface->h;
+    render_frame_row_size = internal_surface->w * internal_surface->format->BytesPerPixel;
+    render_frame.resize(render_frame_row_size * height);
+    SDL_LockSurface(internal_surface);
+    const uint8_t* pixels = static_cast<const uint8_t*>(internal_surface->pixels);
+    for (int row = 0; row < height; ++row) {
+      std::memcpy(&render_frame[row * render_frame_row_size],
+          pixels + row * internal_surface->pitch, render_frame_row_size);
+    }
+    SDL_UnlockSurface(internal_surface);
+    SDL_SemPost(render_frame_ready);
+    return;
+  }
+
+  // Only the rows that have changed since the previous frame are filtered
+  // and uploaded to the texture.
+  int first_row = 0;
+  int last_row = 0;
+  SDL_LockSurface(internal_surface);
+  bool changed = find_changed_rows(
+      static_cast<const uint8_t*>(internal_surface->pixels),
+      internal_surface->pitch,
+      internal_surface->w * internal_surface->format->BytesPerPixel,
+      internal_surface->h,
+      first_row,
+      last_row);
+  SDL_UnlockSurface(internal_surface);
+
+  if (changed) {
+    apply_pixel_filter(first_row, last_row);
+    upload_changed_rows(first_row, last_row);
+  }
+  render_screen();
+}
+
+/**
+ * \brief Measures the time taken by the pixel filters on a frame and checks
+ * that their optimized versions give the same result as the original ones.
+ *
+ * This is done at the end of the benchmark mode.
+ * Each filter is applied in its original version, in its optimized version
+ * on the calling thread, and split into bands processed by several threads
+ * like when drawing the screen.
+ *
+ * \param frame The frame to filter, typically the last one drawn.
+ */
+void VideoManager::run_pixel_filters_benchmark(Surface& frame) {
+
+  const int nb_frames = 30;
+
+  // The filters work on 32-bit pixels, whatever the color depth.
+  SDL_Surface* frame_surface = SDL_ConvertSurfaceFormat(
+      frame.get_internal_surface(), SDL_PIXELFORMAT_ARGB8888, 0);
+  if (frame_surface == NULL) {
+    Debug::error(std::string("Cannot convert the frame to filter: ")
+        + SDL_GetError());
+    return;
+  }
+  const int width = frame_surface->w;
+  const int height = frame_surface->h;
+  std::vector<uint32_t> src(width * height);
+  SDL_LockSurface(frame_surface);
+  for (int row = 0; row < height; ++row) {
+    std::memcpy(&src[row * width],
+        static_cast<const uint8_t*>(frame_surface->pixels) + row * frame_surface->pitch,
+        width * sizeof(uint32_t));
+  }
+  SDL_UnlockSurface(frame_surface);
+  SDL_FreeSurface(frame_surface);
+
+  WorkerPool* workers = pixel_filter_workers;
+  if (workers == NULL) {
+    // No window: the threads were not created.
+    workers = new WorkerPool(WorkerPool::get_default_nb_threads());
+  }
+
+  const PixelFilter* filters[] = { &scale2x_filter, &hq4x_filter };
+  const char* filter_names[] = { "scale2x", "hq4x" };
+  for (int i = 0; i < 2; ++i) {
+
+    const PixelFilter& filter = *filters[i];
+    const int factor = filter.get_scaling_factor();
+    std::vector<uint32_t> reference_dst(width * height * factor * factor);
+    std::vector<uint32_t> dst(reference_dst.size());
+    std::vector<uint32_t> banded_dst(reference_dst.size());
+
+    double start_date = System::get_precise_real_time();
+    for (int j = 0; j < nb_frames; ++j) {
+      filter.filter_reference(&src[0], width, height, &reference_dst[0]);
+    }
+    const double reference_time = (System::get_precise_real_time() - start_date) / nb_frames;
+
+    start_date = System::get_precise_real_time();
+    for (int j = 0; j < nb_frames; ++j) {
+      filter.filter(&src[0], width, height, &dst[0]);
+    }
+    const double time = (System::get_precise_real_time() - start_date) / nb_frames;
+
+    start_date = System::get_precise_real_time();
+    for (int j = 0; j < nb_frames; ++j) {
+      filter.filter(&src[0], width, height, &banded_dst[0], 0, height, *workers);
+    }
+    const double banded_time = (System::get_precise_real_time() - start_date) / nb_frames;
+
+    const bool identical = dst == reference_dst && banded_dst == reference_dst;
+    std::cout << "  " << filter_names[i] << " filter: "
+        << reference_time << " ms/frame original, "
+        << time << " ms/frame optimized, "
+        << banded_time << " ms/frame with " << workers->get_nb_threads() + 1
+        << " threads, " << (identical ? "identical output" : "DIFFERENT OUTPUT")
+        << std::endl;
+  }
+
+  if (workers != pixel_filter_workers) {
+    delete workers;
+  }
+}
+
+/**
+ * \brief Determines the rows of the quest surface that have changed since
+ * the previous frame.
+ *
+ * The main loop redraws the whole quest surface at each frame, so changes
+ * are detected by comparing it to a copy of the previous frame.
+ * The copy is then updated.
+ * Everything is considered as changed after a change of video mode.
+ *
+ * \param pixels Pixels of the quest surface about to be drawn on the screen.
+ * \param pitch Size of a row of pixels in bytes, including the padding.
+ * \param row_size Size of the pixels of a row in bytes.
+ * \param height Height of the quest surface.
+ * \param[out] first_row First row that has changed.
+ * \param[out] last_row Row after the last one that has changed.
+ * \return \c false if nothing has changed.
+ */
+bool VideoManager::find_changed_rows(
+    const uint8_t* pixels,
+    int pitch,
+    int row_size,
+    int height,
+    int& first_row,
+    int& last_row) {
+
+  if (previous_quest_pixels.size() != size_t(row_size * height)) {
+    previous_quest_pixels.resize(row_size * height);
+    full_redraw_needed = true;
+  }
+  uint8_t* previous_pixels = &previous_quest_pixels[0];
+
+  if (full_redraw_needed) {
+    first_row = 0;
+    last_row = height;
   }
   else {
-    screen_sdl_surface = quest_surface.get_internal_surface();
+    first_row = 0;
+    while (first_row < height
+        && std::memcmp(pixels + first_row * pitch, previous_pixels + first_row * row_size, row_size) == 0) {
+      ++first_row;
+    }
+    last_row = height;
+    while (last_row > first_row
+        && std::memcmp(pixels + (last_row - 1) * pitch, previous_pixels + (last_row - 1) * row_size, row_size) == 0) {
+      --last_row;
+    }
   }
-  
-  // Update the internal texture with the internal surface, and render it.
-  SDL_UpdateTexture(screen_texture, NULL, screen_sdl_surface->pixels, screen_sdl_surface->pitch);
-  SDL_RenderClear(main_renderer);
-  SDL_RenderCopy(main_renderer, screen_texture, NULL, NULL);
-  SDL_RenderPresent(main_renderer);
+
+  for (int row = first_row; row < last_row; ++row) {
+    std::memcpy(previous_pixels + row * row_size, pixels + row * pitch, row_size);
+  }
+
+  full_redraw_needed = false;
+  return first_row < last_row;
 }
 
 /**
- * \brief Applies to current pixel filter on a surface.
- * \param src_surface The source surface.
- * \param dst_surface The destination surface. It must have the size of the
- * source surface multiplied by the scaling factor of the filter.
+ * \brief Applies the current pixel filter (if any) on some rows of the
+ * frame.
+ *
+ * The source is the copy of the quest surface made by find_changed_rows()
+ * and the destination is the scaled surface.
+ * Filters read the neighbour rows, so the destination also changes around
+ * the rows that have changed: the range of rows is extended accordingly.
+ *
+ * \param first_row First row that has changed. Updated with the first row
+ * to upload.
+ * \param last_row Row after the last one that has changed. Updated with the
+ * row after the last one to upload.
  */
-void VideoManager::apply_pixel_filter(
-    Surface& src_surface, Surface& dst_surface) {
+void VideoManager::apply_pixel_filter(int& first_row, int& last_row) {
+
+  if (pixel_filter == NULL) {
+    return;
+  }
 
-  Debug::check_assertion(pixel_filter != NULL, "Missing pixel filter");
+  Debug::check_assertion(scaled_surface != NULL,
+      "Missing destination surface for scaling");
 
+  const int width = quest_size.get_width();
+  const int height = quest_size.get_height();
   int factor = pixel_filter->get_scaling_factor();
-  Debug::check_assertion(dst_surface.get_width() == src_surface.get_width() * factor,
+  Debug::check_assertion(scaled_surface->get_width() == width * factor,
       "Wrong destination surface size");
-  Debug::check_assertion(dst_surface.get_height() == src_surface.get_height() * factor,
+  Debug::check_assertion(scaled_surface->get_height() == height * factor,
       "Wrong destination surface size");
 
-  SDL_Surface* src_internal_surface = src_surface.get_internal_surface();
-  SDL_Surface* dst_internal_surface = dst_surface.get_internal_surface();
+  first_row = std::max(0, first_row - 1);
+  last_row = std::min(height, last_row + 1);
 
-  SDL_LockSurface(src_internal_surface);
+  SDL_Surface* dst_internal_surface = scaled_surface->get_internal_surface();
   SDL_LockSurface(dst_internal_surface);
 
-  uint32_t* src = static_cast<uint32_t*>(src_internal_surface->pixels);
+  const uint32_t* src = reinterpret_cast<const uint32_t*>(&previous_quest_pixels[0]);
   uint32_t* dst = static_cast<uint32_t*>(dst_internal_surface->pixels);
 
-  pixel_filter->filter(src, src_surface.get_width(), src_surface.get_height(), dst);
+  pixel_filter->filter(src, width, height, dst,
+      first_row, last_row, *pixel_filter_workers);
 
   SDL_UnlockSurface(dst_internal_surface);
-  SDL_UnlockSurface(src_internal_surface);
+}
+
+/**
+ * \brief Updates some rows of the screen texture with the last frame.
+ * \param first_row First row of the quest surface to upload.
+ * \param last_row Row after the last one to upload.
+ */
+void VideoManager::upload_changed_rows(int first_row, int last_row) {
+
+  const uint8_t* pixels;
+  int pitch;
+  int factor = 1;
+  if (pixel_filter != NULL) {
+    SDL_Surface* screen_sdl_surface = scaled_surface->get_internal_surface();
+    pixels = static_cast<const uint8_t*>(screen_sdl_surface->pixels);
+    pitch = screen_sdl_surface->pitch;
+    factor = pixel_filter->get_scaling_factor();
+  }
+  else {
+    // The copy of the quest surface has no padding between rows.
+    pixels = &previous_quest_pixels[0];
+    pitch = int(previous_quest_pixels.size() / quest_size.get_height());
+  }
+
+  SDL_Rect changed_area;
+  changed_area.x = 0;
+  changed_area.y = first_row * factor;
+  changed_area.w = quest_size.get_width() * factor;
+  changed_area.h = (last_row - first_row) * factor;
+  SDL_UpdateTexture(screen_texture, &changed_area, pixels + changed_area.y * pitch, pitch);
+}
+
+/**
+ * \brief Renders the screen texture in the window.
+ */
+void VideoManager::render_screen() {
+
+  SDL_RenderClear(main_renderer);
+  SDL_RenderCopy(main_renderer, screen_texture, NULL, NULL);
+  SDL_RenderPresent(main_renderer);
+}
+
+/**
+ * \brief Starts the render thread used in pipelined mode.
+ *
+ * SDL requires rendering functions to be called from the thread that
+ * created the renderer, so the render thread detects the changes of each
+ * frame and applies the pixel filter, while the main thread uploads and
+ * presents the result at the next frame.
+ */
+void VideoManager::start_render_thread() {
+
+  render_frame_ready = SDL_CreateSemaphore(0);
+  render_frame_done = SDL_CreateSemaphore(1);  // No frame in progress.
+  render_thread = SDL_CreateThread(render_thread_main, "solarus_render", this);
+  if (render_thread == NULL) {
+    Debug::warning(std::string("Failed to create the render thread: ") + SDL_GetError());
+    SDL_DestroySemaphore(render_frame_done);
+    SDL_DestroySemaphore(render_frame_ready);
+    render_frame_done = NULL;
+    render_frame_ready = NULL;
+  }
+}
+
+/**
+ * \brief Stops the render thread if it is running.
+ */
+void VideoManager::stop_render_thread() {
+
+  if (render_thread == NULL) {
+    return;
+  }
+
+  SDL_SemWait(render_frame_done);
+  render_thread_stopping = true;
+  SDL_SemPost(render_frame_ready);
+  SDL_WaitThread(render_thread, NULL);
+  render_thread = NULL;
+
+  SDL_DestroySemaphore(render_frame_done);
+  SDL_DestroySemaphore(render_frame_ready);
+  render_frame_done = NULL;
+  render_frame_ready = NULL;
+}
+
+/**
+ * \brief Main function of the render thread.
+ * \param video_manager The video manager.
+ * \return 0.
+ */
+int VideoManager::render_thread_main(void* video_manager) {
+
+  static_cast<VideoManager*>(video_manager)->run_render_thread();
+  return 0;
+}
+
+/**
+ * \brief Prepares the frames given by draw() until the thread is stopped.
+ */
+void VideoManager::run_render_thread() {
+
+  while (true) {
+
+    SDL_SemWait(render_frame_ready);
+    if (render_thread_stopping) {
+      break;
+    }
+
+    Profiler::Scope scope("VideoManager::render_thread");
+    render_first_row = 0;
+    render_last_row = 0;
+    if (find_changed_rows(
+          &render_frame[0],
+          render_frame_row_size,
+          render_frame_row_size,
+          quest_size.get_height(),
+          render_first_row,
+          render_last_row)) {
+      apply_pixel_filter(render_first_row, render_last_row);
+    }
+
+    SDL_SemPost(render_frame_done);
+  }
 }
 
 /**
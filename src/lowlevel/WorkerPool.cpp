@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lowlevel/WorkerPool.h"
+#include "lowlevel/Debug.h"
+#include "lowlevel/StringConcat.h"
+#include <algorithm>
+
+/**
+ * \brief Destructor.
+ */
+WorkerPool::Job::~Job() {
+}
+
+/**
+ * \brief Creates a pool and starts its threads.
+ * \param nb_threads Number of threads to create in addition to the calling
+ * one (0 means that jobs run sequentially in the calling thread).
+ */
+WorkerPool::WorkerPool(int nb_threads):
+  mutex(SDL_CreateMutex()),
+  jobs_available(SDL_CreateCond()),
+  jobs_finished(SDL_CreateCond()),
+  nb_unfinished_jobs(0),
+  stopping(false) {
+
+  for (int i = 0; i < nb_threads; ++i) {
+    std::string name = StringConcat() << "solarus_worker_" << i;
+    SDL_Thread* thread = SDL_CreateThread(worker_main, name.c_str(), this);
+    if (thread == NULL) {
+      Debug::warning(std::string("Failed to create a worker thread: ") + SDL_GetError());
+      break;
+    }
+    threads.push_back(thread);
+  }
+}
+
+/**
+ * \brief Stops the threads and destroys the pool.
+ */
+WorkerPool::~WorkerPool() {
+
+  SDL_LockMutex(mutex);
+  stopping = true;
+  SDL_CondBroadcast(jobs_available);
+  SDL_UnlockMutex(mutex);
+
+  std::vector<SDL_Thread*>::iterator it;
+  for (it = threads.begin(); it != threads.end(); ++it) {
+    SDL_WaitThread(*it, NULL);
+  }
+
+  SDL_DestroyCond(jobs_finished);
+  SDL_DestroyCond(jobs_available);
+  SDL_DestroyMutex(mutex);
+}
+
+/**
+ * \brief Returns a reasonable number of worker threads for this machine.
+ * \return The number of CPU cores minus one, between 0 and 7.
+ */
+int WorkerPool::get_default_nb_threads() {
+
+  return std::max(0, std::min(7, SDL_GetCPUCount() - 1));
+}
+
+/**
+ * \brief Returns the number of threads of this pool.
+ * \return The number of threads, not including the calling thread.
+ */
+int WorkerPool::get_nb_threads() const {
+  return threads.size();
+}
+
+/**
+ * \brief Runs a batch of jobs and waits until they are all done.
+ *
+ * This function must not be called by several threads at the same time.
+ *
+ * \param jobs The jobs to execute. The pool does not take ownership of them.
+ */
+void WorkerPool::run(const std::vector<Job*>& jobs) {
+
+  if (jobs.empty()) {
+    return;
+  }
+
+  if (threads.empty() || jobs.size() == 1) {
+    // No need to involve other threads.
+    std::vector<Job*>::const_iterator it;
+    for (it = jobs.begin(); it != jobs.end(); ++it) {
+      (*it)->run();
+    }
+    return;
+  }
+
+  SDL_LockMutex(mutex);
+  pending_jobs.insert(pending_jobs.end(), jobs.begin(), jobs.end());
+  nb_unfinished_jobs += jobs.size();
+  SDL_CondBroadcast(jobs_available);
+
+  // Help the workers.
+  while (!pending_jobs.empty()) {
+    Job* job = pending_jobs.front();
+    pending_jobs.pop_front();
+    SDL_UnlockMutex(mutex);
+    job->run();
+    SDL_LockMutex(mutex);
+    finish_job();
+  }
+
+  while (nb_unfinished_jobs > 0) {
+    SDL_CondWait(jobs_finished, mutex);
+  }
+  SDL_UnlockMutex(mutex);
+}
+
+/**
+ * \brief Main function of worker threads.
+ * \param pool The pool.
+ * \return 0.
+ */
+int WorkerPool::worker_main(void* pool) {
+
+  static_cast<WorkerPool*>(pool)->work();
+  return 0;
+}
+
+/**
+ * \brief Executes jobs until the pool stops.
+ */
+void WorkerPool::work() {
+
+  SDL_LockMutex(mutex);
+  while (true) {
+
+    while (!stopping && pending_jobs.empty()) {
+      SDL_CondWait(jobs_available, mutex);
+    }
+
+    if (stopping) {
+      break;
+    }
+
+    Job* job = pending_jobs.front();
+    pending_jobs.pop_front();
+    SDL_UnlockMutex(mutex);
+    job->run();
+    SDL_LockMutex(mutex);
+    finish_job();
+  }
+  SDL_UnlockMutex(mutex);
+}
+
+/**
+ * \brief Counts a job as finished.
+ *
+ * The mutex must be locked.
+ */
+void WorkerPool::finish_job() {
+
+  --nb_unfinished_jobs;
+  if (nb_unfinished_jobs == 0) {
+    SDL_CondSignal(jobs_finished);
+  }
+}
+
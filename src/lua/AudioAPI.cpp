@@ -96,7 +96,24 @@ int LuaContext::audio_api_play_sound(lua_State* l) {
  */
 int LuaContext::audio_api_preload_sounds(lua_State* l) {
 
-  Sound::load_all();
+  if (lua_gettop(l) >= 1) {
+    // Only load the sounds given.
+    luaL_checktype(l, 1, LUA_TTABLE);
+    std::vector<std::string> sound_ids;
+    lua_pushnil(l);
+    while (lua_next(l, 1) != 0) {
+      const std::string& sound_id = luaL_checkstring(l, -1);
+      if (!Sound::exists(sound_id)) {
+        error(l, StringConcat() << "Cannot find sound '" << sound_id << "'");
+      }
+      sound_ids.push_back(sound_id);
+      lua_pop(l, 1);
+    }
+    Sound::load_sounds(sound_ids);
+  }
+  else {
+    Sound::load_all();
+  }
   return 0;
 }
 
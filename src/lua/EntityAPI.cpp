@@ -111,6 +111,8 @@ void LuaContext::register_entity_module() {
       { "get_direction8_to", entity_api_get_direction8_to },
       { "get_optimization_distance", entity_api_get_optimization_distance },
       { "set_optimization_distance", entity_api_set_optimization_distance },
+      { "get_update_lod", entity_api_get_update_lod },
+      { "set_update_lod", entity_api_set_update_lod },
       { "is_in_same_region", entity_api_is_in_same_region },
       { "test_obstacles", entity_api_test_obstacles },
       { "is_visible", entity_api_is_visible },
@@ -898,6 +900,48 @@ int LuaContext::entity_api_set_optimization_distance(lua_State* l) {
   return 0;
 }
 
+/**
+ * \brief Implementation of entity:get_update_lod().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::entity_api_get_update_lod(lua_State* l) {
+
+  MapEntity& entity = check_entity(l, 1);
+
+  if (entity.get_update_lod_margin() < 0) {
+    // The default setting of the entity type is used.
+    lua_pushnil(l);
+    return 1;
+  }
+
+  lua_pushinteger(l, entity.get_update_lod_margin());
+  lua_pushinteger(l, entity.get_update_lod_interval());
+  return 2;
+}
+
+/**
+ * \brief Implementation of entity:set_update_lod().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::entity_api_set_update_lod(lua_State* l) {
+
+  MapEntity& entity = check_entity(l, 1);
+  int margin = -1;  // nil means the default setting of the entity type.
+  if (!lua_isnoneornil(l, 2)) {
+    margin = luaL_checkint(l, 2);
+    if (margin < 0) {
+      luaL_argerror(l, 2, "Invalid margin: must be positive or zero");
+    }
+  }
+  int interval = luaL_optint(l, 3, 0);
+
+  entity.set_update_lod(margin, interval);
+
+  return 0;
+}
+
 /**
  * \brief Implementation of entity:is_in_same_region().
  * \param l The Lua context that is calling this function.
@@ -2614,7 +2658,7 @@ void LuaContext::entity_on_removed(MapEntity& entity) {
   }
 
   push_entity(l, entity);
-  if (entity.is_with_lua_table()) {
+  if (entity.has_lua_field("on_removed")) {
     on_removed();
   }
   remove_timers(-1);  // Stop timers associated to this entity.
@@ -2633,7 +2677,7 @@ void LuaContext::entity_on_removed(MapEntity& entity) {
 void LuaContext::entity_on_position_changed(
     MapEntity& entity, const Rectangle& xy, Layer layer) {
 
-  if (!entity.is_with_lua_table()) {
+  if (!entity.has_lua_field("on_position_changed")) {
     return;
   }
 
@@ -2653,7 +2697,7 @@ void LuaContext::entity_on_position_changed(
 void LuaContext::entity_on_obstacle_reached(
     MapEntity& entity, Movement& movement) {
 
-  if (!entity.is_with_lua_table()) {
+  if (!entity.has_lua_field("on_obstacle_reached")) {
     return;
   }
 
@@ -2673,7 +2717,7 @@ void LuaContext::entity_on_obstacle_reached(
 void LuaContext::entity_on_movement_changed(
     MapEntity& entity, Movement& movement) {
 
-  if (!entity.is_with_lua_table()) {
+  if (!entity.has_lua_field("on_movement_changed")) {
     return;
   }
 
@@ -2691,7 +2735,7 @@ void LuaContext::entity_on_movement_changed(
  */
 void LuaContext::entity_on_movement_finished(MapEntity& entity) {
 
-  if (!entity.is_with_lua_table()) {
+  if (!entity.has_lua_field("on_movement_finished")) {
     return;
   }
 
@@ -2711,7 +2755,7 @@ void LuaContext::entity_on_movement_finished(MapEntity& entity) {
 void LuaContext::hero_on_state_changed(
     Hero& hero, const std::string& state_name) {
 
-  if (!hero.is_with_lua_table()) {
+  if (!hero.has_lua_field("on_state_changed")) {
     return;
   }
 
@@ -2729,7 +2773,7 @@ void LuaContext::hero_on_state_changed(
  */
 void LuaContext::npc_on_interaction(NPC& npc) {
 
-  if (!npc.is_with_lua_table()) {
+  if (!npc.has_lua_field("on_interaction")) {
     return;
   }
 
@@ -2768,7 +2812,7 @@ bool LuaContext::npc_on_interaction_item(NPC& npc, EquipmentItem& item_used) {
  */
 void LuaContext::npc_on_collision_fire(NPC& npc) {
 
-  if (!npc.is_with_lua_table()) {
+  if (!npc.has_lua_field("on_collision_fire")) {
     return;
   }
 
@@ -2786,7 +2830,7 @@ void LuaContext::npc_on_collision_fire(NPC& npc) {
  */
 void LuaContext::block_on_moving(Block& block) {
 
-  if (!block.is_with_lua_table()) {
+  if (!block.has_lua_field("on_moving")) {
     return;
   }
 
@@ -2804,7 +2848,7 @@ void LuaContext::block_on_moving(Block& block) {
  */
 void LuaContext::block_on_moved(Block& block) {
 
-  if (!block.is_with_lua_table()) {
+  if (!block.has_lua_field("on_moved")) {
     return;
   }
 
@@ -2842,7 +2886,7 @@ bool LuaContext::chest_on_empty(Chest& chest) {
  */
 void LuaContext::switch_on_activated(Switch& sw) {
 
-  if (!sw.is_with_lua_table()) {
+  if (!sw.has_lua_field("on_activated")) {
     return;
   }
 
@@ -2860,7 +2904,7 @@ void LuaContext::switch_on_activated(Switch& sw) {
  */
 void LuaContext::switch_on_inactivated(Switch& sw) {
 
-  if (!sw.is_with_lua_table()) {
+  if (!sw.has_lua_field("on_inactivated")) {
     return;
   }
 
@@ -2878,7 +2922,7 @@ void LuaContext::switch_on_inactivated(Switch& sw) {
  */
 void LuaContext::switch_on_left(Switch& sw) {
 
-  if (!sw.is_with_lua_table()) {
+  if (!sw.has_lua_field("on_left")) {
     return;
   }
 
@@ -2896,7 +2940,7 @@ void LuaContext::switch_on_left(Switch& sw) {
  */
 void LuaContext::sensor_on_activated(Sensor& sensor) {
 
-  if (!sensor.is_with_lua_table()) {
+  if (!sensor.has_lua_field("on_activated")) {
     return;
   }
 
@@ -2914,7 +2958,7 @@ void LuaContext::sensor_on_activated(Sensor& sensor) {
  */
 void LuaContext::sensor_on_activated_repeat(Sensor& sensor) {
 
-  if (!sensor.is_with_lua_table()) {
+  if (!sensor.has_lua_field("on_activated_repeat")) {
     return;
   }
 
@@ -2929,7 +2973,7 @@ void LuaContext::sensor_on_activated_repeat(Sensor& sensor) {
  */
 void LuaContext::sensor_on_left(Sensor& sensor) {
 
-  if (!sensor.is_with_lua_table()) {
+  if (!sensor.has_lua_field("on_left")) {
     return;
   }
 
@@ -2947,7 +2991,7 @@ void LuaContext::sensor_on_left(Sensor& sensor) {
  */
 void LuaContext::sensor_on_collision_explosion(Sensor& sensor) {
 
-  if (!sensor.is_with_lua_table()) {
+  if (!sensor.has_lua_field("on_collision_explosion")) {
     return;
   }
 
@@ -2966,7 +3010,7 @@ void LuaContext::sensor_on_collision_explosion(Sensor& sensor) {
  */
 void LuaContext::separator_on_activating(Separator& separator, int direction4) {
 
-  if (!separator.is_with_lua_table()) {
+  if (!separator.has_lua_field("on_activating")) {
     return;
   }
 
@@ -2985,7 +3029,7 @@ void LuaContext::separator_on_activating(Separator& separator, int direction4) {
  */
 void LuaContext::separator_on_activated(Separator& separator, int direction4) {
 
-  if (!separator.is_with_lua_table()) {
+  if (!separator.has_lua_field("on_activated")) {
     return;
   }
 
@@ -3003,7 +3047,7 @@ void LuaContext::separator_on_activated(Separator& separator, int direction4) {
  */
 void LuaContext::door_on_opened(Door& door) {
 
-  if (!door.is_with_lua_table()) {
+  if (!door.has_lua_field("on_opened")) {
     return;
   }
 
@@ -3021,7 +3065,7 @@ void LuaContext::door_on_opened(Door& door) {
  */
 void LuaContext::door_on_closed(Door& door) {
 
-  if (!door.is_with_lua_table()) {
+  if (!door.has_lua_field("on_closed")) {
     return;
   }
 
@@ -3059,7 +3103,7 @@ bool LuaContext::shop_treasure_on_buying(ShopTreasure& shop_treasure) {
  */
 void LuaContext::shop_treasure_on_bought(ShopTreasure& shop_treasure) {
 
-  if (!shop_treasure.is_with_lua_table()) {
+  if (!shop_treasure.has_lua_field("on_bought")) {
     return;
   }
 
@@ -3077,7 +3121,7 @@ void LuaContext::shop_treasure_on_bought(ShopTreasure& shop_treasure) {
  */
 void LuaContext::enemy_on_update(Enemy& enemy) {
 
-  if (!enemy.is_with_lua_table()) {
+  if (!enemy.has_lua_field("on_update")) {
     return;
   }
 
@@ -3096,7 +3140,7 @@ void LuaContext::enemy_on_update(Enemy& enemy) {
  */
 void LuaContext::enemy_on_suspended(Enemy& enemy, bool suspended) {
 
-  if (!enemy.is_with_lua_table()) {
+  if (!enemy.has_lua_field("on_suspended")) {
     return;
   }
 
@@ -3114,7 +3158,7 @@ void LuaContext::enemy_on_suspended(Enemy& enemy, bool suspended) {
  */
 void LuaContext::enemy_on_created(Enemy& enemy) {
 
-  if (!enemy.is_with_lua_table()) {
+  if (!enemy.has_lua_field("on_created")) {
     return;
   }
 
@@ -3132,7 +3176,7 @@ void LuaContext::enemy_on_created(Enemy& enemy) {
  */
 void LuaContext::enemy_on_enabled(Enemy& enemy) {
 
-  if (!enemy.is_with_lua_table()) {
+  if (!enemy.has_lua_field("on_enabled")) {
     return;
   }
 
@@ -3150,7 +3194,7 @@ void LuaContext::enemy_on_enabled(Enemy& enemy) {
  */
 void LuaContext::enemy_on_disabled(Enemy& enemy) {
 
-  if (!enemy.is_with_lua_table()) {
+  if (!enemy.has_lua_field("on_disabled")) {
     return;
   }
 
@@ -3174,7 +3218,7 @@ void LuaContext::enemy_on_restarted(Enemy& enemy) {
 
   push_enemy(l, enemy);
   remove_timers(-1);  // Stop timers associated to this enemy.
-  if (enemy.is_with_lua_table()) {
+  if (enemy.has_lua_field("on_restarted")) {
     on_restarted();
   }
   lua_pop(l, 1);
@@ -3189,7 +3233,7 @@ void LuaContext::enemy_on_restarted(Enemy& enemy) {
  */
 void LuaContext::enemy_on_pre_draw(Enemy& enemy) {
 
-  if (!enemy.is_with_lua_table()) {
+  if (!enemy.has_lua_field("on_pre_draw")) {
     return;
   }
 
@@ -3207,7 +3251,7 @@ void LuaContext::enemy_on_pre_draw(Enemy& enemy) {
  */
 void LuaContext::enemy_on_post_draw(Enemy& enemy) {
 
-  if (!enemy.is_with_lua_table()) {
+  if (!enemy.has_lua_field("on_post_draw")) {
     return;
   }
 
@@ -3229,7 +3273,7 @@ void LuaContext::enemy_on_post_draw(Enemy& enemy) {
 void LuaContext::enemy_on_collision_enemy(Enemy& enemy,
     Enemy& other_enemy, Sprite& other_sprite, Sprite& this_sprite) {
 
-  if (!enemy.is_with_lua_table()) {
+  if (!enemy.has_lua_field("on_collision_enemy")) {
     return;
   }
 
@@ -3250,7 +3294,7 @@ void LuaContext::enemy_on_collision_enemy(Enemy& enemy,
 void LuaContext::enemy_on_custom_attack_received(Enemy& enemy,
     EnemyAttack attack, Sprite* sprite) {
 
-  if (!enemy.is_with_lua_table()) {
+  if (!enemy.has_lua_field("on_custom_attack_received")) {
     return;
   }
 
@@ -3276,7 +3320,7 @@ void LuaContext::enemy_on_hurt(Enemy& enemy, EnemyAttack attack, int life_lost)
 
   push_enemy(l, enemy);
   remove_timers(-1);  // Stop timers associated to this enemy.
-  if (enemy.is_with_lua_table()) {
+  if (enemy.has_lua_field("on_hurt")) {
     on_hurt(attack, life_lost);
   }
   lua_pop(l, 1);
@@ -3297,7 +3341,7 @@ void LuaContext::enemy_on_dying(Enemy& enemy) {
 
   push_enemy(l, enemy);
   remove_timers(-1);  // Stop timers associated to this enemy.
-  if (enemy.is_with_lua_table()) {
+  if (enemy.has_lua_field("on_dying")) {
     on_dying();
   }
   lua_pop(l, 1);
@@ -3312,7 +3356,7 @@ void LuaContext::enemy_on_dying(Enemy& enemy) {
  */
 void LuaContext::enemy_on_dead(Enemy& enemy) {
 
-  if (!enemy.is_with_lua_table()) {
+  if (!enemy.has_lua_field("on_dead")) {
     return;
   }
 
@@ -3336,7 +3380,7 @@ void LuaContext::enemy_on_immobilized(Enemy& enemy) {
 
   push_enemy(l, enemy);
   remove_timers(-1);  // Stop timers associated to this enemy.
-  if (enemy.is_with_lua_table()) {
+  if (enemy.has_lua_field("on_immobilized")) {
     on_immobilized();
   }
   lua_pop(l, 1);
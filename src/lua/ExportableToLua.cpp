@@ -24,7 +24,8 @@
 ExportableToLua::ExportableToLua():
   refcount(0),
   known_to_lua(false),
-  with_lua_table(false) {
+  with_lua_table(false),
+  lua_field_bits(0) {
 
 }
 
@@ -78,6 +79,53 @@ void ExportableToLua::set_with_lua_table(bool with_lua_table) {
   this->with_lua_table = with_lua_table;
 }
 
+/**
+ * \brief Returns whether a key may have been set in the Lua table of this
+ * userdata.
+ *
+ * This is a fast test to avoid looking for event methods like on_update()
+ * in Lua when the script has not defined them.
+ * A \c false result is exact. A \c true result may be wrong if another key
+ * with the same hash was set, or if the key was set to nil since then.
+ *
+ * \param key A key, typically the name of an event.
+ * This is not an const std::string& but a const char* on purpose to avoid
+ * costly conversions as this function is called very often.
+ * \return \c false if this key was never set in the Lua table.
+ */
+bool ExportableToLua::has_lua_field(const char* key) const {
+
+  return with_lua_table && (lua_field_bits & get_lua_field_bit(key)) != 0;
+}
+
+/**
+ * \brief Notifies this userdata that a key was set in its Lua table.
+ *
+ * This function is called by the __newindex metamethod.
+ *
+ * \param key The key that was set.
+ */
+void ExportableToLua::notify_lua_field_set(const char* key) {
+
+  lua_field_bits |= get_lua_field_bit(key);
+}
+
+/**
+ * \brief Returns the bit that represents a key in lua_field_bits.
+ * \param key A key.
+ * \return A mask with the bit corresponding to a hash of this key.
+ */
+uint64_t ExportableToLua::get_lua_field_bit(const char* key) {
+
+  // FNV-1a hash.
+  uint32_t hash = 2166136261U;
+  for (const char* c = key; *c != '\0'; ++c) {
+    hash ^= uint8_t(*c);
+    hash *= 16777619U;
+  }
+  return uint64_t(1) << (hash & 63);
+}
+
 /**
  * \brief Returns the current refcount of this object.
  *
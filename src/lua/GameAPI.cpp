@@ -1388,7 +1388,7 @@ void LuaContext::game_on_update(Game& game) {
   }
 
   push_game(l, game.get_savegame());
-  if (game.get_savegame().is_with_lua_table()) {
+  if (game.get_savegame().has_lua_field("on_update")) {
     on_update();
   }
   menus_on_update(-1);
@@ -1410,7 +1410,7 @@ void LuaContext::game_on_draw(Game& game, Surface& dst_surface) {
   }
 
   push_game(l, game.get_savegame());
-  if (game.get_savegame().is_with_lua_table()) {
+  if (game.get_savegame().has_lua_field("on_draw")) {
     on_draw(dst_surface);
   }
   menus_on_draw(-1, dst_surface);
@@ -28,6 +28,7 @@
 #include "lowlevel/FileTools.h"
 #include "lowlevel/Debug.h"
 #include "lowlevel/StringConcat.h"
+#include "lowlevel/Profiler.h"
 #include "EquipmentItem.h"
 #include "Treasure.h"
 #include "Map.h"
@@ -179,6 +180,8 @@ void LuaContext::exit() {
  */
 void LuaContext::update() {
 
+  SOLARUS_PROFILE("LuaContext::update");
+
   update_drawables();
   update_movements();
   update_menus();
@@ -1417,6 +1420,11 @@ int LuaContext::userdata_meta_newindex_as_table(lua_State* l) {
                                   // ... udata_tables udata_table key value
   lua_settable(l, -3);
                                   // ... udata_tables udata_table
+
+  // Remember which keys are defined, to avoid looking for undefined events.
+  if (lua_type(l, 2) == LUA_TSTRING) {
+    userdata->notify_lua_field_set(lua_tostring(l, 2));
+  }
   return 0;
 }
 
@@ -17,6 +17,7 @@
 #include "lua/LuaContext.h"
 #include "lowlevel/Geometry.h"
 #include "lowlevel/FileTools.h"
+#include "lowlevel/Profiler.h"
 #include "MainLoop.h"
 #include "Settings.h"
 #include <lua.hpp>
@@ -41,6 +42,7 @@ void LuaContext::register_main_module() {
       { "save_settings", main_api_save_settings },
       { "get_distance", main_api_get_distance },
       { "get_angle", main_api_get_angle },
+      { "get_profiler_statistics", main_api_get_profiler_statistics },
       { NULL, NULL }
   };
   register_functions(main_module_name, functions);
@@ -221,6 +223,46 @@ int LuaContext::main_api_get_angle(lua_State* l) {
   return 1;
 }
 
+/**
+ * \brief Implementation of sol.main.get_profiler_statistics().
+ *
+ * Returns nil if the engine was not started with -profile.
+ * Otherwise, returns a table indexed by section names, where each value
+ * is a table with the fields nb_calls, average and max (in milliseconds)
+ * measured over the last second.
+ *
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::main_api_get_profiler_statistics(lua_State* l) {
+
+  if (!Profiler::is_enabled()) {
+    lua_pushnil(l);
+    return 1;
+  }
+
+  std::map<std::string, Profiler::Statistics> statistics;
+  Profiler::get_statistics(statistics);
+
+  lua_newtable(l);
+                                  // statistics
+  std::map<std::string, Profiler::Statistics>::const_iterator it;
+  for (it = statistics.begin(); it != statistics.end(); ++it) {
+    const Profiler::Statistics& section = it->second;
+    lua_newtable(l);
+                                  // statistics section
+    lua_pushinteger(l, section.nb_calls);
+    lua_setfield(l, -2, "nb_calls");
+    lua_pushnumber(l, section.average);
+    lua_setfield(l, -2, "average");
+    lua_pushnumber(l, section.max);
+    lua_setfield(l, -2, "max");
+    lua_setfield(l, -2, it->first.c_str());
+                                  // statistics
+  }
+  return 1;
+}
+
 /**
  * \brief Calls sol.main.on_started() if it exists.
  *
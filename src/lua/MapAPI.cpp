@@ -91,6 +91,8 @@ void LuaContext::register_map_module() {
       { "get_entities_count", map_api_get_entities_count },
       { "has_entities", map_api_has_entities },
       { "set_entities_enabled", map_api_set_entities_enabled },
+      { "get_update_lod", map_api_get_update_lod },
+      { "set_update_lod", map_api_set_update_lod },
       { "remove_entities", map_api_remove_entities },
       { "create_destination", map_api_create_destination },
       { "create_teletransporter", map_api_create_teletransporter },
@@ -725,6 +727,11 @@ int LuaContext::map_api_has_entity(lua_State* l) {
 
 /**
  * \brief Implementation of map:get_entities().
+ *
+ * Entities created during the loop are not returned.
+ * With a non-empty prefix, the entities are returned lazily in the
+ * alphabetical order of their names: no intermediate table is built.
+ *
  * \param l The Lua context that is calling this function.
  * \return Number of values to return to Lua.
  */
@@ -733,6 +740,16 @@ int LuaContext::map_api_get_entities(lua_State* l) {
   Map& map = check_map(l, 1);
   const std::string& prefix = luaL_checkstring(l, 2);
 
+  if (!prefix.empty()) {
+    lua_pushvalue(l, 1);
+    push_string(l, prefix);
+    lua_pushstring(l, "");
+    lua_pushnumber(l, map.get_entities().get_last_creation_index());
+    lua_pushcclosure(l, l_get_next_entity_with_prefix, 4);
+    return 1;
+  }
+
+  // Empty prefix: unnamed entities are also returned.
   const std::list<MapEntity*> entities =
     map.get_entities().get_entities_with_prefix(prefix);
 
@@ -751,6 +768,40 @@ int LuaContext::map_api_get_entities(lua_State* l) {
   return 3;
 }
 
+/**
+ * \brief Iterator function returned by map:get_entities().
+ *
+ * Upvalues: map, prefix, name of the previous entity returned,
+ * creation index of the last entity that existed when the iteration
+ * started.
+ *
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::l_get_next_entity_with_prefix(lua_State* l) {
+
+  Map& map = check_map(l, lua_upvalueindex(1));
+  const std::string& prefix = luaL_checkstring(l, lua_upvalueindex(2));
+  const std::string& previous_name = luaL_checkstring(l, lua_upvalueindex(3));
+  const uint32_t max_creation_index =
+    uint32_t(luaL_checknumber(l, lua_upvalueindex(4)));
+
+  if (!map.is_loaded()) {
+    return 0;
+  }
+
+  MapEntity* entity = map.get_entities().get_next_entity_with_prefix(
+      prefix, previous_name, max_creation_index);
+  if (entity == NULL) {
+    return 0;
+  }
+
+  push_string(l, entity->get_name());
+  lua_replace(l, lua_upvalueindex(3));
+  push_entity(l, *entity);
+  return 1;
+}
+
 /**
  * \brief Implementation of map:get_entities_count().
  * \param l The Lua context that is calling this function.
@@ -761,10 +812,7 @@ int LuaContext::map_api_get_entities_count(lua_State* l) {
   Map& map = check_map(l, 1);
   const std::string& prefix = luaL_checkstring(l, 2);
 
-  const std::list<MapEntity*> entities =
-    map.get_entities().get_entities_with_prefix(prefix);
-
-  lua_pushinteger(l, entities.size());
+  lua_pushinteger(l, map.get_entities().get_entities_count_with_prefix(prefix));
   return 1;
 }
 
@@ -806,6 +854,45 @@ int LuaContext::map_api_set_entities_enabled(lua_State* l) {
   return 0;
 }
 
+/**
+ * \brief Implementation of map:get_update_lod().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::map_api_get_update_lod(lua_State* l) {
+
+  Map& map = check_map(l, 1);
+  EntityType type = check_enum<EntityType>(l, 2, MapEntity::entity_type_names);
+
+  int margin = 0;
+  int interval = 0;
+  map.get_entities().get_default_update_lod(type, margin, interval);
+
+  lua_pushinteger(l, margin);
+  lua_pushinteger(l, interval);
+  return 2;
+}
+
+/**
+ * \brief Implementation of map:set_update_lod().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::map_api_set_update_lod(lua_State* l) {
+
+  Map& map = check_map(l, 1);
+  EntityType type = check_enum<EntityType>(l, 2, MapEntity::entity_type_names);
+  int margin = luaL_checkint(l, 3);
+  if (margin < 0) {
+    luaL_argerror(l, 3, "Invalid margin: must be positive or zero");
+  }
+  int interval = luaL_optint(l, 4, 0);
+
+  map.get_entities().set_default_update_lod(type, margin, interval);
+
+  return 0;
+}
+
 /**
  * \brief Implementation of map:remove_entities().
  * \param l The Lua context that is calling this function.
@@ -1966,7 +2053,7 @@ int LuaContext::map_api_create_fire(lua_State* l) {
  */
 void LuaContext::map_on_started(Map& map, Destination* destination) {
 
-  if (!map.is_with_lua_table()) {
+  if (!map.has_lua_field("on_started")) {
     return;
   }
 
@@ -1989,7 +2076,7 @@ void LuaContext::map_on_finished(Map& map) {
   }
 
   push_map(l, map);
-  if (map.is_with_lua_table()) {
+  if (map.has_lua_field("on_finished")) {
     on_finished();
   }
   remove_timers(-1);  // Stop timers and menus associated to this map.
@@ -2011,7 +2098,7 @@ void LuaContext::map_on_update(Map& map) {
   }
 
   push_map(l, map);
-  if (map.is_with_lua_table()) {
+  if (map.has_lua_field("on_update")) {
     on_update();
   }
   menus_on_update(-1);
@@ -2032,7 +2119,7 @@ void LuaContext::map_on_draw(Map& map, Surface& dst_surface) {
     return;
   }
   push_map(l, map);
-  if (map.is_with_lua_table()) {
+  if (map.has_lua_field("on_draw")) {
     on_draw(dst_surface);
   }
   menus_on_draw(-1, dst_surface);
@@ -2134,7 +2221,7 @@ bool LuaContext::map_on_command_released(Map& map, GameCommands::Command command
  */
 void LuaContext::map_on_suspended(Map& map, bool suspended) {
 
-  if (!map.is_with_lua_table()) {
+  if (!map.has_lua_field("on_suspended")) {
     return;
   }
 
@@ -2154,7 +2241,7 @@ void LuaContext::map_on_suspended(Map& map, bool suspended) {
 void LuaContext::map_on_opening_transition_finished(Map& map,
     Destination* destination) {
 
-  if (!map.is_with_lua_table()) {
+  if (!map.has_lua_field("on_opening_transition_finished")) {
     return;
   }
 
@@ -2172,7 +2259,7 @@ void LuaContext::map_on_opening_transition_finished(Map& map,
  */
 void LuaContext::map_on_camera_back(Map& map) {
 
-  if (!map.is_with_lua_table()) {
+  if (!map.has_lua_field("on_camera_back")) {
     return;
   }
 
@@ -2191,7 +2278,7 @@ void LuaContext::map_on_camera_back(Map& map) {
  */
 void LuaContext::map_on_obtaining_treasure(Map& map, const Treasure& treasure) {
 
-  if (!map.is_with_lua_table()) {
+  if (!map.has_lua_field("on_obtaining_treasure")) {
     return;
   }
 
@@ -2210,7 +2297,7 @@ void LuaContext::map_on_obtaining_treasure(Map& map, const Treasure& treasure) {
  */
 void LuaContext::map_on_obtained_treasure(Map& map, const Treasure& treasure) {
 
-  if (!map.is_with_lua_table()) {
+  if (!map.has_lua_field("on_obtained_treasure")) {
     return;
   }
 
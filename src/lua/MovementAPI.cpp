@@ -87,6 +87,8 @@ void LuaContext::register_movement_module() {
       { "set_max_distance", straight_movement_api_set_max_distance },
       { "is_smooth", straight_movement_api_is_smooth },
       { "set_smooth", straight_movement_api_set_smooth },
+      { "is_swept", straight_movement_api_is_swept },
+      { "set_swept", straight_movement_api_set_swept },
       { NULL, NULL }
   };
   register_functions(movement_straight_module_name, common_methods);
@@ -721,6 +723,35 @@ int LuaContext::straight_movement_api_set_smooth(lua_State* l) {
   return 0;
 }
 
+/**
+ * \brief Implementation of straight_movement:is_swept().
+ * \param l the Lua context that is calling this function
+ * \return number of values to return to Lua
+ */
+int LuaContext::straight_movement_api_is_swept(lua_State* l) {
+
+  StraightMovement& movement = check_straight_movement(l, 1);
+  lua_pushboolean(l, movement.is_swept());
+  return 1;
+}
+
+/**
+ * \brief Implementation of straight_movement:set_swept().
+ * \param l the Lua context that is calling this function
+ * \return number of values to return to Lua
+ */
+int LuaContext::straight_movement_api_set_swept(lua_State* l) {
+
+  StraightMovement& movement = check_straight_movement(l, 1);
+  bool swept = true; // true if unspecified
+  if (lua_gettop(l) >= 2) {
+    swept = lua_toboolean(l, 2);
+  }
+  movement.set_swept(swept);
+
+  return 0;
+}
+
 /**
  * \brief Returns whether a value is a userdata of type random movement.
  * \param l A Lua context.
@@ -1741,7 +1772,7 @@ void LuaContext::movement_on_position_changed(Movement& movement) {
  */
 void LuaContext::movement_on_obstacle_reached(Movement& movement) {
 
-  if (!movement.is_with_lua_table()) {
+  if (!movement.has_lua_field("on_obstacle_reached")) {
     return;
   }
 
@@ -1759,7 +1790,7 @@ void LuaContext::movement_on_obstacle_reached(Movement& movement) {
  */
 void LuaContext::movement_on_changed(Movement& movement) {
 
-  if (!movement.is_with_lua_table()) {
+  if (!movement.has_lua_field("on_changed")) {
     return;
   }
 
@@ -1777,7 +1808,7 @@ void LuaContext::movement_on_changed(Movement& movement) {
  */
 void LuaContext::movement_on_finished(Movement& movement) {
 
-  if (!movement.is_with_lua_table()) {
+  if (!movement.has_lua_field("on_finished")) {
     return;
   }
 
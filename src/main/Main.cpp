@@ -39,8 +39,17 @@ static void print_help(int argc, char** argv);
  * The following options are supported:
  *   -help               shows a help message
  *   -no-audio           disables sounds and musics
+ *   -lazy-sounds        decodes each sound when it is first played instead of preloading them all
+ *   -sound-cache        keeps decoded sounds in the quest write directory to load them faster
  *   -no-video           disables displaying (used for unitary tests)
+ *   -render-thread      prepares frames in a separate thread (pipelined rendering)
+ *   -profile[=<file>]   measures the time of each subsystem and writes a Chrome trace on exit
+ *   -record-input=<file>                 saves the input events to replay them with -benchmark
+ *   -benchmark=<file>   replays recorded input events as fast as possible and prints timings
+ *   -benchmark-suite=<map>               measures some subsystems on a test map and prints timings
  *   -quest-size=<width>x<height>         sets the size of the drawing area (if compatible with the quest)
+ *   -tileset-cache-size=<kilobytes>      sets the memory kept for tilesets that no map uses
+ *   -music-buffer=<milliseconds>         sets the duration of music decoded in advance (default 1000)
  *
  * \param argc number of command-line arguments
  * \param argv command-line arguments
@@ -92,9 +101,27 @@ static void print_help(int argc, char **argv) {
     << std::endl
     << "  -no-audio           disables sounds and musics"
     << std::endl
+    << "  -lazy-sounds        decodes each sound when it is first played instead of preloading them all"
+    << std::endl
+    << "  -sound-cache        keeps decoded sounds in the quest write directory to load them faster"
+    << std::endl
     << "  -no-video           disables displaying (may be useful for automated tests)"
     << std::endl
+    << "  -render-thread      prepares frames in a separate thread (pipelined rendering)"
+    << std::endl
+    << "  -profile[=<file>]   measures the time of each subsystem and writes a Chrome trace on exit"
+    << std::endl
+    << "  -record-input=<file>                 saves the input events to replay them with -benchmark"
+    << std::endl
+    << "  -benchmark=<file>   replays recorded input events as fast as possible and prints timings"
+    << std::endl
+    << "  -benchmark-suite=<map>               measures some subsystems on a test map and prints timings"
+    << std::endl
     << "  -quest-size=<width>x<height>         sets the size of the drawing area (if compatible with the quest)"
+    << std::endl
+    << "  -tileset-cache-size=<kilobytes>      sets the memory kept for tilesets that no map uses"
+    << std::endl
+    << "  -music-buffer=<milliseconds>         sets the duration of music decoded in advance (default 1000)"
     << std::endl;
 }
 
@@ -16,8 +16,17 @@
  */
 #include "movements/PathFinding.h"
 #include "entities/MapEntity.h"
+#include "entities/MapEntities.h"
+#include "movements/WalkabilityGrid.h"
 #include "Map.h"
 #include "lowlevel/Debug.h"
+#include <algorithm>
+
+std::vector<PathFinding::Node> PathFinding::nodes;
+std::vector<PathFinding::OpenNode> PathFinding::open_list;
+std::vector<PathFinding::Region> PathFinding::regions;
+std::vector<int> PathFinding::regions_queue;
+uint32_t PathFinding::search_id = 0;
 
 const Rectangle PathFinding::neighbours_locations[] = {
   Rectangle( 8,  0, 16, 16 ),
@@ -54,7 +63,12 @@ PathFinding::PathFinding(
     const MapEntity& target_entity):
   map(map),
   source_entity(source_entity),
-  target_entity(target_entity) {
+  target_entity(target_entity),
+  walkability(map.get_entities().get_walkability_grid()),
+  layer(source_entity.get_layer()),
+  ground_profile(WalkabilityGrid::get_ground_profile(source_entity)),
+  nb_regions_x((map.get_width8() + region_size - 1) / region_size),
+  nb_regions_y((map.get_height8() + region_size - 1) / region_size) {
 
   Debug::check_assertion(source_entity.is_aligned_to_grid(),
       "The source must be aligned on the map grid");
@@ -69,14 +83,9 @@ PathFinding::~PathFinding() {
 /**
  * \brief Tries to find a path between the source point and the target point.
  * \return the path found, or an empty string if no path was found
- * (because there is no path or the target is too far)
  */
 std::string PathFinding::compute_path() {
 
-  //std::cout << "will compute a path from " << source_entity.get_top_left_x() << ","
-  //  << source_entity.get_top_left_y() << " to " << target_entity.get_top_left_x() << ","
-  //  << target_entity.get_top_left_y() << std::endl;
-
   const Rectangle& source = source_entity.get_bounding_box();
   Rectangle target = target_entity.get_bounding_box();
 
@@ -84,21 +93,89 @@ std::string PathFinding::compute_path() {
   target.add_x(-target.get_x() % 8);
   target.add_y(4);
   target.add_y(-target.get_y() % 8);
-  int target_index = get_square_index(target);
 
   Debug::check_assertion(target.get_x() % 8 == 0 && target.get_y() % 8 == 0,
       "Could not snap the target to the map grid");
 
-  int total_mdistance = get_manhattan_distance(source, target);
-  if (total_mdistance > 200 || target_entity.get_layer() != source_entity.get_layer()) {
-    //std::cout << "too far, not computing a path\n";
-    return ""; // too far to compute a path
+  if (target_entity.get_layer() != layer
+      || map.test_collision_with_border(target.get_x(), target.get_y())) {
+    return "";
   }
 
-  std::string path = "";
+  start_search();
+
+  if (get_manhattan_distance(source, target) <= max_local_distance) {
+    // The target is close: explore all nodes around.
+    return search_path(source, target, false);
+  }
+
+  // The target is far: only explore the regions that lead to it.
+  if (!find_corridor(source, target)) {
+    return "";
+  }
+  return search_path(source, target, true);
+}
+
+/**
+ * \brief Prepares the static data for a new computation.
+ *
+ * Nodes and regions reached by previous computations are forgotten.
+ */
+void PathFinding::start_search() {
+
+  const size_t nb_squares = map.get_width8() * map.get_height8();
+  if (nodes.size() < nb_squares) {
+    Node unreached_node;
+    unreached_node.search_id = 0;
+    nodes.resize(nb_squares, unreached_node);
+  }
+
+  const size_t nb_regions = nb_regions_x * nb_regions_y;
+  if (regions.size() < nb_regions) {
+    Region unreached_region;
+    unreached_region.search_id = 0;
+    unreached_region.corridor_id = 0;
+    regions.resize(nb_regions, unreached_region);
+  }
+
+  ++search_id;
+  if (search_id == 0) {
+    // The counter has wrapped: mark everything as unreached explicitly.
+    std::vector<Node>::iterator it;
+    for (it = nodes.begin(); it != nodes.end(); ++it) {
+      it->search_id = 0;
+    }
+    std::vector<Region>::iterator region_it;
+    for (region_it = regions.begin(); region_it != regions.end(); ++region_it) {
+      region_it->search_id = 0;
+      region_it->corridor_id = 0;
+    }
+    search_id = 1;
+  }
+}
+
+/**
+ * \brief Runs the A* algorithm on the nodes of the map.
+ * \param source The starting point.
+ * \param target The target point, aligned on the map grid.
+ * \param in_corridor \c true to only explore the regions found by
+ * find_corridor(), \c false to only explore nodes close to the target.
+ * \return the path found, or an empty string if no path was found
+ */
+std::string PathFinding::search_path(
+    const Rectangle& source, const Rectangle& target, bool in_corridor) {
+
+  if (!is_on_map(source)) {
+    // the entity to move is partly outside the map: it has no node
+    return "";
+  }
+
+  const int target_index = get_square_index(target);
+  const int total_mdistance = get_manhattan_distance(source, target);
+  open_list.clear();
 
-  Node starting_node;
   int index = get_square_index(source);
+  Node& starting_node = nodes[index];
   starting_node.location = source;
   starting_node.index = index;
   starting_node.previous_cost = 0;
@@ -106,92 +183,241 @@ std::string PathFinding::compute_path() {
   starting_node.total_cost = total_mdistance;
   starting_node.direction = ' ';
   starting_node.parent_index = -1;
+  starting_node.search_id = search_id;
+  starting_node.closed = false;
+  push_open_node(starting_node);
 
-  open_list[index] = starting_node;
-  open_list_indices.push_front(index);
-
-  bool finished = false;
-  while (!finished) {
+  const int map_width = map.get_width();
+  const int map_height = map.get_height();
+  while (!open_list.empty()) {
 
     // pick the node with the lowest total cost in the open list
-    int index = open_list_indices.front();
-    Node* current_node = &open_list[index];
-    open_list_indices.pop_front();
-    closed_list[index] = *current_node;
-    open_list.erase(index);
-    current_node = &closed_list[index];
-
-    //std::cout << System::now() << " picking the lowest cost node in the open list ("
-    //  << (open_list_indices.size() + 1) << " elements): "
-    //  << current_node->location << ", index = " << current_node->index
-    //  << ", cost = " << current_node->previous_cost << " + " << current_node->heuristic << "\n";
+    std::pop_heap(open_list.begin(), open_list.end());
+    const OpenNode open_node = open_list.back();
+    open_list.pop_back();
+
+    index = open_node.index;
+    Node& current_node = nodes[index];
+    if (current_node.closed || open_node.total_cost != current_node.total_cost) {
+      // a better path to this node was already found
+      continue;
+    }
+    current_node.closed = true;
 
     if (index == target_index) {
-      //std::cout << "target node was added to the closed list\n";
-      finished = true;
-      path = rebuild_path(current_node);
-      //std::cout << "rebuild done\n";
+      return rebuild_path(current_node);
     }
-    else {
-      // look at the accessible nodes from it
-      //std::cout << System::now() << " looking for accessible states\n";
-      for (int i = 0; i < 8; i++) {
-
-        Node new_node;
-        int immediate_cost = (i & 1) ? 11 : 8;
-        new_node.previous_cost = current_node->previous_cost + immediate_cost;
-        new_node.location = current_node->location;
-        new_node.location.add_xy(neighbours_locations[i]);
-        new_node.index = get_square_index(new_node.location);
-        //std::cout << "  node in direction " << i << ": index = " << new_node.index << std::endl;
-
-        bool in_closed_list = (closed_list.find(new_node.index) != closed_list.end());
-        if (!in_closed_list && get_manhattan_distance(new_node.location, target) < 200
-            && is_node_transition_valid(*current_node, i)) {
-          //std::cout << "  node in direction " << i << " is not in the closed list\n";
-          // not in the closed list: look in the open list
-
-          bool in_open_list = open_list.find(new_node.index) != open_list.end();
-
-          if (!in_open_list) {
-            // not in the open list: add it
-            new_node.heuristic = get_manhattan_distance(new_node.location, target);
-            new_node.total_cost = new_node.previous_cost + new_node.heuristic;
-            new_node.parent_index = index;
-            new_node.direction = '0' + i;
-            open_list[new_node.index] = new_node;
-            add_index_sorted(&open_list[new_node.index]);
-            //std::cout << "  node in direction " << i << " is not in the open list, adding it with cost "
-            //  << new_node.previous_cost << " (" << current_node->previous_cost << " + "
-            //  << immediate_cost << ") + " << new_node.heuristic << " and parent " << new_node.parent_index << "\n";
-          }
-          else {
-            //std::cout << "  node in direction " << i << " is already in the open list\n";
-            Node* existing_node = &open_list[new_node.index];
-            // already in the open list: see if the current path is better
-            if (new_node.previous_cost < existing_node->previous_cost) {
-              existing_node->previous_cost = new_node.previous_cost;
-              existing_node->total_cost = existing_node->previous_cost + existing_node->heuristic;
-              existing_node->parent_index = index;
-              open_list_indices.sort();
-            }
-          }
+
+    // look at the accessible nodes from it
+    for (int i = 0; i < 8; i++) {
+
+      Rectangle location = current_node.location;
+      location.add_xy(neighbours_locations[i]);
+      if (location.get_x() < 0
+          || location.get_y() < 0
+          || location.get_x() + location.get_width() > map_width
+          || location.get_y() + location.get_height() > map_height) {
+        // outside the map
+        continue;
+      }
+
+      if (in_corridor
+          && regions[get_region_index(location)].corridor_id != search_id) {
+        // outside the regions to explore
+        continue;
+      }
+
+      int new_index = get_square_index(location);
+      Node& new_node = nodes[new_index];
+      bool reached = (new_node.search_id == search_id);
+      if (reached && new_node.closed) {
+        continue;
+      }
+
+      int heuristic = get_manhattan_distance(location, target);
+      if ((!in_corridor && heuristic >= max_local_distance)
+          || !is_node_transition_valid(current_node, i)) {
+        continue;
+      }
+
+      int immediate_cost = (i & 1) ? 11 : 8;
+      int previous_cost = current_node.previous_cost + immediate_cost;
+      if (!reached) {
+        // not in the open list: add it
+        new_node.location = location;
+        new_node.index = new_index;
+        new_node.heuristic = heuristic;
+        new_node.search_id = search_id;
+        new_node.closed = false;
+      }
+      else if (previous_cost >= new_node.previous_cost) {
+        // already in the open list with a better path
+        continue;
+      }
+
+      new_node.previous_cost = previous_cost;
+      new_node.total_cost = previous_cost + new_node.heuristic;
+      new_node.parent_index = index;
+      new_node.direction = '0' + i;
+      push_open_node(new_node);
+    }
+  }
+
+  // no path
+  return "";
+}
+
+/**
+ * \brief Finds a sequence of connected regions from the source to the target.
+ *
+ * This is a breadth-first search on the regions of the map.
+ * The regions found and their neighbours are marked as the corridor that
+ * search_path() will explore.
+ * Only the terrain is considered at this level, so a corridor does not
+ * guarantee that a path exists, but no corridor means that there is no path.
+ *
+ * \param source The starting point.
+ * \param target The target point.
+ * \return \c false if the target cannot be reached.
+ */
+bool PathFinding::find_corridor(const Rectangle& source, const Rectangle& target) {
+
+  if (!is_on_map(source) || !is_on_map(target)) {
+    // no region contains them
+    return false;
+  }
+
+  const int source_region = get_region_index(source);
+  const int target_region = get_region_index(target);
+
+  regions_queue.clear();
+  regions_queue.push_back(source_region);
+  regions[source_region].search_id = search_id;
+  regions[source_region].parent_index = -1;
+
+  bool found = false;
+  for (size_t i = 0; i < regions_queue.size() && !found; ++i) {
+
+    const int index = regions_queue[i];
+    if (index == target_region) {
+      found = true;
+      break;
+    }
+
+    const int region_x = index % nb_regions_x;
+    const int region_y = index / nb_regions_x;
+    for (int y = region_y - 1; y <= region_y + 1; ++y) {
+      for (int x = region_x - 1; x <= region_x + 1; ++x) {
+
+        if (x < 0 || y < 0 || x >= nb_regions_x || y >= nb_regions_y) {
+          continue;
         }
-        else {
-          //std::cout << "skipping node in direction " << i << ": already in closed list = "
-          //  << in_closed_list << ", too far from target = "
-          //  << (get_manhattan_distance(new_node.location, target) >= 200) << ", invalid transition = "
-          //  << (!is_node_transition_valid(*current_node, i)) << std::endl;
+
+        const int neighbour_index = y * nb_regions_x + x;
+        Region& neighbour = regions[neighbour_index];
+        if (neighbour.search_id != search_id
+            && are_regions_connected(index, neighbour_index)) {
+          neighbour.search_id = search_id;
+          neighbour.parent_index = index;
+          regions_queue.push_back(neighbour_index);
         }
       }
-      if (open_list_indices.empty()) {
-        finished = true;
+    }
+  }
+
+  if (!found) {
+    return false;
+  }
+
+  // Mark the regions of the corridor and their neighbours, so that the
+  // path may go around obstacle entities.
+  int index = target_region;
+  while (index != -1) {
+    const int region_x = index % nb_regions_x;
+    const int region_y = index / nb_regions_x;
+    for (int y = std::max(0, region_y - 1); y <= std::min(nb_regions_y - 1, region_y + 1); ++y) {
+      for (int x = std::max(0, region_x - 1); x <= std::min(nb_regions_x - 1, region_x + 1); ++x) {
+        regions[y * nb_regions_x + x].corridor_id = search_id;
       }
     }
+    index = regions[index].parent_index;
   }
 
-  //std::cout << "path found: " << path << ", open nodes: " << open_list.size() << ", closed nodes: " << closed_list.size() << std::endl;
-  return path;
+  return true;
+}
+
+/**
+ * \brief Returns whether two neighbour regions have a portal.
+ *
+ * A portal is a pair of adjacent squares (including diagonally), one in
+ * each region, where the terrain is not entirely blocked.
+ *
+ * \param region_index1 Index of a region.
+ * \param region_index2 Index of a neighbour region.
+ * \return \c true if the terrain may allow to go from one region to the other.
+ */
+bool PathFinding::are_regions_connected(
+    int region_index1, int region_index2) const {
+
+  // Squares of each region.
+  const int x1 = (region_index1 % nb_regions_x) * region_size;
+  const int y1 = (region_index1 / nb_regions_x) * region_size;
+  const int x2 = (region_index2 % nb_regions_x) * region_size;
+  const int y2 = (region_index2 / nb_regions_x) * region_size;
+
+  // Squares of the first region that touch the second one.
+  const int min_x = std::max(x1, x2 - 1);
+  const int max_x = std::min(x1 + region_size - 1, x2 + region_size);
+  const int min_y = std::max(y1, y2 - 1);
+  const int max_y = std::min(y1 + region_size - 1, y2 + region_size);
+
+  for (int y = min_y; y <= max_y; ++y) {
+    for (int x = min_x; x <= max_x; ++x) {
+
+      if (walkability.get_square_state(layer, ground_profile, x, y)
+          == WalkabilityGrid::SQUARE_BLOCKED) {
+        continue;
+      }
+
+      // Squares of the second region adjacent to this one.
+      for (int j = std::max(y2, y - 1); j <= std::min(y2 + region_size - 1, y + 1); ++j) {
+        for (int i = std::max(x2, x - 1); i <= std::min(x2 + region_size - 1, x + 1); ++i) {
+          if (walkability.get_square_state(layer, ground_profile, i, j)
+              != WalkabilityGrid::SQUARE_BLOCKED) {
+            return true;
+          }
+        }
+      }
+    }
+  }
+
+  return false;
+}
+
+/**
+ * \brief Returns the index of the region
+ * corresponding to the specified location.
+ * \param location location of a node on the map
+ * \return index of the region containing the top-left part of the location
+ */
+int PathFinding::get_region_index(const Rectangle& location) const {
+
+  int x = location.get_x() / (8 * region_size);
+  int y = location.get_y() / (8 * region_size);
+  return y * nb_regions_x + x;
+}
+
+/**
+ * \brief Returns whether the top-left corner of a location is inside the map.
+ * \param location location of a node on the map
+ * \return \c true if the location has a square on the map
+ */
+bool PathFinding::is_on_map(const Rectangle& location) const {
+
+  return location.get_x() >= 0
+      && location.get_y() >= 0
+      && location.get_x() < map.get_width()
+      && location.get_y() < map.get_height();
 }
 
 /**
@@ -222,52 +448,55 @@ int PathFinding::get_manhattan_distance(
 
 
 /**
- * \brief Compares two nodes according to their total estimated cost.
- * \param other the other node
+ * \brief Compares two elements of the open list.
+ *
+ * The heap keeps its greatest element first, so an element is considered
+ * lower than another one when its cost is higher.
+ * On equal total costs, the node closer to the target comes first.
+ *
+ * \param other the other element
+ * \return true if this element should be picked after the other one
  */
-bool PathFinding::Node::operator<(const Node& other) const {
-  return total_cost < other.total_cost;
+bool PathFinding::OpenNode::operator<(const OpenNode& other) const {
+
+  if (total_cost != other.total_cost) {
+    return total_cost > other.total_cost;
+  }
+  return heuristic > other.heuristic;
 }
 
 /**
- * \brief Adds the index of a node to the sorted list of indices of the open
- * list, making sure the list remains sorted.
+ * \brief Adds a node to the open list.
+ *
+ * If the node was already in the open list, its previous element becomes
+ * obsolete and will be skipped.
+ *
  * \param node The node.
  */
-void PathFinding::add_index_sorted(Node* node) {
-
-  bool inserted = false;
-  std::list<int>::iterator i;
-  for (i = open_list_indices.begin();
-      i != open_list_indices.end() && !inserted;
-      ++i) {
-    int index = *i;
-    Node* current_node = &open_list[index];
-    if (current_node->total_cost >= node->total_cost) {
-      open_list_indices.insert(i, node->index);
-      inserted = true;
-    }
-  }
-
-  if (!inserted) {
-    open_list_indices.push_back(node->index);
-  }
+void PathFinding::push_open_node(const Node& node) {
+
+  OpenNode open_node;
+  open_node.total_cost = node.total_cost;
+  open_node.heuristic = node.heuristic;
+  open_node.index = node.index;
+  open_list.push_back(open_node);
+  std::push_heap(open_list.begin(), open_list.end());
 }
 
 /**
  * \brief Builds the string representation of the path found by the algorithm.
- * \param closed_list The closed list of A*.
- * \return final_node The final node of the path.
+ * \param final_node The final node of the path.
+ * \return The path.
  */
-std::string PathFinding::rebuild_path(const Node* final_node) {
+std::string PathFinding::rebuild_path(const Node& final_node) const {
 
-  const Node* current_node = final_node;
+  const Node* current_node = &final_node;
   std::string path = "";
   while (current_node->direction != ' ') {
-    path = current_node->direction + path;
-    current_node = &closed_list[current_node->parent_index];
-    //std::cout << "current_node: " << current_node->index << ", path = " << path << std::endl;
+    path += current_node->direction;
+    current_node = &nodes[current_node->parent_index];
   }
+  std::reverse(path.begin(), path.end());
   return path;
 }
 
@@ -284,6 +513,7 @@ bool PathFinding::is_node_transition_valid(
   Rectangle collision_box = transition_collision_boxes[direction];
   collision_box.add_xy(initial_node.location);
 
-  return !map.test_collision_with_obstacles(source_entity.get_layer(), collision_box, source_entity);
+  return !walkability.test_collision_with_obstacles(
+      layer, ground_profile, collision_box, source_entity);
 }
 
@@ -16,12 +16,14 @@
  */
 #include "movements/StraightMovement.h"
 #include "entities/MapEntity.h"
+#include "Map.h"
 #include "lua/LuaContext.h"
 #include "lowlevel/System.h"
 #include "lowlevel/Geometry.h"
 #include "lowlevel/Debug.h"
 #include "lowlevel/StringConcat.h"
 #include <cmath>
+#include <cstdlib>
 
 /**
  * \brief Constructor.
@@ -41,7 +43,8 @@ StraightMovement::StraightMovement(bool ignore_obstacles, bool smooth):
   y_move(0),
   max_distance(0),
   finished(false),
-  smooth(smooth) {
+  smooth(smooth),
+  swept(false) {
 
 }
 
@@ -364,6 +367,32 @@ void StraightMovement::set_smooth(bool smooth) {
   this->smooth = smooth;
 }
 
+/**
+ * \brief Returns whether the movement makes all pixel moves that are due
+ * at once.
+ * \return true if the movement is swept
+ */
+bool StraightMovement::is_swept() const {
+  return this->swept;
+}
+
+/**
+ * \brief Sets whether the movement makes all pixel moves that are due
+ * at once.
+ *
+ * When the movement is late of several pixels (because it is fast or
+ * because a frame took long), a swept movement checks obstacles and
+ * detectors along the whole path in one pass, and then notifies the
+ * entity of its new position only once.
+ * The entity and its ground are only updated at the final position,
+ * which is why this is not the default.
+ *
+ * \param swept true to make the movement swept
+ */
+void StraightMovement::set_swept(bool swept) {
+  this->swept = swept;
+}
+
 /**
  * \brief Updates the x position of the entity if it wants to move
  * (smooth version).
@@ -611,6 +640,11 @@ void StraightMovement::update_y() {
 void StraightMovement::update() {
 
   if (!is_suspended()) {
+
+    if (swept) {
+      update_swept();
+    }
+
     uint32_t now = System::now();
 
     bool x_move_now = x_move != 0 && now >= next_move_date_x;
@@ -679,6 +713,97 @@ void StraightMovement::update() {
   Movement::update();
 }
 
+/**
+ * \brief Makes at once all pixel moves that are due, as far as possible.
+ *
+ * The positions that update() would go through one pixel at a time are
+ * computed first. The entity goes through them as long as no obstacle
+ * blocks it: detectors are notified in order at each intermediate
+ * position, and the entity is then moved to the last one with a normal
+ * position change notification.
+ * Remaining moves (if an obstacle is reached) are left to update().
+ */
+void StraightMovement::update_swept() {
+
+  MapEntity* entity = get_entity();
+  if (entity == NULL || !entity->is_on_map() || finished) {
+    return;
+  }
+
+  const uint32_t now = System::now();
+  const int start_x = get_x();
+  const int start_y = get_y();
+  int x = start_x;
+  int y = start_y;
+  uint32_t date_x = next_move_date_x;
+  uint32_t date_y = next_move_date_y;
+  bool x_move_now = x_move != 0 && now >= date_x;
+  bool y_move_now = y_move != 0 && now >= date_y;
+
+  // Compute the path in the same order as the pixel by pixel loop.
+  swept_path.clear();
+  while (x_move_now || y_move_now) {
+
+    if (x_move_now && (!y_move_now || date_x <= date_y)) {
+      x += x_move;
+      date_x += x_delay;
+    }
+    else {
+      y += y_move;
+      date_y += y_delay;
+    }
+    swept_path.push_back(Rectangle(x, y));
+
+    if (max_distance != 0 && Geometry::get_distance(initial_xy.get_x(),
+        initial_xy.get_y(), x, y) >= max_distance) {
+      break;
+    }
+
+    x_move_now = x_move != 0 && now >= date_x;
+    y_move_now = y_move != 0 && now >= date_y;
+  }
+
+  if (swept_path.size() < 2) {
+    // Nothing to gain.
+    return;
+  }
+
+  Map& map = entity->get_map();
+  int nb_positions = swept_path.size();
+  if (!are_obstacles_ignored()) {
+    nb_positions = map.get_nb_reachable_positions(*entity, swept_path);
+    if (nb_positions < 2) {
+      return;
+    }
+  }
+
+  const int nb_reached = map.check_collision_with_detectors(
+      *entity, swept_path, nb_positions);
+
+  const Rectangle& xy = swept_path[nb_reached - 1];
+  next_move_date_x += std::abs(xy.get_x() - start_x) * x_delay;
+  next_move_date_y += std::abs(xy.get_y() - start_y) * y_delay;
+
+  if (get_entity() != entity) {
+    // A detector has given another movement to the entity.
+    return;
+  }
+
+  if (nb_reached < nb_positions
+      && (entity->get_x() != xy.get_x() || entity->get_y() != xy.get_y())) {
+    // A detector has moved the entity.
+    return;
+  }
+
+  // Notify the new position normally.
+  set_xy(xy);
+
+  if (!finished && max_distance != 0 && Geometry::get_distance(initial_xy.get_x(),
+      initial_xy.get_y(), get_x(), get_y()) >= max_distance) {
+    set_finished();
+  }
+}
+
 /**
  * \brief Returns the name identifying this type in Lua.
  * \return the name identifying this type in Lua
@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2006-2013 Christopho, Solarus - http://www.solarus-games.org
+ * 
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "movements/WalkabilityGrid.h"
+#include "entities/MapEntity.h"
+#include "lowlevel/Rectangle.h"
+#include "Map.h"
+#include <algorithm>
+
+/**
+ * \brief Creates an empty walkability cache.
+ * \param map The map. Its size does not have to be known yet.
+ */
+WalkabilityGrid::WalkabilityGrid(const Map& map):
+  map(map),
+  valid(true) {
+
+}
+
+/**
+ * \brief Destructor.
+ */
+WalkabilityGrid::~WalkabilityGrid() {
+
+}
+
+/**
+ * \brief Forgets all squares computed so far.
+ *
+ * Call this function when the ground of the map has changed.
+ * This is fast: squares are only recomputed when they are needed again.
+ */
+void WalkabilityGrid::invalidate() {
+
+  valid = false;
+}
+
+/**
+ * \brief Forgets the squares computed so far in a rectangle of a layer.
+ *
+ * Call this function when the ground has changed in this rectangle,
+ * for example under a ground modifier that has moved.
+ *
+ * \param layer The layer where the ground has changed.
+ * \param where The rectangle where the ground has changed.
+ */
+void WalkabilityGrid::invalidate(Layer layer, const Rectangle& where) {
+
+  if (!valid) {
+    // Everything will be recomputed anyway.
+    return;
+  }
+
+  const int width8 = map.get_width8();
+  const int x1 = std::max(0, where.get_x() / 8);
+  const int x2 = std::min(width8 - 1, (where.get_x() + where.get_width() - 1) / 8);
+  const int y1 = std::max(0, where.get_y() / 8);
+  const int y2 = std::min(map.get_height8() - 1, (where.get_y() + where.get_height() - 1) / 8);
+  if (x1 > x2 || y1 > y2) {
+    return;
+  }
+
+  std::map<int, std::vector<uint8_t> >::iterator it;
+  for (it = squares[layer].begin(); it != squares[layer].end(); ++it) {
+    std::vector<uint8_t>& layer_squares = it->second;
+    if (layer_squares.empty()) {
+      continue;
+    }
+    for (int y8 = y1; y8 <= y2; ++y8) {
+      std::fill(layer_squares.begin() + y8 * width8 + x1,
+          layer_squares.begin() + y8 * width8 + x2 + 1,
+          uint8_t(SQUARE_UNKNOWN));
+    }
+  }
+}
+
+/**
+ * \brief Returns the ground obstacle properties of an entity.
+ *
+ * Two entities with the same profile have the same terrain obstacles.
+ *
+ * \param entity An entity.
+ * \return Its ground profile.
+ */
+int WalkabilityGrid::get_ground_profile(const MapEntity& entity) {
+
+  int ground_profile = 0;
+  if (entity.is_low_wall_obstacle()) {
+    ground_profile |= LOW_WALL_OBSTACLE;
+  }
+  if (entity.is_shallow_water_obstacle()) {
+    ground_profile |= SHALLOW_WATER_OBSTACLE;
+  }
+  if (entity.is_deep_water_obstacle()) {
+    ground_profile |= DEEP_WATER_OBSTACLE;
+  }
+  if (entity.is_hole_obstacle()) {
+    ground_profile |= HOLE_OBSTACLE;
+  }
+  if (entity.is_lava_obstacle()) {
+    ground_profile |= LAVA_OBSTACLE;
+  }
+  if (entity.is_prickle_obstacle()) {
+    ground_profile |= PRICKLE_OBSTACLE;
+  }
+  if (entity.is_ladder_obstacle()) {
+    ground_profile |= LADDER_OBSTACLE;
+  }
+  return ground_profile;
+}
+
+/**
+ * \brief Returns the state of a square of the map for a ground profile.
+ * \param layer Layer of the square.
+ * \param ground_profile Ground obstacle properties of the entity to check.
+ * \param x8 X coordinate of the square (in 8*8 squares).
+ * \param y8 Y coordinate of the square (in 8*8 squares).
+ * \return The state of this square. Squares outside the map are blocked.
+ */
+WalkabilityGrid::SquareState WalkabilityGrid::get_square_state(
+    Layer layer, int ground_profile, int x8, int y8) const {
+
+  const int width8 = map.get_width8();
+  if (x8 < 0 || y8 < 0 || x8 >= width8 || y8 >= map.get_height8()) {
+    return SQUARE_BLOCKED;
+  }
+
+  uint8_t& state = get_squares(layer, ground_profile)[y8 * width8 + x8];
+  if (state == SQUARE_UNKNOWN) {
+    state = compute_square_state(layer, ground_profile, x8, y8);
+  }
+  return SquareState(state);
+}
+
+/**
+ * \brief Tests whether a rectangle overlaps an obstacle for an entity.
+ *
+ * The result is always the same as
+ * Map::test_collision_with_obstacles(Layer, const Rectangle&, const MapEntity&),
+ * but the terrain is checked with the cache whenever possible.
+ * This is only the case if the rectangle is aligned on the 8*8 squares.
+ *
+ * \param layer Layer of the rectangle.
+ * \param ground_profile Ground profile of the entity.
+ * \param collision_box The rectangle to check.
+ * \param entity_to_check The entity to check.
+ * \return \c true if there is an obstacle in this rectangle.
+ */
+bool WalkabilityGrid::test_collision_with_obstacles(
+    Layer layer,
+    int ground_profile,
+    const Rectangle& collision_box,
+    const MapEntity& entity_to_check) const {
+
+  const int x = collision_box.get_x();
+  const int y = collision_box.get_y();
+  const int width = collision_box.get_width();
+  const int height = collision_box.get_height();
+  if (x < 0 || y < 0
+      || x % 8 != 0 || y % 8 != 0
+      || width % 8 != 0 || height % 8 != 0
+      || width == 0 || height == 0) {
+    return map.test_collision_with_obstacles(layer, collision_box, entity_to_check);
+  }
+
+  // The map only checks points on the border of the rectangle, and at
+  // least one point of each square of the border. So only these squares
+  // matter.
+  const int x1 = x / 8;
+  const int x2 = (x + width) / 8 - 1;
+  const int y1 = y / 8;
+  const int y2 = (y + height) / 8 - 1;
+  bool partial = false;
+  for (int y8 = y1; y8 <= y2; ++y8) {
+    const int step = (y8 == y1 || y8 == y2) ? 1 : std::max(1, x2 - x1);
+    for (int x8 = x1; x8 <= x2; x8 += step) {
+      SquareState state = get_square_state(layer, ground_profile, x8, y8);
+      if (state == SQUARE_BLOCKED) {
+        return true;
+      }
+      if (state == SQUARE_PARTIAL) {
+        partial = true;
+      }
+    }
+  }
+
+  if (partial) {
+    // A diagonal wall or a moving ground modifier: let the map check each point.
+    return map.test_collision_with_obstacles(layer, collision_box, entity_to_check);
+  }
+
+  // No collision with the terrain: check collisions with dynamic entities.
+  return map.test_collision_with_entities(layer, collision_box, entity_to_check);
+}
+
+/**
+ * \brief Returns the squares of a layer for a ground profile.
+ *
+ * The squares are created or reset if necessary.
+ *
+ * \param layer A layer.
+ * \param ground_profile A ground profile.
+ * \return The state of each square.
+ */
+std::vector<uint8_t>& WalkabilityGrid::get_squares(
+    Layer layer, int ground_profile) const {
+
+  if (!valid) {
+    for (int i = 0; i < LAYER_NB; ++i) {
+      std::map<int, std::vector<uint8_t> >::iterator it;
+      for (it = squares[i].begin(); it != squares[i].end(); ++it) {
+        std::fill(it->second.begin(), it->second.end(), uint8_t(SQUARE_UNKNOWN));
+      }
+    }
+    valid = true;
+  }
+
+  std::vector<uint8_t>& layer_squares = squares[layer][ground_profile];
+  if (layer_squares.empty()) {
+    layer_squares.resize(map.get_width8() * map.get_height8(), SQUARE_UNKNOWN);
+  }
+  return layer_squares;
+}
+
+/**
+ * \brief Computes the state of a square of the map.
+ *
+ * The ground is considered uniform in the square if it is the same at its
+ * four corners. This holds because tiles are aligned on squares and because
+ * ground modifiers are at least 8*8: any ground modifier overlapping the
+ * square also overlaps one of its corners.
+ *
+ * \param layer Layer of the square.
+ * \param ground_profile Ground obstacle properties of the entity to check.
+ * \param x8 X coordinate of the square (in 8*8 squares).
+ * \param y8 Y coordinate of the square (in 8*8 squares).
+ * \return The state of this square.
+ */
+WalkabilityGrid::SquareState WalkabilityGrid::compute_square_state(
+    Layer layer, int ground_profile, int x8, int y8) const {
+
+  const int x = x8 * 8;
+  const int y = y8 * 8;
+  const Ground ground = map.get_ground(layer, x, y);
+  if (map.get_ground(layer, x + 7, y) != ground
+      || map.get_ground(layer, x, y + 7) != ground
+      || map.get_ground(layer, x + 7, y + 7) != ground) {
+    return SQUARE_PARTIAL;
+  }
+
+  return get_ground_state(ground, ground_profile);
+}
+
+/**
+ * \brief Returns the state of a square entirely made of a ground.
+ *
+ * This is consistent with Map::test_collision_with_ground().
+ *
+ * \param ground A ground.
+ * \param ground_profile Ground obstacle properties of the entity to check.
+ * \return The state of a square with this ground.
+ */
+WalkabilityGrid::SquareState WalkabilityGrid::get_ground_state(
+    Ground ground, int ground_profile) {
+
+  int obstacle = 0;
+  switch (ground) {
+
+  case GROUND_EMPTY:
+  case GROUND_TRAVERSABLE:
+  case GROUND_GRASS:
+  case GROUND_ICE:
+    return SQUARE_FREE;
+
+  case GROUND_WALL:
+    return SQUARE_BLOCKED;
+
+  case GROUND_WALL_TOP_RIGHT:
+  case GROUND_WALL_TOP_RIGHT_WATER:
+  case GROUND_WALL_TOP_LEFT:
+  case GROUND_WALL_TOP_LEFT_WATER:
+  case GROUND_WALL_BOTTOM_LEFT:
+  case GROUND_WALL_BOTTOM_LEFT_WATER:
+  case GROUND_WALL_BOTTOM_RIGHT:
+  case GROUND_WALL_BOTTOM_RIGHT_WATER:
+    return SQUARE_PARTIAL;
+
+  case GROUND_LOW_WALL:
+    obstacle = LOW_WALL_OBSTACLE;
+    break;
+
+  case GROUND_SHALLOW_WATER:
+    obstacle = SHALLOW_WATER_OBSTACLE;
+    break;
+
+  case GROUND_DEEP_WATER:
+    obstacle = DEEP_WATER_OBSTACLE;
+    break;
+
+  case GROUND_HOLE:
+    obstacle = HOLE_OBSTACLE;
+    break;
+
+  case GROUND_LAVA:
+    obstacle = LAVA_OBSTACLE;
+    break;
+
+  case GROUND_PRICKLE:
+    obstacle = PRICKLE_OBSTACLE;
+    break;
+
+  case GROUND_LADDER:
+    obstacle = LADDER_OBSTACLE;
+    break;
+  }
+
+  return (ground_profile & obstacle) ? SQUARE_BLOCKED : SQUARE_FREE;
+}
+
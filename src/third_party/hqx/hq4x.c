@@ -163,7 +163,7 @@
 #define PIXEL33_81    *(dp+dpL+dpL+dpL+3) = Interp8(w[5], w[6]);
 #define PIXEL33_82    *(dp+dpL+dpL+dpL+3) = Interp8(w[5], w[8]);
 
-HQX_API void HQX_CALLCONV hq4x_32_rb( uint32_t * sp, uint32_t srb, uint32_t * dp, uint32_t drb, int Xres, int Yres )
+static void hq4x_32_rb_rows( uint32_t * sp, uint32_t srb, uint32_t * dp, uint32_t drb, int Xres, int Yres, int first_row, int last_row )
 {
     int  i, j, k;
     int  prevline, nextline;
@@ -185,7 +185,12 @@ HQX_API void HQX_CALLCONV hq4x_32_rb( uint32_t * sp, uint32_t srb, uint32_t * dp
     //   | w7 | w8 | w9 |
     //   +----+----+----+
 
-    for (j=0; j<Yres; j++)
+    sRowP += srb * first_row;
+    sp = (uint32_t *) sRowP;
+    dRowP += drb * 4 * first_row;
+    dp = (uint32_t *) dRowP;
+
+    for (j=first_row; j<last_row; j++)
     {
         if (j>0)      prevline = -spL; else prevline = 0;
         if (j<Yres-1) nextline =  spL; else nextline = 0;
@@ -5226,6 +5231,17 @@ HQX_API void HQX_CALLCONV hq4x_32_rb( uint32_t * sp, uint32_t srb, uint32_t * dp
     }
 }
 
+HQX_API void HQX_CALLCONV hq4x_32_rb( uint32_t * sp, uint32_t srb, uint32_t * dp, uint32_t drb, int Xres, int Yres )
+{
+    hq4x_32_rb_rows(sp, srb, dp, drb, Xres, Yres, 0, Yres);
+}
+
+HQX_API void HQX_CALLCONV hq4x_32_rows( uint32_t * sp, uint32_t * dp, int Xres, int Yres, int first_row, int last_row )
+{
+    uint32_t rowBytesL = Xres * 4;
+    hq4x_32_rb_rows(sp, rowBytesL, dp, rowBytesL * 4, Xres, Yres, first_row, last_row);
+}
+
 HQX_API void HQX_CALLCONV hq4x_32( uint32_t * sp, uint32_t * dp, int Xres, int Yres )
 {
     uint32_t rowBytesL = Xres * 4;